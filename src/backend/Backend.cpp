@@ -0,0 +1,113 @@
+#include "Backend.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include "NativeBackend.h"
+#include "ReferenceBackend.h"
+#ifdef REVGRAD_HAVE_CBLAS
+#include "BlasBackend.h"
+#endif
+
+#ifndef REVGRAD_DEFAULT_BACKEND
+#define REVGRAD_DEFAULT_BACKEND "native"
+#endif
+
+namespace RevGrad {
+    namespace BackendUtill {
+        namespace {
+            std::unique_ptr<Backend> make_backend(const std::string& name) {
+                if (name == "native") {
+                    return std::make_unique<NativeBackend>();
+                }
+                if (name == "reference") {
+                    return std::make_unique<ReferenceBackend>();
+                }
+#ifdef REVGRAD_HAVE_CBLAS
+                if (name == "blas") {
+                    return std::make_unique<BlasBackend>();
+                }
+#endif
+                std::string names;
+                for (const std::string& available : available_backends()) {
+                    names += (names.empty() ? "" : ", ") + available;
+                }
+                throw std::invalid_argument("unknown backend '" + name + "', available: " + names);
+            }
+
+            std::unique_ptr<Backend>& current() {
+                static std::unique_ptr<Backend> backend = [] {
+                    const char* name = std::getenv("REVGRAD_BACKEND");
+                    if (name) {
+                        try {
+                            return make_backend(name);
+                        } catch (const std::invalid_argument& e) {
+                            std::cerr << "REVGRAD_BACKEND: " << e.what() << ", using " << REVGRAD_DEFAULT_BACKEND << std::endl;
+                        }
+                    }
+                    return make_backend(REVGRAD_DEFAULT_BACKEND);
+                }();
+                return backend;
+            }
+        }
+
+        Backend& backend() {
+            return *current();
+        }
+
+        void set_backend(const std::string& name) {
+            current() = make_backend(name);
+        }
+
+        std::vector<std::string> available_backends() {
+            std::vector<std::string> names = {"native", "reference"};
+#ifdef REVGRAD_HAVE_CBLAS
+            names.push_back("blas");
+#endif
+            return names;
+        }
+    }
+
+    namespace {
+        /*
+            @return the row-major (rows, cols) matrix u as floats, copied into scratch with 
+            ld set to cols if u has a half type
+        */
+        const float* widen(const void* u, DType type, int rows, int cols, int& ld, std::vector<float>& scratch) {
+            if (type == DType::Float32) {
+                return static_cast<const float*>(u);
+            }
+            scratch.resize((size_t)rows * cols);
+            for (int i = 0; i < rows; i++) {
+                HalfUtill::to_float(type, static_cast<const Half*>(u) + (long long)i * ld, scratch.data() + (long long)i * cols, cols);
+            }
+            ld = cols;
+            return scratch.data();
+        }
+    }
+
+    void Backend::gemm(
+        bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+        float beta, float* c, int ldc
+    ) {
+        std::vector<float> a_scratch, b_scratch;
+        const float* a_values = widen(a, a_type, trans_a ? k : m, trans_a ? m : k, lda, a_scratch);
+        const float* b_values = widen(b, b_type, trans_b ? n : k, trans_b ? k : n, ldb, b_scratch);
+        gemm(trans_a, trans_b, m, n, k, alpha, a_values, lda, b_values, ldb, beta, c, ldc);
+    }
+
+    void Backend::linear(
+        Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+        const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+        const float* bias, int bias_axis, float* c, int ldc
+    ) {
+        std::vector<float> a_scratch, b_scratch;
+        const float* a_values = widen(a, a_type, trans_a ? k : m, trans_a ? m : k, lda, a_scratch);
+        const float* b_values = widen(b, b_type, trans_b ? n : k, trans_b ? k : n, ldb, b_scratch);
+        linear(act, trans_a, trans_b, m, n, k, a_values, lda, b_values, ldb, bias, bias_axis, c, ldc);
+    }
+}
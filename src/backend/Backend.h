@@ -0,0 +1,149 @@
+#ifndef REVGRAD_BACKEND_H
+#define REVGRAD_BACKEND_H
+
+#include <string>
+#include <vector>
+
+#include "../kernel/Broadcast.h"
+#include "../kernel/Half.h"
+
+namespace RevGrad {
+    enum class BinaryOp { Add, Subtract, Multiply, Divide };
+    enum class UnaryOp { Exp, Log, Relu, Sigmoid, Tanh };
+    enum class Activation { None, Relu, Sigmoid, Tanh };
+
+    /*
+        Compute kernels used by the tensor ops. All buffers are float arrays, except the
+        operands of the typed gemm and linear. Elementwise kernels are described by a
+        BroadcastUtill::Plan and reductions by an (outer, reduce, inner) decomposition of a
+        dense input.
+    */
+    class Backend {
+    public:
+        virtual ~Backend() {}
+        virtual const char* name() const = 0;
+        /*
+            C = alpha * op(A) * op(B) + beta * C for row-major matrices
+        */
+        virtual void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc
+        ) = 0;
+        /*
+            gemm with operands stored as a_type and b_type (see DType). The default copies
+            half operands into float buffers first, backends that convert them while loading
+            override it.
+        */
+        virtual void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            float beta, float* c, int ldc
+        );
+        /*
+            C = act(op(A) * op(B) + bias) for row-major matrices, where bias holds one value 
+            per row of C when bias_axis is 0 and one per column when it is 1
+        */
+        virtual void linear(
+            Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+            const float* a, int lda, const float* b, int ldb,
+            const float* bias, int bias_axis, float* c, int ldc
+        ) = 0;
+        /*
+            linear with operands stored as a_type and b_type, like the typed gemm
+        */
+        virtual void linear(
+            Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+            const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            const float* bias, int bias_axis, float* c, int ldc
+        );
+        /*
+            Backward of the bias and activation of linear from its dense (m, n) output c:
+            z_grad = c_grad * act'(c) is written and its sums along the axis other than 
+            bias_axis are accumulated into bias_grad, unless bias_grad is null. The operand 
+            gradients follow from z_grad with two gemm calls.
+        */
+        virtual void linear_backward(
+            Activation act, int m, int n, const float* c, const float* c_grad, 
+            float* z_grad, int bias_axis, float* bias_grad
+        ) = 0;
+        /*
+            w = op(u, v) with plan operands (w, u, v)
+        */
+        virtual void binary(BinaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u, const float* v) = 0;
+        /*
+            Accumulates the gradient of operand x (0 for u, 1 for v) with plan operands 
+            (w_grad, u, v, x_grad), reduced over the dimensions along which x is broadcast
+        */
+        virtual void binary_backward(
+            BinaryOp op, int x, const BroadcastUtill::Plan& plan, 
+            float* x_grad, const float* w_grad, const float* u, const float* v
+        ) = 0;
+        /*
+            w = op(u) with plan operands (w, u)
+        */
+        virtual void unary(UnaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u) = 0;
+        /*
+            Accumulates u_grad with plan operands (u_grad, w_grad, u, w), where w is the
+            output of the forward pass
+        */
+        virtual void unary_backward(
+            UnaryOp op, const BroadcastUtill::Plan& plan, 
+            float* u_grad, const float* w_grad, const float* u, const float* w
+        ) = 0;
+        /*
+            w[o, i] = sum_r u[o, r, i]
+        */
+        virtual void sum(const float* u, int outer, int reduce, int inner, float* w) = 0;
+        /*
+            u_grad[o, r, i] += w_grad[o, i]
+        */
+        virtual void sum_backward(const float* w_grad, int outer, int reduce, int inner, float* u_grad) = 0;
+        /*
+            w[o, i] = max_r u[o, r, i], argmax[o, i] is the first r reaching the maximum and
+            ties[o, i] the number of r reaching it
+        */
+        virtual void max(const float* u, int outer, int reduce, int inner, float* w, int* argmax, int* ties) = 0;
+        /*
+            w[o, :, i] = softmax(u[o, :, i]), or log_softmax when log is set
+        */
+        virtual void softmax(const float* u, int outer, int reduce, int inner, float* w, bool log) = 0;
+        /*
+            Accumulates u_grad from the forward output w: u_grad += w * (w_grad - sum(w_grad * w))
+            for softmax and u_grad += w_grad - exp(w) * sum(w_grad) for log_softmax
+        */
+        virtual void softmax_backward(
+            const float* w, const float* w_grad, int outer, int reduce, int inner, float* u_grad, bool log
+        ) = 0;
+        /*
+            loss[o, i] = log(sum_r exp(u[o, r, i])) - u[o, labels[o, i], i], the log-sum-exp of 
+            every line is written to lse for the backward
+        */
+        virtual void softmax_cross_entropy(
+            const float* u, const int* labels, int outer, int reduce, int inner, float* loss, float* lse
+        ) = 0;
+        /*
+            u_grad[o, r, i] += scale * (exp(u[o, r, i] - lse[o, i]) - (r == labels[o, i]))
+        */
+        virtual void softmax_cross_entropy_backward(
+            const float* u, const int* labels, const float* lse, int outer, int reduce, int inner, 
+            float scale, float* u_grad
+        ) = 0;
+    };
+
+    namespace BackendUtill {
+        /*
+            @return the active backend. On first use it is taken from the REVGRAD_BACKEND
+            environment variable, falling back to the build default (make BACKEND=...) with
+            a warning if the variable names no available backend
+        */
+        Backend& backend();
+        /*
+            @throws std::invalid_argument if name is not one of available_backends()
+        */
+        void set_backend(const std::string& name);
+        std::vector<std::string> available_backends();
+    }
+}
+
+#endif
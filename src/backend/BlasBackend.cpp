@@ -0,0 +1,29 @@
+#include "BlasBackend.h"
+
+#include <cblas.h>
+
+namespace RevGrad {
+    const char* BlasBackend::name() const { return "blas"; }
+
+    void BlasBackend::gemm(
+        bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const float* a, int lda, const float* b, int ldb,
+        float beta, float* c, int ldc
+    ) {
+        cblas_sgemm(
+            CblasRowMajor, trans_a ? CblasTrans : CblasNoTrans, trans_b ? CblasTrans : CblasNoTrans,
+            m, n, k, alpha, a, lda, b, ldb, beta, c, ldc
+        );
+    }
+
+    void BlasBackend::linear(
+        Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+        const float* a, int lda, const float* b, int ldb,
+        const float* bias, int bias_axis, float* c, int ldc
+    ) {
+        gemm(trans_a, trans_b, m, n, k, 1.0f, a, lda, b, ldb, 0.0f, c, ldc);
+        BroadcastUtill::parallel_for(m, (long long)m * n >= BroadcastUtill::PARALLEL_THRESHOLD, [&](int i) {
+            bias_activation(act, bias, bias_axis, c, ldc, i, i + 1, 0, n);
+        });
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef REVGRAD_BLAS_BACKEND_H
+#define REVGRAD_BLAS_BACKEND_H
+
+#include "NativeBackend.h"
+
+namespace RevGrad {
+    /*
+        Native kernels with matmul delegated to the system CBLAS (cblas_sgemm), only
+        built when the makefile finds a CBLAS library. CBLAS has no epilogue, so linear
+        applies its bias and activation in a second pass over the output. Half operands
+        have no CBLAS routine and go through the native kernels.
+    */
+    class BlasBackend : public NativeBackend {
+    public:
+        using NativeBackend::gemm;
+        using NativeBackend::linear;
+        const char* name() const override;
+        void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc
+        ) override;
+        void linear(
+            Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+            const float* a, int lda, const float* b, int ldb,
+            const float* bias, int bias_axis, float* c, int ldc
+        ) override;
+    };
+}
+
+#endif
@@ -0,0 +1,826 @@
+#include "NativeBackend.h"
+
+#include <cmath>
+#include <limits>
+
+#include "../kernel/Gemm.h"
+#include "../kernel/Math.h"
+
+namespace RevGrad {
+    const char* NativeBackend::name() const { return "native"; }
+
+    void NativeBackend::gemm(
+        bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const float* a, int lda, const float* b, int ldb,
+        float beta, float* c, int ldc
+    ) {
+        GemmUtill::sgemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    }
+
+    void NativeBackend::gemm(
+        bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+        float beta, float* c, int ldc
+    ) {
+        if (a_type == DType::Float32 && b_type == DType::Float32) {
+            gemm(
+                trans_a, trans_b, m, n, k, alpha, static_cast<const float*>(a), lda, 
+                static_cast<const float*>(b), ldb, beta, c, ldc
+            );
+            return;
+        }
+        GemmUtill::gemm(trans_a, trans_b, m, n, k, alpha, a, a_type, lda, b, b_type, ldb, beta, c, ldc);
+    }
+
+    namespace {
+        template <MathUtill::Mode M, Activation A>
+        inline float activation(float z) {
+            switch (A) {
+                case Activation::None: return z;
+                case Activation::Relu: return std::max(0.0f, z);
+                case Activation::Sigmoid: return MathUtill::sigmoid<M>(z);
+                case Activation::Tanh: return MathUtill::tanh<M>(z);
+            }
+            return z;
+        }
+
+        /*
+            @return derivative of the activation expressed in terms of its output w
+        */
+        template <Activation A>
+        inline float activation_derivative(float w) {
+            switch (A) {
+                case Activation::None: return 1.0f;
+                case Activation::Relu: return w > 0.0f ? 1.0f : 0.0f;
+                case Activation::Sigmoid: return w * (1.0f - w);
+                case Activation::Tanh: return 1.0f - w * w;
+            }
+            return 1.0f;
+        }
+
+        template <MathUtill::Mode M, Activation A>
+        void bias_activation_kernel(const float* bias, int bias_axis, float* c, int ldc, int i0, int i1, int j0, int j1) {
+            for (int i = i0; i < i1; i++) {
+                float* ci = c + (long long)i * ldc;
+                if (bias_axis == 0) {
+                    float b = bias[i];
+                    #pragma omp simd
+                    for (int j = j0; j < j1; j++) {
+                        ci[j] = activation<M, A>(ci[j] + b);
+                    }
+                } else {
+                    #pragma omp simd
+                    for (int j = j0; j < j1; j++) {
+                        ci[j] = activation<M, A>(ci[j] + bias[j]);
+                    }
+                }
+            }
+        }
+
+        template <MathUtill::Mode M>
+        void bias_activation_mode(
+            Activation act, const float* bias, int bias_axis, float* c, int ldc, int i0, int i1, int j0, int j1
+        ) {
+            switch (act) {
+                case Activation::None:
+                    bias_activation_kernel<M, Activation::None>(bias, bias_axis, c, ldc, i0, i1, j0, j1);
+                    break;
+                case Activation::Relu:
+                    bias_activation_kernel<M, Activation::Relu>(bias, bias_axis, c, ldc, i0, i1, j0, j1);
+                    break;
+                case Activation::Sigmoid:
+                    bias_activation_kernel<M, Activation::Sigmoid>(bias, bias_axis, c, ldc, i0, i1, j0, j1);
+                    break;
+                case Activation::Tanh:
+                    bias_activation_kernel<M, Activation::Tanh>(bias, bias_axis, c, ldc, i0, i1, j0, j1);
+                    break;
+            }
+        }
+
+        template <Activation A>
+        void linear_backward_kernel(
+            int m, int n, const float* c, const float* c_grad, float* z_grad, int bias_axis, float* bias_grad
+        ) {
+            if (bias_axis == 0) {
+                // one row per task, each task owns its bias gradient
+                BroadcastUtill::parallel_for(m, (long long)m * n >= BroadcastUtill::PARALLEL_THRESHOLD, [&](int i) {
+                    const float* ci = c + (long long)i * n;
+                    const float* gi = c_grad + (long long)i * n;
+                    float* zi = z_grad + (long long)i * n;
+                    float sum = 0.0f;
+                    #pragma omp simd reduction(+:sum)
+                    for (int j = 0; j < n; j++) {
+                        zi[j] = gi[j] * activation_derivative<A>(ci[j]);
+                        sum += zi[j];
+                    }
+                    if (bias_grad) {
+                        bias_grad[i] += sum;
+                    }
+                });
+                return;
+            }
+            // bias along columns: every task walks all rows for a block of columns
+            int threads = (long long)m * n >= BroadcastUtill::PARALLEL_THRESHOLD ? omp_get_max_threads() : 1;
+            int blocks = std::max(1, std::min(threads, n / BroadcastUtill::GRAIN));
+            BroadcastUtill::parallel_for(blocks, blocks > 1, [&](int b) {
+                int begin = (long long)n * b / blocks, end = (long long)n * (b + 1) / blocks;
+                for (int i = 0; i < m; i++) {
+                    const float* ci = c + (long long)i * n;
+                    const float* gi = c_grad + (long long)i * n;
+                    float* zi = z_grad + (long long)i * n;
+                    #pragma omp simd
+                    for (int j = begin; j < end; j++) {
+                        zi[j] = gi[j] * activation_derivative<A>(ci[j]);
+                    }
+                    if (bias_grad) {
+                        #pragma omp simd
+                        for (int j = begin; j < end; j++) {
+                            bias_grad[j] += zi[j];
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    void NativeBackend::bias_activation(
+        Activation act, const float* bias, int bias_axis, float* c, int ldc, int i0, int i1, int j0, int j1
+    ) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            bias_activation_mode<MathUtill::Mode::Fast>(act, bias, bias_axis, c, ldc, i0, i1, j0, j1);
+        } else {
+            bias_activation_mode<MathUtill::Mode::Precise>(act, bias, bias_axis, c, ldc, i0, i1, j0, j1);
+        }
+    }
+
+    void NativeBackend::linear(
+        Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+        const float* a, int lda, const float* b, int ldb,
+        const float* bias, int bias_axis, float* c, int ldc
+    ) {
+        GemmUtill::sgemm(
+            trans_a, trans_b, m, n, k, 1.0f, a, lda, b, ldb, 0.0f, c, ldc,
+            [&](float* c, int ldc, int i0, int i1, int j0, int j1) {
+                bias_activation(act, bias, bias_axis, c, ldc, i0, i1, j0, j1);
+            }
+        );
+    }
+
+    void NativeBackend::linear(
+        Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+        const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+        const float* bias, int bias_axis, float* c, int ldc
+    ) {
+        if (a_type == DType::Float32 && b_type == DType::Float32) {
+            linear(
+                act, trans_a, trans_b, m, n, k, static_cast<const float*>(a), lda, 
+                static_cast<const float*>(b), ldb, bias, bias_axis, c, ldc
+            );
+            return;
+        }
+        GemmUtill::gemm(
+            trans_a, trans_b, m, n, k, 1.0f, a, a_type, lda, b, b_type, ldb, 0.0f, c, ldc,
+            [&](float* c, int ldc, int i0, int i1, int j0, int j1) {
+                bias_activation(act, bias, bias_axis, c, ldc, i0, i1, j0, j1);
+            }
+        );
+    }
+
+    void NativeBackend::linear_backward(
+        Activation act, int m, int n, const float* c, const float* c_grad, 
+        float* z_grad, int bias_axis, float* bias_grad
+    ) {
+        switch (act) {
+            case Activation::None:
+                linear_backward_kernel<Activation::None>(m, n, c, c_grad, z_grad, bias_axis, bias_grad);
+                break;
+            case Activation::Relu:
+                linear_backward_kernel<Activation::Relu>(m, n, c, c_grad, z_grad, bias_axis, bias_grad);
+                break;
+            case Activation::Sigmoid:
+                linear_backward_kernel<Activation::Sigmoid>(m, n, c, c_grad, z_grad, bias_axis, bias_grad);
+                break;
+            case Activation::Tanh:
+                linear_backward_kernel<Activation::Tanh>(m, n, c, c_grad, z_grad, bias_axis, bias_grad);
+                break;
+        }
+    }
+
+    void NativeBackend::binary(BinaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u, const float* v) {
+        switch (op) {
+            case BinaryOp::Add:
+                BroadcastUtill::binary(plan, w, u, v, [](float a, float b) { return a + b; });
+                break;
+            case BinaryOp::Subtract:
+                BroadcastUtill::binary(plan, w, u, v, [](float a, float b) { return a - b; });
+                break;
+            case BinaryOp::Multiply:
+                BroadcastUtill::binary(plan, w, u, v, [](float a, float b) { return a * b; });
+                break;
+            case BinaryOp::Divide:
+                BroadcastUtill::binary(plan, w, u, v, [](float a, float b) { return a / b; });
+                break;
+        }
+    }
+
+    void NativeBackend::binary_backward(
+        BinaryOp op, int x, const BroadcastUtill::Plan& plan, 
+        float* x_grad, const float* w_grad, const float* u, const float* v
+    ) {
+        switch (op) {
+            case BinaryOp::Add:
+                BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float, float) { return dw; });
+                break;
+            case BinaryOp::Subtract:
+                if (x == 0) {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float, float) { return dw; });
+                } else {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float, float) { return -dw; });
+                }
+                break;
+            case BinaryOp::Multiply:
+                if (x == 0) {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float, float b) { return dw * b; });
+                } else {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float a, float) { return dw * a; });
+                }
+                break;
+            case BinaryOp::Divide:
+                if (x == 0) {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float, float b) { 
+                        return dw * (1.0f / b); 
+                    });
+                } else {
+                    BroadcastUtill::reduce_binary(plan, x_grad, w_grad, u, v, [](float dw, float a, float b) { 
+                        return dw * (-a / (b * b)); 
+                    });
+                }
+                break;
+        }
+    }
+
+    namespace {
+        template <MathUtill::Mode M>
+        void unary_kernel(UnaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u) {
+            std::array<float*, 2> ptrs = {w, const_cast<float*>(u)};
+            switch (op) {
+                case UnaryOp::Exp:
+                    BroadcastUtill::elementwise<2>(plan, ptrs, [](float& w, float& u) { 
+                        w = MathUtill::exp<M>(u); 
+                    });
+                    break;
+                case UnaryOp::Log:
+                    BroadcastUtill::elementwise<2>(plan, ptrs, [](float& w, float& u) { 
+                        w = MathUtill::log<M>(u); 
+                    });
+                    break;
+                case UnaryOp::Relu:
+                    BroadcastUtill::elementwise<2>(plan, ptrs, [](float& w, float& u) { 
+                        w = std::max(0.0f, u); 
+                    });
+                    break;
+                case UnaryOp::Sigmoid:
+                    BroadcastUtill::elementwise<2>(plan, ptrs, [](float& w, float& u) { 
+                        w = MathUtill::sigmoid<M>(u); 
+                    });
+                    break;
+                case UnaryOp::Tanh:
+                    BroadcastUtill::elementwise<2>(plan, ptrs, [](float& w, float& u) { 
+                        w = MathUtill::tanh<M>(u); 
+                    });
+                    break;
+            }
+        }
+    }
+
+    void NativeBackend::unary(UnaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            unary_kernel<MathUtill::Mode::Fast>(op, plan, w, u);
+        } else {
+            unary_kernel<MathUtill::Mode::Precise>(op, plan, w, u);
+        }
+    }
+
+    void NativeBackend::unary_backward(
+        UnaryOp op, const BroadcastUtill::Plan& plan, 
+        float* u_grad, const float* w_grad, const float* u, const float* w
+    ) {
+        std::array<float*, 4> ptrs = {u_grad, const_cast<float*>(w_grad), const_cast<float*>(u), const_cast<float*>(w)};
+        // the derivatives are expressed in terms of the forward output w where possible
+        switch (op) {
+            case UnaryOp::Exp:
+                BroadcastUtill::elementwise<4>(plan, ptrs, [](float& du, float& dw, float&, float& w) { 
+                    du += dw * w; 
+                });
+                break;
+            case UnaryOp::Log:
+                BroadcastUtill::elementwise<4>(plan, ptrs, [](float& du, float& dw, float& u, float&) { 
+                    du += dw / u; 
+                });
+                break;
+            case UnaryOp::Relu:
+                BroadcastUtill::elementwise<4>(plan, ptrs, [](float& du, float& dw, float&, float& w) { 
+                    du += w > 0.0f ? dw : 0.0f; 
+                });
+                break;
+            case UnaryOp::Sigmoid:
+                BroadcastUtill::elementwise<4>(plan, ptrs, [](float& du, float& dw, float&, float& w) { 
+                    du += dw * (w * (1 - w)); 
+                });
+                break;
+            case UnaryOp::Tanh:
+                BroadcastUtill::elementwise<4>(plan, ptrs, [](float& du, float& dw, float&, float& w) { 
+                    du += dw * (1 - w * w); 
+                });
+                break;
+        }
+    }
+
+    namespace {
+        // lines longer than this are split into blocks when there are too few lines to keep 
+        // every thread busy, the block size does not depend on the thread count so results
+        // are the same for any number of threads
+        const int REDUCE_BLOCK = 1 << 14;
+
+        /*
+            Calls fn(o, begin, end) for every outer index and block [begin, end) of the inner 
+            extent, in parallel when the reduction is large enough
+        */
+        template <typename Fn>
+        void for_each_outer(int outer, int reduce, int inner, Fn fn) {
+            long long work = (long long)outer * reduce * inner;
+            int threads = work >= BroadcastUtill::PARALLEL_THRESHOLD ? omp_get_max_threads() : 1;
+            int blocks = 1;
+            if (outer < threads && inner >= 2 * BroadcastUtill::GRAIN) {
+                blocks = std::min(threads, inner / BroadcastUtill::GRAIN);
+            }
+            int block = (inner + blocks - 1) / blocks;
+            BroadcastUtill::parallel_for(outer * blocks, threads > 1, [&](int t) {
+                int o = t / blocks, b = t % blocks;
+                fn(o, b * block, std::min(inner, (b + 1) * block));
+            });
+        }
+
+        /*
+            @return true if single lines (inner == 1) should be split into REDUCE_BLOCK blocks
+        */
+        bool split_lines(int outer, int reduce, int inner) {
+            long long work = (long long)outer * reduce;
+            return inner == 1 && reduce >= 2 * REDUCE_BLOCK && outer < omp_get_max_threads()
+                && work >= BroadcastUtill::PARALLEL_THRESHOLD;
+        }
+
+        float line_sum(const float* u, int n) {
+            float sum = 0.0f;
+            #pragma omp simd reduction(+:sum)
+            for (int r = 0; r < n; r++) {
+                sum += u[r];
+            }
+            return sum;
+        }
+
+        struct LineMax {
+            float value;
+            int index;
+            int ties;
+        };
+
+        LineMax line_max(const float* u, int begin, int end) {
+            float value = std::numeric_limits<float>::lowest();
+            #pragma omp simd reduction(max:value)
+            for (int r = begin; r < end; r++) {
+                value = std::max(value, u[r]);
+            }
+            int index = end, ties = 0;
+            #pragma omp simd reduction(min:index) reduction(+:ties)
+            for (int r = begin; r < end; r++) {
+                bool equal = u[r] == value;
+                index = equal ? std::min(index, r) : index;
+                ties += equal;
+            }
+            return {value, index, ties};
+        }
+    }
+
+    void NativeBackend::sum(const float* u, int outer, int reduce, int inner, float* w) {
+        if (split_lines(outer, reduce, inner)) {
+            int blocks = (reduce + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+            std::vector<float> partial(outer * blocks);
+            #pragma omp parallel for schedule(static)
+            for (int t = 0; t < outer * blocks; t++) {
+                int o = t / blocks, b = t % blocks;
+                int begin = b * REDUCE_BLOCK, end = std::min(reduce, begin + REDUCE_BLOCK);
+                partial[t] = line_sum(u + (long long)o * reduce + begin, end - begin);
+            }
+            for (int o = 0; o < outer; o++) {
+                w[o] = line_sum(partial.data() + o * blocks, blocks);
+            }
+            return;
+        }
+        for_each_outer(outer, reduce, inner, [&](int o, int begin, int end) {
+            const float* uo = u + (long long)o * reduce * inner;
+            if (inner == 1) {
+                w[o] = line_sum(uo, reduce);
+                return;
+            }
+            float* wo = w + (long long)o * inner;
+            for (int i = begin; i < end; i++) {
+                wo[i] = 0.0f;
+            }
+            for (int r = 0; r < reduce; r++) {
+                const float* ur = uo + (long long)r * inner;
+                #pragma omp simd
+                for (int i = begin; i < end; i++) {
+                    wo[i] += ur[i];
+                }
+            }
+        });
+    }
+
+    void NativeBackend::sum_backward(const float* w_grad, int outer, int reduce, int inner, float* u_grad) {
+        for_each_outer(outer, reduce, inner, [&](int o, int begin, int end) {
+            const float* wo = w_grad + (long long)o * inner;
+            for (int r = 0; r < reduce; r++) {
+                float* ur = u_grad + ((long long)o * reduce + r) * inner;
+                #pragma omp simd
+                for (int i = begin; i < end; i++) {
+                    ur[i] += wo[i];
+                }
+            }
+        });
+    }
+
+    void NativeBackend::max(const float* u, int outer, int reduce, int inner, float* w, int* argmax, int* ties) {
+        if (split_lines(outer, reduce, inner)) {
+            int blocks = (reduce + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+            std::vector<LineMax> partial(outer * blocks);
+            #pragma omp parallel for schedule(static)
+            for (int t = 0; t < outer * blocks; t++) {
+                int o = t / blocks, b = t % blocks;
+                int begin = b * REDUCE_BLOCK, end = std::min(reduce, begin + REDUCE_BLOCK);
+                partial[t] = line_max(u + (long long)o * reduce, begin, end);
+            }
+            for (int o = 0; o < outer; o++) {
+                LineMax m = partial[o * blocks];
+                for (int b = 1; b < blocks; b++) {
+                    const LineMax& p = partial[o * blocks + b];
+                    if (p.value > m.value) {
+                        m = p;
+                    } else if (p.value == m.value) {
+                        m.ties += p.ties;
+                    }
+                }
+                w[o] = m.value, argmax[o] = m.index, ties[o] = m.ties;
+            }
+            return;
+        }
+        for_each_outer(outer, reduce, inner, [&](int o, int begin, int end) {
+            const float* uo = u + (long long)o * reduce * inner;
+            if (inner == 1) {
+                LineMax m = line_max(uo, 0, reduce);
+                w[o] = m.value, argmax[o] = m.index, ties[o] = m.ties;
+                return;
+            }
+            float* wo = w + (long long)o * inner;
+            int* ao = argmax + (long long)o * inner;
+            int* to = ties + (long long)o * inner;
+            for (int i = begin; i < end; i++) {
+                wo[i] = uo[i], ao[i] = 0, to[i] = 1;
+            }
+            for (int r = 1; r < reduce; r++) {
+                const float* ur = uo + (long long)r * inner;
+                #pragma omp simd
+                for (int i = begin; i < end; i++) {
+                    bool greater = ur[i] > wo[i];
+                    bool equal = ur[i] == wo[i];
+                    ao[i] = greater ? r : ao[i];
+                    to[i] = greater ? 1 : to[i] + equal;
+                    wo[i] = greater ? ur[i] : wo[i];
+                }
+            }
+        });
+    }
+
+    namespace {
+        // columns of a softmax over a strided axis are processed in chunks of this many
+        const int SOFTMAX_COLUMNS = 256;
+
+        template <MathUtill::Mode M>
+        void softmax_kernel(const float* u, int outer, int reduce, int inner, float* w, bool log) {
+            for_each_outer(outer, reduce, inner, [&](int o, int begin, int end) {
+                const float* uo = u + (long long)o * reduce * inner;
+                float* wo = w + (long long)o * reduce * inner;
+                if (inner == 1) {
+                    float max_value = std::numeric_limits<float>::lowest();
+                    #pragma omp simd reduction(max:max_value)
+                    for (int r = 0; r < reduce; r++) {
+                        max_value = std::max(max_value, uo[r]);
+                    }
+                    float sum = 0.0f;
+                    #pragma omp simd reduction(+:sum)
+                    for (int r = 0; r < reduce; r++) {
+                        float e = MathUtill::exp<M>(uo[r] - max_value);
+                        wo[r] = e;
+                        sum += e;
+                    }
+                    if (log) {
+                        float shift = max_value + MathUtill::log<M>(sum);
+                        #pragma omp simd
+                        for (int r = 0; r < reduce; r++) {
+                            wo[r] = uo[r] - shift;
+                        }
+                    } else {
+                        float scale = 1.0f / sum;
+                        #pragma omp simd
+                        for (int r = 0; r < reduce; r++) {
+                            wo[r] *= scale;
+                        }
+                    }
+                    return;
+                }
+                // strided axis: a chunk of columns is reduced together, vectorized along i
+                float max_value[SOFTMAX_COLUMNS], sum[SOFTMAX_COLUMNS];
+                for (int chunk = begin; chunk < end; chunk += SOFTMAX_COLUMNS) {
+                    int n = std::min(SOFTMAX_COLUMNS, end - chunk);
+                    const float* uc = uo + chunk;
+                    float* wc = wo + chunk;
+                    for (int i = 0; i < n; i++) {
+                        max_value[i] = uc[i];
+                        sum[i] = 0.0f;
+                    }
+                    for (int r = 1; r < reduce; r++) {
+                        const float* ur = uc + (long long)r * inner;
+                        #pragma omp simd
+                        for (int i = 0; i < n; i++) {
+                            max_value[i] = std::max(max_value[i], ur[i]);
+                        }
+                    }
+                    for (int r = 0; r < reduce; r++) {
+                        const float* ur = uc + (long long)r * inner;
+                        float* wr = wc + (long long)r * inner;
+                        #pragma omp simd
+                        for (int i = 0; i < n; i++) {
+                            wr[i] = MathUtill::exp<M>(ur[i] - max_value[i]);
+                            sum[i] += wr[i];
+                        }
+                    }
+                    for (int i = 0; i < n; i++) {
+                        sum[i] = log ? max_value[i] + MathUtill::log<M>(sum[i]) : 1.0f / sum[i];
+                    }
+                    for (int r = 0; r < reduce; r++) {
+                        const float* ur = uc + (long long)r * inner;
+                        float* wr = wc + (long long)r * inner;
+                        if (log) {
+                            #pragma omp simd
+                            for (int i = 0; i < n; i++) {
+                                wr[i] = ur[i] - sum[i];
+                            }
+                        } else {
+                            #pragma omp simd
+                            for (int i = 0; i < n; i++) {
+                                wr[i] *= sum[i];
+                            }
+                        }
+                    }
+                }
+            });
+        }
+
+        template <MathUtill::Mode M>
+        void softmax_backward_kernel(
+            const float* w, const float* w_grad, int outer, int reduce, int inner, float* u_grad, bool log
+        ) {
+            for_each_outer(outer, reduce, inner, [&](int o, int begin, int end) {
+                long long base = (long long)o * reduce * inner;
+                const float* wo = w + base;
+                const float* go = w_grad + base;
+                float* uo = u_grad + base;
+                if (inner == 1) {
+                    float sum = 0.0f;
+                    #pragma omp simd reduction(+:sum)
+                    for (int r = 0; r < reduce; r++) {
+                        sum += log ? go[r] : go[r] * wo[r];
+                    }
+                    #pragma omp simd
+                    for (int r = 0; r < reduce; r++) {
+                        uo[r] += log ? go[r] - MathUtill::exp<M>(wo[r]) * sum : wo[r] * (go[r] - sum);
+                    }
+                    return;
+                }
+                float sum[SOFTMAX_COLUMNS];
+                for (int chunk = begin; chunk < end; chunk += SOFTMAX_COLUMNS) {
+                    int n = std::min(SOFTMAX_COLUMNS, end - chunk);
+                    for (int i = 0; i < n; i++) {
+                        sum[i] = 0.0f;
+                    }
+                    for (int r = 0; r < reduce; r++) {
+                        const float* wr = wo + chunk + (long long)r * inner;
+                        const float* gr = go + chunk + (long long)r * inner;
+                        #pragma omp simd
+                        for (int i = 0; i < n; i++) {
+                            sum[i] += log ? gr[i] : gr[i] * wr[i];
+                        }
+                    }
+                    for (int r = 0; r < reduce; r++) {
+                        const float* wr = wo + chunk + (long long)r * inner;
+                        const float* gr = go + chunk + (long long)r * inner;
+                        float* ur = uo + chunk + (long long)r * inner;
+                        #pragma omp simd
+                        for (int i = 0; i < n; i++) {
+                            ur[i] += log ? gr[i] - MathUtill::exp<M>(wr[i]) * sum[i] : wr[i] * (gr[i] - sum[i]);
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    namespace {
+        /*
+            Max and sum of exponentials of the rows [row_begin, row_end) of the columns 
+            [0, columns) of u[o], whose rows are inner apart, relative to the maximum
+        */
+        template <MathUtill::Mode M>
+        void partial_logsumexp(
+            const float* uo, int row_begin, int row_end, int inner, int columns, float* max_value, float* sum
+        ) {
+            if (inner == 1) {
+                float m = std::numeric_limits<float>::lowest();
+                #pragma omp simd reduction(max:m)
+                for (int r = row_begin; r < row_end; r++) {
+                    m = std::max(m, uo[r]);
+                }
+                float total = 0.0f;
+                #pragma omp simd reduction(+:total)
+                for (int r = row_begin; r < row_end; r++) {
+                    total += MathUtill::exp<M>(uo[r] - m);
+                }
+                max_value[0] = m, sum[0] = total;
+                return;
+            }
+            for (int chunk = 0; chunk < columns; chunk += SOFTMAX_COLUMNS) {
+                int n = std::min(SOFTMAX_COLUMNS, columns - chunk);
+                const float* uc = uo + chunk;
+                float* mc = max_value + chunk;
+                float* sc = sum + chunk;
+                for (int i = 0; i < n; i++) {
+                    mc[i] = std::numeric_limits<float>::lowest();
+                    sc[i] = 0.0f;
+                }
+                for (int r = row_begin; r < row_end; r++) {
+                    const float* ur = uc + (long long)r * inner;
+                    #pragma omp simd
+                    for (int i = 0; i < n; i++) {
+                        mc[i] = std::max(mc[i], ur[i]);
+                    }
+                }
+                for (int r = row_begin; r < row_end; r++) {
+                    const float* ur = uc + (long long)r * inner;
+                    #pragma omp simd
+                    for (int i = 0; i < n; i++) {
+                        sc[i] += MathUtill::exp<M>(ur[i] - mc[i]);
+                    }
+                }
+            }
+        }
+
+        /*
+            Work split of softmax cross entropy: tasks cover blocks of rows times chunks of
+            SOFTMAX_COLUMNS columns of every u[o]. Narrow lines are split into blocks of
+            rows to keep every thread busy, wide lines only into column chunks. The partial
+            results of the forward take one float per line of wide logits and at most
+            SOFTMAX_COLUMNS / REDUCE_BLOCK of the size of narrow ones.
+        */
+        struct CrossEntropySplit {
+            int rows, blocks, chunks;
+            CrossEntropySplit(int reduce, int inner) {
+                rows = inner < SOFTMAX_COLUMNS ? std::max(1, REDUCE_BLOCK / inner) : reduce;
+                blocks = (reduce + rows - 1) / rows;
+                chunks = (inner + SOFTMAX_COLUMNS - 1) / SOFTMAX_COLUMNS;
+            }
+        };
+
+        template <MathUtill::Mode M>
+        void softmax_cross_entropy_kernel(
+            const float* u, const int* labels, int outer, int reduce, int inner, float* loss, float* lse
+        ) {
+            // partial results are merged in block order
+            CrossEntropySplit split(reduce, inner);
+            int blocks = split.blocks, chunks = split.chunks;
+            long long work = (long long)outer * reduce * inner;
+            bool parallel = work >= BroadcastUtill::PARALLEL_THRESHOLD;
+            // grow only, so repeated steps do not allocate; the references hand the buffers
+            // of this thread to the workers
+            thread_local std::vector<float> max_buffer, sum_buffer;
+            std::vector<float>& max_value = max_buffer;
+            std::vector<float>& sum = sum_buffer;
+            max_value.resize((long long)outer * blocks * inner), sum.resize(max_value.size());
+            BroadcastUtill::parallel_for(outer * blocks * chunks, parallel, [&](int t) {
+                int o = t / (blocks * chunks), b = t / chunks % blocks, c = t % chunks;
+                int column = c * SOFTMAX_COLUMNS;
+                long long partial = ((long long)o * blocks + b) * inner + column;
+                partial_logsumexp<M>(
+                    u + (long long)o * reduce * inner + column, b * split.rows, std::min(reduce, (b + 1) * split.rows), 
+                    inner, std::min(SOFTMAX_COLUMNS, inner - column), max_value.data() + partial, sum.data() + partial
+                );
+            });
+            BroadcastUtill::parallel_for(outer * inner, parallel, [&](int t) {
+                int o = t / inner, i = t % inner;
+                const float* mt = max_value.data() + (long long)o * blocks * inner + i;
+                const float* st = sum.data() + (long long)o * blocks * inner + i;
+                float m = mt[0];
+                for (int b = 1; b < blocks; b++) {
+                    m = std::max(m, mt[(long long)b * inner]);
+                }
+                float total = 0.0f;
+                for (int b = 0; b < blocks; b++) {
+                    total += st[(long long)b * inner] * MathUtill::exp<M>(mt[(long long)b * inner] - m);
+                }
+                lse[t] = m + MathUtill::log<M>(total);
+                loss[t] = lse[t] - u[((long long)o * reduce + labels[t]) * inner + i];
+            });
+        }
+
+        template <MathUtill::Mode M>
+        void softmax_cross_entropy_backward_kernel(
+            const float* u, const int* labels, const float* lse, int outer, int reduce, int inner, 
+            float scale, float* u_grad
+        ) {
+            CrossEntropySplit split(reduce, inner);
+            int blocks = split.blocks, chunks = split.chunks;
+            long long work = (long long)outer * reduce * inner;
+            BroadcastUtill::parallel_for(outer * blocks * chunks, work >= BroadcastUtill::PARALLEL_THRESHOLD, [&](int t) {
+                int o = t / (blocks * chunks), b = t / chunks % blocks, c = t % chunks;
+                const int* lo = labels + (long long)o * inner;
+                const float* lse_o = lse + (long long)o * inner;
+                int row_begin = b * split.rows, row_end = std::min(reduce, (b + 1) * split.rows);
+                if (inner == 1) {
+                    const float* uo = u + (long long)o * reduce;
+                    float* go = u_grad + (long long)o * reduce;
+                    float shift = lse_o[0];
+                    #pragma omp simd
+                    for (int r = row_begin; r < row_end; r++) {
+                        go[r] += scale * MathUtill::exp<M>(uo[r] - shift);
+                    }
+                    if (row_begin <= lo[0] && lo[0] < row_end) {
+                        go[lo[0]] -= scale;
+                    }
+                    return;
+                }
+                int column_begin = c * SOFTMAX_COLUMNS, column_end = std::min(inner, column_begin + SOFTMAX_COLUMNS);
+                for (int r = row_begin; r < row_end; r++) {
+                    long long base = ((long long)o * reduce + r) * inner;
+                    const float* ur = u + base;
+                    float* gr = u_grad + base;
+                    #pragma omp simd
+                    for (int i = column_begin; i < column_end; i++) {
+                        gr[i] += scale * (MathUtill::exp<M>(ur[i] - lse_o[i]) - (r == lo[i] ? 1.0f : 0.0f));
+                    }
+                }
+            });
+        }
+    }
+
+    void NativeBackend::softmax(const float* u, int outer, int reduce, int inner, float* w, bool log) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            softmax_kernel<MathUtill::Mode::Fast>(u, outer, reduce, inner, w, log);
+        } else {
+            softmax_kernel<MathUtill::Mode::Precise>(u, outer, reduce, inner, w, log);
+        }
+    }
+
+    void NativeBackend::softmax_backward(
+        const float* w, const float* w_grad, int outer, int reduce, int inner, float* u_grad, bool log
+    ) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            softmax_backward_kernel<MathUtill::Mode::Fast>(w, w_grad, outer, reduce, inner, u_grad, log);
+        } else {
+            softmax_backward_kernel<MathUtill::Mode::Precise>(w, w_grad, outer, reduce, inner, u_grad, log);
+        }
+    }
+
+    void NativeBackend::softmax_cross_entropy(
+        const float* u, const int* labels, int outer, int reduce, int inner, float* loss, float* lse
+    ) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            softmax_cross_entropy_kernel<MathUtill::Mode::Fast>(u, labels, outer, reduce, inner, loss, lse);
+        } else {
+            softmax_cross_entropy_kernel<MathUtill::Mode::Precise>(u, labels, outer, reduce, inner, loss, lse);
+        }
+    }
+
+    void NativeBackend::softmax_cross_entropy_backward(
+        const float* u, const int* labels, const float* lse, int outer, int reduce, int inner, 
+        float scale, float* u_grad
+    ) {
+        if (MathUtill::mode() == MathUtill::Mode::Fast) {
+            softmax_cross_entropy_backward_kernel<MathUtill::Mode::Fast>(
+                u, labels, lse, outer, reduce, inner, scale, u_grad
+            );
+        } else {
+            softmax_cross_entropy_backward_kernel<MathUtill::Mode::Precise>(
+                u, labels, lse, outer, reduce, inner, scale, u_grad
+            );
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef REVGRAD_NATIVE_BACKEND_H
+#define REVGRAD_NATIVE_BACKEND_H
+
+#include "Backend.h"
+
+namespace RevGrad {
+    /*
+        In-house kernels: BroadcastUtill for elementwise ops and GemmUtill for matmul
+    */
+    class NativeBackend : public Backend {
+    public:
+        const char* name() const override;
+        void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc
+        ) override;
+        /*
+            Half operands are converted while GemmUtill packs them, float ones go through
+            the float overload
+        */
+        void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            float beta, float* c, int ldc
+        ) override;
+        void linear(
+            Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+            const float* a, int lda, const float* b, int ldb,
+            const float* bias, int bias_axis, float* c, int ldc
+        ) override;
+        void linear(
+            Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+            const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            const float* bias, int bias_axis, float* c, int ldc
+        ) override;
+        void linear_backward(
+            Activation act, int m, int n, const float* c, const float* c_grad, 
+            float* z_grad, int bias_axis, float* bias_grad
+        ) override;
+        void binary(BinaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u, const float* v) override;
+        void binary_backward(
+            BinaryOp op, int x, const BroadcastUtill::Plan& plan, 
+            float* x_grad, const float* w_grad, const float* u, const float* v
+        ) override;
+        void unary(UnaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u) override;
+        void unary_backward(
+            UnaryOp op, const BroadcastUtill::Plan& plan, 
+            float* u_grad, const float* w_grad, const float* u, const float* w
+        ) override;
+        void sum(const float* u, int outer, int reduce, int inner, float* w) override;
+        void sum_backward(const float* w_grad, int outer, int reduce, int inner, float* u_grad) override;
+        void max(const float* u, int outer, int reduce, int inner, float* w, int* argmax, int* ties) override;
+        void softmax(const float* u, int outer, int reduce, int inner, float* w, bool log) override;
+        void softmax_backward(
+            const float* w, const float* w_grad, int outer, int reduce, int inner, float* u_grad, bool log
+        ) override;
+        void softmax_cross_entropy(
+            const float* u, const int* labels, int outer, int reduce, int inner, float* loss, float* lse
+        ) override;
+        void softmax_cross_entropy_backward(
+            const float* u, const int* labels, const float* lse, int outer, int reduce, int inner, 
+            float scale, float* u_grad
+        ) override;
+    protected:
+        /*
+            C[i, j] = act(C[i, j] + bias) over rows [i0, i1) and columns [j0, j1), the 
+            epilogue of linear
+        */
+        static void bias_activation(
+            Activation act, const float* bias, int bias_axis, float* c, int ldc, int i0, int i1, int j0, int j1
+        );
+    };
+}
+
+#endif
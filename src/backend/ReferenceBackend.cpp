@@ -0,0 +1,277 @@
+#include "ReferenceBackend.h"
+
+#include <cmath>
+#include <limits>
+
+namespace RevGrad {
+    namespace {
+        /*
+            @return offset of operand n at the linear position index of the plan
+        */
+        long long offset(const BroadcastUtill::Plan& plan, int n, int index) {
+            long long offset = 0;
+            for (int k = (int)plan.shape.size() - 1; k >= 0; k--) {
+                offset += (long long)(index % plan.shape[k]) * plan.strides[n][k];
+                index /= plan.shape[k];
+            }
+            return offset;
+        }
+
+        float binary_value(BinaryOp op, float a, float b) {
+            switch (op) {
+                case BinaryOp::Add: return a + b;
+                case BinaryOp::Subtract: return a - b;
+                case BinaryOp::Multiply: return a * b;
+                case BinaryOp::Divide: return a / b;
+            }
+            return 0.0f;
+        }
+
+        float binary_gradient(BinaryOp op, int x, float dw, float a, float b) {
+            switch (op) {
+                case BinaryOp::Add: return dw;
+                case BinaryOp::Subtract: return x == 0 ? dw : -dw;
+                case BinaryOp::Multiply: return x == 0 ? dw * b : dw * a;
+                case BinaryOp::Divide: return x == 0 ? dw / b : -dw * a / (b * b);
+            }
+            return 0.0f;
+        }
+    }
+
+    const char* ReferenceBackend::name() const { return "reference"; }
+
+    void ReferenceBackend::gemm(
+        bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const float* a, int lda, const float* b, int ldb,
+        float beta, float* c, int ldc
+    ) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                float sum = 0.0f;
+                for (int p = 0; p < k; p++) {
+                    float a_value = trans_a ? a[(long long)p * lda + i] : a[(long long)i * lda + p];
+                    float b_value = trans_b ? b[(long long)j * ldb + p] : b[(long long)p * ldb + j];
+                    sum += a_value * b_value;
+                }
+                float& c_value = c[(long long)i * ldc + j];
+                c_value = alpha * sum + (beta == 0.0f ? 0.0f : beta * c_value);
+            }
+        }
+    }
+
+    void ReferenceBackend::linear(
+        Activation act, bool trans_a, bool trans_b, int m, int n, int k,
+        const float* a, int lda, const float* b, int ldb,
+        const float* bias, int bias_axis, float* c, int ldc
+    ) {
+        gemm(trans_a, trans_b, m, n, k, 1.0f, a, lda, b, ldb, 0.0f, c, ldc);
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                float& value = c[(long long)i * ldc + j];
+                value += bias_axis == 0 ? bias[i] : bias[j];
+                switch (act) {
+                    case Activation::None: break;
+                    case Activation::Relu: value = value > 0.0f ? value : 0.0f; break;
+                    case Activation::Sigmoid: value = 1.0f / (1.0f + std::exp(-value)); break;
+                    case Activation::Tanh: value = std::tanh(value); break;
+                }
+            }
+        }
+    }
+
+    void ReferenceBackend::linear_backward(
+        Activation act, int m, int n, const float* c, const float* c_grad, 
+        float* z_grad, int bias_axis, float* bias_grad
+    ) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                long long index = (long long)i * n + j;
+                float w = c[index];
+                float derivative = 1.0f;
+                switch (act) {
+                    case Activation::None: break;
+                    case Activation::Relu: derivative = w > 0.0f ? 1.0f : 0.0f; break;
+                    case Activation::Sigmoid: derivative = w * (1.0f - w); break;
+                    case Activation::Tanh: derivative = 1.0f - w * w; break;
+                }
+                z_grad[index] = c_grad[index] * derivative;
+                if (bias_grad) {
+                    bias_grad[bias_axis == 0 ? i : j] += z_grad[index];
+                }
+            }
+        }
+    }
+
+    void ReferenceBackend::binary(BinaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u, const float* v) {
+        for (int i = 0; i < plan.size; i++) {
+            w[offset(plan, 0, i)] = binary_value(op, u[offset(plan, 1, i)], v[offset(plan, 2, i)]);
+        }
+    }
+
+    void ReferenceBackend::binary_backward(
+        BinaryOp op, int x, const BroadcastUtill::Plan& plan, 
+        float* x_grad, const float* w_grad, const float* u, const float* v
+    ) {
+        for (int i = 0; i < plan.size; i++) {
+            x_grad[offset(plan, 3, i)] += binary_gradient(
+                op, x, w_grad[offset(plan, 0, i)], u[offset(plan, 1, i)], v[offset(plan, 2, i)]
+            );
+        }
+    }
+
+    void ReferenceBackend::unary(UnaryOp op, const BroadcastUtill::Plan& plan, float* w, const float* u) {
+        for (int i = 0; i < plan.size; i++) {
+            float value = u[offset(plan, 1, i)];
+            float& result = w[offset(plan, 0, i)];
+            switch (op) {
+                case UnaryOp::Exp: result = std::exp(value); break;
+                case UnaryOp::Log: result = std::log(value); break;
+                case UnaryOp::Relu: result = value > 0.0f ? value : 0.0f; break;
+                case UnaryOp::Sigmoid: result = 1.0f / (1.0f + std::exp(-value)); break;
+                case UnaryOp::Tanh: result = std::tanh(value); break;
+            }
+        }
+    }
+
+    void ReferenceBackend::unary_backward(
+        UnaryOp op, const BroadcastUtill::Plan& plan, 
+        float* u_grad, const float* w_grad, const float* u, const float* w
+    ) {
+        for (int i = 0; i < plan.size; i++) {
+            float dw = w_grad[offset(plan, 1, i)];
+            float u_value = u[offset(plan, 2, i)];
+            float w_value = w[offset(plan, 3, i)];
+            float& du = u_grad[offset(plan, 0, i)];
+            switch (op) {
+                case UnaryOp::Exp: du += dw * w_value; break;
+                case UnaryOp::Log: du += dw / u_value; break;
+                case UnaryOp::Relu: du += u_value > 0.0f ? dw : 0.0f; break;
+                case UnaryOp::Sigmoid: du += dw * w_value * (1.0f - w_value); break;
+                case UnaryOp::Tanh: du += dw * (1.0f - w_value * w_value); break;
+            }
+        }
+    }
+
+    void ReferenceBackend::sum(const float* u, int outer, int reduce, int inner, float* w) {
+        for (int o = 0; o < outer; o++) {
+            for (int i = 0; i < inner; i++) {
+                float sum = 0.0f;
+                for (int r = 0; r < reduce; r++) {
+                    sum += u[((long long)o * reduce + r) * inner + i];
+                }
+                w[(long long)o * inner + i] = sum;
+            }
+        }
+    }
+
+    void ReferenceBackend::sum_backward(const float* w_grad, int outer, int reduce, int inner, float* u_grad) {
+        for (int o = 0; o < outer; o++) {
+            for (int r = 0; r < reduce; r++) {
+                for (int i = 0; i < inner; i++) {
+                    u_grad[((long long)o * reduce + r) * inner + i] += w_grad[(long long)o * inner + i];
+                }
+            }
+        }
+    }
+
+    void ReferenceBackend::max(const float* u, int outer, int reduce, int inner, float* w, int* argmax, int* ties) {
+        for (int o = 0; o < outer; o++) {
+            for (int i = 0; i < inner; i++) {
+                long long index = (long long)o * inner + i;
+                float max_value = std::numeric_limits<float>::lowest();
+                int max_index = 0, count = 0;
+                for (int r = 0; r < reduce; r++) {
+                    float value = u[((long long)o * reduce + r) * inner + i];
+                    if (value > max_value) {
+                        max_value = value, max_index = r, count = 1;
+                    } else if (value == max_value) {
+                        count++;
+                    }
+                }
+                w[index] = max_value;
+                argmax[index] = max_index;
+                ties[index] = count;
+            }
+        }
+    }
+
+    void ReferenceBackend::softmax(const float* u, int outer, int reduce, int inner, float* w, bool log) {
+        for (int o = 0; o < outer; o++) {
+            for (int i = 0; i < inner; i++) {
+                const float* uo = u + (long long)o * reduce * inner + i;
+                float* wo = w + (long long)o * reduce * inner + i;
+                float max_value = std::numeric_limits<float>::lowest();
+                for (int r = 0; r < reduce; r++) {
+                    max_value = std::max(max_value, uo[(long long)r * inner]);
+                }
+                float sum = 0.0f;
+                for (int r = 0; r < reduce; r++) {
+                    sum += std::exp(uo[(long long)r * inner] - max_value);
+                }
+                for (int r = 0; r < reduce; r++) {
+                    float shifted = uo[(long long)r * inner] - max_value;
+                    wo[(long long)r * inner] = log ? shifted - std::log(sum) : std::exp(shifted) / sum;
+                }
+            }
+        }
+    }
+
+    void ReferenceBackend::softmax_backward(
+        const float* w, const float* w_grad, int outer, int reduce, int inner, float* u_grad, bool log
+    ) {
+        for (int o = 0; o < outer; o++) {
+            for (int i = 0; i < inner; i++) {
+                long long base = (long long)o * reduce * inner + i;
+                float sum = 0.0f;
+                for (int r = 0; r < reduce; r++) {
+                    long long index = base + (long long)r * inner;
+                    sum += log ? w_grad[index] : w_grad[index] * w[index];
+                }
+                for (int r = 0; r < reduce; r++) {
+                    long long index = base + (long long)r * inner;
+                    if (log) {
+                        u_grad[index] += w_grad[index] - std::exp(w[index]) * sum;
+                    } else {
+                        u_grad[index] += w[index] * (w_grad[index] - sum);
+                    }
+                }
+            }
+        }
+    }
+
+    void ReferenceBackend::softmax_cross_entropy(
+        const float* u, const int* labels, int outer, int reduce, int inner, float* loss, float* lse
+    ) {
+        for (int o = 0; o < outer; o++) {
+            for (int i = 0; i < inner; i++) {
+                const float* uo = u + (long long)o * reduce * inner + i;
+                long long index = (long long)o * inner + i;
+                float max_value = std::numeric_limits<float>::lowest();
+                for (int r = 0; r < reduce; r++) {
+                    max_value = std::max(max_value, uo[(long long)r * inner]);
+                }
+                float sum = 0.0f;
+                for (int r = 0; r < reduce; r++) {
+                    sum += std::exp(uo[(long long)r * inner] - max_value);
+                }
+                lse[index] = max_value + std::log(sum);
+                loss[index] = lse[index] - uo[(long long)labels[index] * inner];
+            }
+        }
+    }
+
+    void ReferenceBackend::softmax_cross_entropy_backward(
+        const float* u, const int* labels, const float* lse, int outer, int reduce, int inner, 
+        float scale, float* u_grad
+    ) {
+        for (int o = 0; o < outer; o++) {
+            for (int r = 0; r < reduce; r++) {
+                for (int i = 0; i < inner; i++) {
+                    long long index = ((long long)o * reduce + r) * inner + i;
+                    long long line = (long long)o * inner + i;
+                    u_grad[index] += scale * (std::exp(u[index] - lse[line]) - (r == labels[line]));
+                }
+            }
+        }
+    }
+}
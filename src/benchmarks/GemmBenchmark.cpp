@@ -0,0 +1,106 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <omp.h>
+
+#include "../kernel/Gemm.h"
+#include "../backend/Backend.h"
+
+using namespace RevGrad;
+
+// The i-k-j loop TensorUtill::matmul used before GemmUtill::sgemm
+void naive_matmul(int m, int n, int k, const std::vector<float>& a, const std::vector<float>& b, std::vector<float>& c) {
+    std::vector<float> w_values = c;
+    std::vector<float> u_values = a;
+    std::vector<float> v_values = b;
+    #pragma omp parallel for
+    for (int i = 0; i < m; i++) {
+        for (int p = 0; p < k; p++) {
+            for (int j = 0; j < n; j++) {
+                w_values[i * n + j] += u_values[i * k + p] * v_values[p * n + j];
+            }
+        }
+    }
+    c = w_values;
+}
+
+template <typename F>
+double seconds_per_call(F f) {
+    f();
+    int calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (elapsed < 0.25) {
+        f();
+        calls++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed / calls;
+}
+
+int main() {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<std::vector<int>> shapes = {
+        {128, 64, 784},  // Linear(784, 128) forward, batch 64
+        {128, 784, 64},  // its weight gradient
+        {784, 64, 128},  // its input gradient
+        {256, 256, 256},
+        {512, 512, 512},
+        {1024, 1024, 1024},
+        {8, 4096, 1024},
+        {4096, 8, 1024},
+    };
+
+    Backend& backend = BackendUtill::backend();
+    std::cout << "kernel: " << GemmUtill::kernel_name() 
+              << ", backend: " << backend.name() 
+              << ", threads: " << omp_get_max_threads() << std::endl;
+    std::cout << std::setw(20) << "m x n x k" 
+              << std::setw(14) << "naive GFLOP/s" 
+              << std::setw(14) << "sgemm GFLOP/s" 
+              << std::setw(16) << "backend GFLOP/s" 
+              << std::setw(10) << "speedup" 
+              << std::setw(12) << "max error" << std::endl;
+
+    for (auto& shape : shapes) {
+        int m = shape[0], n = shape[1], k = shape[2];
+        std::vector<float> a(m * k), b(k * n), c_naive(m * n), c(m * n);
+        for (auto& x : a) x = dist(rng);
+        for (auto& x : b) x = dist(rng);
+
+        double flops = 2.0 * m * n * k;
+        double naive = seconds_per_call([&] {
+            std::fill(c_naive.begin(), c_naive.end(), 0.0f);
+            naive_matmul(m, n, k, a, b, c_naive);
+        });
+        double gemm = seconds_per_call([&] {
+            GemmUtill::sgemm(false, false, m, n, k, 1.0f, a.data(), k, b.data(), n, 0.0f, c.data(), n);
+        });
+        std::vector<float> c_backend(m * n);
+        double backend_gemm = seconds_per_call([&] {
+            backend.gemm(false, false, m, n, k, 1.0f, a.data(), k, b.data(), n, 0.0f, c_backend.data(), n);
+        });
+
+        float error = 0.0f;
+        for (int i = 0; i < m * n; i++) {
+            error = std::max(error, std::abs(c[i] - c_naive[i]));
+            error = std::max(error, std::abs(c_backend[i] - c_naive[i]));
+        }
+
+        std::string name = std::to_string(m) + " x " + std::to_string(n) + " x " + std::to_string(k);
+        std::cout << std::setw(20) << name
+                  << std::setw(14) << std::fixed << std::setprecision(2) << flops / naive * 1e-9
+                  << std::setw(14) << flops / gemm * 1e-9
+                  << std::setw(16) << flops / backend_gemm * 1e-9
+                  << std::setw(9) << naive / gemm << "x"
+                  << std::setw(12) << std::scientific << std::setprecision(2) << error 
+                  << std::defaultfloat << std::endl;
+    }
+
+    return 0;
+}
@@ -15,19 +15,16 @@ public:
     Linear l3;
     
     NN() {
-        l1 = Linear(this, 2, 8);
-        l2 = Linear(this, 8, 4);
-        l3 = Linear(this, 4, 1);
+        l1 = Linear(this, 2, 8, Activation::Relu);
+        l2 = Linear(this, 8, 4, Activation::Relu);
+        l3 = Linear(this, 4, 1, Activation::Sigmoid);
     }
 
     Tensor forward(Tensor x) {
         Tensor y = x;
         y = l1(y);
-        y = Tensor::relu(y);
         y = l2(y);
-        y = Tensor::relu(y);
         y = l3(y);
-        y = Tensor::sigmoid(y);
         return y;
     }
 };
@@ -44,7 +41,7 @@ int main() {
         0, 1, 
         0, 1
     });
-    X.transpose();
+    X = X.transpose();
 
     Tensor correct = Tensor(Shape({8}), {1, 1, 1, 1, 0, 0, 0, 0});
 
@@ -57,7 +54,7 @@ int main() {
         nn.load_parameters("examples/model_weights/learning_weights.csv");
 
         Tensor prediction = nn(X);
-        prediction.flatten();
+        prediction = prediction.flatten();
         Tensor loss = mse(prediction, correct);
 
         std::cout << "prediction: " << prediction << std::endl;
@@ -71,7 +68,7 @@ int main() {
 
     for (int i = 0; i <= 500; i++) {
         Tensor prediction = nn(X);
-        prediction.flatten();
+        prediction = prediction.flatten();
         Tensor loss = mse(prediction, correct);
 
         sgd.zero();
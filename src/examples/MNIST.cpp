@@ -13,6 +13,7 @@
 #include "../model/Model.h"
 #include "../loss/Loss.h"
 #include "../strategy/Strategy.h"
+#include "../graph/StaticGraph.h"
 
 using namespace RevGrad;
 
@@ -23,26 +24,23 @@ public:
     Linear l3;
     
     FeedForward() {
-        l1 = Linear(this, 784, 128);
-        l2 = Linear(this, 128, 64);
-        l3 = Linear(this, 64, 10);
+        l1 = Linear(this, 784, 128, Activation::Relu, Layout::BatchFirst);
+        l2 = Linear(this, 128, 64, Activation::Relu, Layout::BatchFirst);
+        l3 = Linear(this, 64, 10, Activation::None, Layout::BatchFirst);
     }
 
     Tensor forward(Tensor x) {
         Tensor y = x;
         y = l1(y);
-        y = Tensor::relu(y);
         y = l2(y);
-        y = Tensor::relu(y);
         y = l3(y);
-        y = Tensor::log_softmax(y);
         return y;
     }
 };
 
 void print_image(Tensor image) {
     assert(image.size() == 784);
-    image.reshape({28, 28});
+    image = image.reshape({28, 28});
     const std::string intensity_chars = " .:-=+*#%@";
     for (int i = 0; i < 28; i++) {
         for (int j = 0; j < 28; j++) {
@@ -61,21 +59,10 @@ int main() {
     Tensor test = Tensor::from_csv("examples/data/mnist_test.csv");
 
     auto split = [] (const Tensor& data) -> std::pair<Tensor, Tensor> {
-        Tensor X = data.slice({{0, data.shape()[0]}, {1, data.shape()[1]}});
-        float mx = 0;
-        for (int i = 0; i < X.shape()[0]; i++) {
-            for (int j = 0; j < X.shape()[1]; j++) {
-                X.value({i, j}) /= 255.0f;
-            }
-        }
-        Tensor y = data.slice({{0, data.shape()[0]}, {0, 1}});
-        std::vector<float> values;
-        for (int i = 0; i < y.shape()[0]; i++) {
-            for (int j = 0; j < 10; j++) {
-                values.push_back(y.value({i, 0}) == j);
-            }
-        }
-        return {X, Tensor(Shape({y.shape()[0], 10}), values)};
+        Tensor X = data.slice({{0, data.shape()[0]}, {1, data.shape()[1]}}).contiguous();
+        X.mul_(1.0f / 255.0f);
+        Tensor y = data.slice({{0, data.shape()[0]}, {0, 1}}).flatten();
+        return {X, y};
     };
 
     auto [X_train, y_train] = split(train);
@@ -96,41 +83,51 @@ int main() {
     std::cout << "Number of model parameters: " << parameter_cnt << std::endl;
 
     // Training
-    NLLLoss nll_loss;
+    SoftmaxCrossEntropyLoss loss_fn(Layout::BatchFirst);
     SGD sgd(model.get_params(), 0.002f);
 
     int num_epochs = 4;
     int batch_size = 64;
 
+    // Every batch runs the same graph, so it is captured once and replayed, the last
+    // smaller batch gets its own plan
+    StaticGraph train_step([&] (const std::vector<Tensor>& inputs) {
+        return loss_fn(model(inputs[0]), inputs[1]);
+    });
+
     for (int i = 0; i < num_epochs; i++) {
 
         float epoch_loss = 0.0f;
+        double engine_seconds = 0.0, kernel_seconds = 0.0;
         
         for (int j = 0; j < X_train.shape()[0]; j += batch_size) {
 
             Tensor batch = X_train.slice({{j, std::min(X_train.shape()[0], j + batch_size)}, {0, 784}});
-            batch.transpose();
-            Tensor correct = y_train.slice({{j, std::min(y_train.shape()[0], j + batch_size)}, {0, 10}});
-            correct.transpose();
-            
-            Tensor prediction = model(batch);
-            Tensor loss = nll_loss(prediction, correct);
+            Tensor correct = y_train.slice({{j, std::min(y_train.shape()[0], j + batch_size)}});
             
             sgd.zero();
-            loss.backward();
+            Tensor loss = train_step({batch, correct});
             sgd.update();
             
             epoch_loss += loss.value({0});
+            engine_seconds += Tensor::backward_stats().engine_seconds;
+            kernel_seconds += Tensor::backward_stats().kernel_seconds;
         }
 
         epoch_loss /= X_train.shape()[0];
-        std::cout << "Epoch: " << i + 1 << ", training loss: " << epoch_loss << std::endl;
+        AllocatorStats memory = AllocatorUtill::stats();
+        std::cout << "Epoch: " << i + 1 << ", training loss: " << epoch_loss 
+            << ", backward engine: " << engine_seconds << "s, backward kernels: " << kernel_seconds << "s" 
+            << ", peak memory: " << memory.peak / (1 << 20) << "MB, reused buffers: " 
+            << memory.reuse_hits << "/" << memory.allocations << std::endl;
     }
 
     // Test accuracy
-    X_test.transpose();
-    Tensor prediction = model(X_test);
-    prediction.transpose();
+    Tensor prediction;
+    {
+        NoGradGuard no_grad;
+        prediction = model(X_test);
+    }
 
     auto get_prediction = [&] (int i) -> float {
         float best = std::numeric_limits<float>::lowest();
@@ -162,7 +159,7 @@ int main() {
         std::cout << "prediction: " << get_prediction(i) << std::endl;
         std::cout << "correct: " << test.value({i, 0}) << std::endl;
         std::cout << "image: " << std::endl;
-        Tensor image = X_test.slice({{0, 784}, {i, i + 1}});
+        Tensor image = X_test.slice({{i, i + 1}, {0, 784}});
         print_image(image);
     }
     
@@ -0,0 +1,102 @@
+#include "StaticGraph.h"
+
+#include <set>
+
+namespace RevGrad {
+    namespace {
+        std::vector<Shape> shapes_of(const std::vector<Tensor>& inputs) {
+            std::vector<Shape> shapes;
+            for (const Tensor& input : inputs) {
+                shapes.push_back(input.shape());
+            }
+            return shapes;
+        }
+
+        /*
+            Copies the values of u, which may be a view, into the dense tensor w
+        */
+        void copy_into(const Tensor& w, const Tensor& u) {
+            assert(w.shape() == u.shape());
+            TensorUtill::contiguous_forward_fn(w, {u});
+        }
+    }
+
+    StaticGraph::StaticGraph(Step step, int max_plans)
+        : step(step), max_plans(max_plans), capture_count(0), replay_count(0) {}
+
+    StaticGraph::Plan StaticGraph::capture(const std::vector<Tensor>& inputs) {
+        Plan plan;
+        for (const Tensor& input : inputs) {
+            Tensor placeholder(input.shape());
+            copy_into(placeholder, input);
+            placeholder.requires_grad() = input.requires_grad();
+            plan.inputs.push_back(placeholder);
+        }
+        plan.loss = step(plan.inputs);
+        // post-order depth first search, so every op comes after its inputs
+        std::set<Node*> visited = {plan.loss.data().get()};
+        std::vector<std::pair<Tensor, int>> stack = {{plan.loss, 0}};
+        while (!stack.empty()) {
+            auto& [tensor, next] = stack.back();
+            if (next == (int)tensor.edges().size()) {
+                if (!tensor.edges().empty()) {
+                    plan.ops.push_back(tensor);
+                }
+                stack.pop_back();
+                continue;
+            }
+            Tensor child = tensor.edges()[next++];
+            if (visited.insert(child.data().get()).second) {
+                stack.push_back({child, 0});
+            }
+        }
+        plan.loss.backward(true);
+        return plan;
+    }
+
+    void StaticGraph::replay(Plan& plan, const std::vector<Tensor>& inputs) {
+        for (int i = 0; i < (int)inputs.size(); i++) {
+            copy_into(plan.inputs[i], inputs[i]);
+            // placeholders stand for fresh inputs, which start without a gradient
+            std::fill(plan.inputs[i].data()->grads.begin(), plan.inputs[i].data()->grads.end(), 0.0f);
+        }
+        for (Tensor& op : plan.ops) {
+            // views share the storage of their input and have nothing to recompute
+            if (op.forward_fn()) {
+                op.forward_fn()(op, op.edges());
+            }
+            // the recomputed values are the ones the backward reads now
+            TensorUtill::save_version(op);
+            std::fill(op.data()->grads.begin(), op.data()->grads.end(), 0.0f);
+        }
+        // the backward walks the captured order itself, the engine would sort again
+        // whenever another graph ran backward in between
+        std::fill(plan.loss.data()->grads.begin(), plan.loss.data()->grads.end(), 1.0f);
+        for (auto it = plan.ops.rbegin(); it != plan.ops.rend(); ++it) {
+            // ops that received no gradient pass none on
+            if (it->backward_fn() && !it->data()->grads.empty()) {
+                it->backward_fn()(*it);
+            }
+        }
+    }
+
+    Tensor StaticGraph::operator()(const std::vector<Tensor>& inputs) {
+        std::vector<Shape> shapes = shapes_of(inputs);
+        auto it = plans.find(shapes);
+        if (it != plans.end()) {
+            replay(it->second, inputs);
+            replay_count++;
+            return it->second.loss;
+        }
+        if ((int)plans.size() >= max_plans) {
+            Tensor loss = step(inputs);
+            loss.backward();
+            return loss;
+        }
+        capture_count++;
+        return plans.emplace(shapes, capture(inputs)).first->second.loss;
+    }
+
+    int StaticGraph::captures() const { return capture_count; }
+    int StaticGraph::replays() const { return replay_count; }
+}
@@ -0,0 +1,62 @@
+#ifndef REVGRAD_STATIC_GRAPH_H
+#define REVGRAD_STATIC_GRAPH_H
+
+#include <map>
+#include <functional>
+
+#include "../tensor/Tensor.h"
+
+namespace RevGrad {
+    /*
+        Captures a training step (forward and backward) whose graph only depends on the shapes
+        of its inputs, and replays it on new inputs. The first call for a set of input shapes
+        runs the step once and keeps its graph as an execution plan: every intermediate
+        buffer stays allocated and replays only copy the inputs in and run the forward and
+        backward kernels in the captured topological order, with no op dispatch, node
+        allocation or graph sorting. The backward of a replay is serial. Outputs,
+        gradients and the working buffers of the ops (see Node::workspace) are bound at
+        capture, so a replay takes no tensor buffer from the allocator.
+
+        Parameters are read through the graph, so in place updates between steps are seen
+        by the next replay. Each distinct set of shapes, e.g. a smaller final batch, is
+        captured once; past max_plans the step runs eagerly instead.
+    */
+    class StaticGraph {
+    public:
+        /*
+            @param inputs dense placeholders with the shapes of the current call
+            @return scalar loss of the step
+        */
+        typedef std::function<Tensor(const std::vector<Tensor>& inputs)> Step;
+
+    private:
+        struct Plan {
+            std::vector<Tensor> inputs;
+            Tensor loss;
+            std::vector<Tensor> ops; // op outputs in topological order, the loss last
+        };
+
+        Step step;
+        int max_plans;
+        std::map<std::vector<Shape>, Plan> plans;
+        int capture_count;
+        int replay_count;
+
+        Plan capture(const std::vector<Tensor>& inputs);
+        void replay(Plan& plan, const std::vector<Tensor>& inputs);
+
+    public:
+        StaticGraph(Step step, int max_plans = 4);
+        /*
+            Runs the step on inputs and its backward pass, accumulating into the gradients
+            of the parameters like Tensor::backward
+
+            @return loss of the step, valid until the next call with the same shapes
+        */
+        Tensor operator()(const std::vector<Tensor>& inputs);
+        int captures() const;
+        int replays() const;
+    };
+}
+
+#endif
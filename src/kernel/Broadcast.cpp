@@ -0,0 +1,61 @@
+#include "Broadcast.h"
+
+namespace RevGrad {
+    namespace BroadcastUtill {
+        Dims broadcast_strides(const Shape& shape, const Strides& strides, const Shape& out_shape) {
+            int n = out_shape.size();
+            int size_delta = n - (int)shape.size();
+            assert(size_delta >= 0 && n <= MAX_DIMS);
+            Dims aligned;
+            aligned.count = n;
+            std::fill(aligned.values, aligned.values + n, 0);
+            for (int i = 0; i < (int)shape.size(); i++) {
+                assert(shape[i] == out_shape[size_delta + i] || shape[i] == 1);
+                if (shape[i] != 1) {
+                    aligned[size_delta + i] = strides[i];
+                }
+            }
+            return aligned;
+        }
+
+        Plan make_plan(const Shape& out_shape, std::initializer_list<Dims> operand_strides) {
+            return make_plan(out_shape, operand_strides.begin(), operand_strides.size());
+        }
+
+        Plan make_plan(const Shape& out_shape, const Dims* strides, int n) {
+            assert(n <= MAX_OPERANDS);
+            Plan plan;
+            plan.operands = n;
+            plan.size = 1;
+            for (int k = 0; k < (int)out_shape.size(); k++) {
+                plan.size *= out_shape[k];
+                if (out_shape[k] == 1) {
+                    continue;
+                }
+                int d = plan.shape.size();
+                bool mergeable = d > 0;
+                for (int i = 0; i < n && mergeable; i++) {
+                    mergeable = plan.strides[i][d - 1] == strides[i][k] * out_shape[k];
+                }
+                if (mergeable) {
+                    plan.shape[d - 1] *= out_shape[k];
+                    for (int i = 0; i < n; i++) {
+                        plan.strides[i][d - 1] = strides[i][k];
+                    }
+                    continue;
+                }
+                plan.shape.push_back(out_shape[k]);
+                for (int i = 0; i < n; i++) {
+                    plan.strides[i].push_back(strides[i][k]);
+                }
+            }
+            if (plan.shape.empty()) {
+                plan.shape.push_back(1);
+                for (int i = 0; i < n; i++) {
+                    plan.strides[i].push_back(0);
+                }
+            }
+            return plan;
+        }
+    }
+}
@@ -0,0 +1,352 @@
+#ifndef REVGRAD_BROADCAST_H
+#define REVGRAD_BROADCAST_H
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <cassert>
+#include <algorithm>
+#include <omp.h>
+
+namespace RevGrad {
+    typedef std::vector<int> Shape;
+    typedef std::vector<int> Strides;
+
+    namespace BroadcastUtill {
+        const int MAX_DIMS = 8;
+        const int MAX_OPERANDS = 16; // a fused op reads up to 7 inputs and writes their gradients
+        const int PARALLEL_THRESHOLD = 1 << 15;
+        const int GRAIN = 1 << 12;
+
+        /*
+            Sizes or strides of at most MAX_DIMS dimensions stored inline, so that building
+            a plan allocates nothing
+        */
+        struct Dims {
+            int values[MAX_DIMS];
+            int count = 0;
+            Dims() {}
+            Dims(const std::vector<int>& dims) : count(dims.size()) {
+                assert(count <= MAX_DIMS);
+                std::copy(dims.begin(), dims.end(), values);
+            }
+            int size() const { return count; }
+            bool empty() const { return count == 0; }
+            int& operator[](int i) { return values[i]; }
+            int operator[](int i) const { return values[i]; }
+            const int* begin() const { return values; }
+            const int* end() const { return values + count; }
+            void push_back(int value) {
+                assert(count < MAX_DIMS);
+                values[count++] = value;
+            }
+        };
+
+        /*
+            Iteration plan for an elementwise op. Every operand is described by strides
+            aligned to the output shape, with stride 0 along broadcast dimensions.
+            Unit dimensions are dropped and adjacent dimensions that are contiguous for
+            every operand are merged, so most ops end up with one or two dimensions.
+        */
+        struct Plan {
+            Dims shape;
+            std::array<Dims, MAX_OPERANDS> strides; // strides of operand n, for n < operands
+            int operands = 0;
+            int size = 0;
+        };
+
+        /*
+            @return strides of a tensor (shape, strides) aligned to out_shape, 0 where it is broadcast
+        */
+        Dims broadcast_strides(const Shape& shape, const Strides& strides, const Shape& out_shape);
+        Plan make_plan(const Shape& out_shape, std::initializer_list<Dims> strides);
+        Plan make_plan(const Shape& out_shape, const Dims* strides, int operands);
+
+        /*
+            Calls fn(i) for every i in [0, n), split statically over the OpenMP threads if
+            parallel. Serial loops do not enter a parallel region at all: even with a false
+            if clause that costs several hundred nanoseconds, more than the math of an op
+            on a small tensor.
+        */
+        template <typename Fn>
+        void parallel_for(int n, bool parallel, Fn fn) {
+            if (!parallel || n <= 1) {
+                for (int i = 0; i < n; i++) {
+                    fn(i);
+                }
+                return;
+            }
+            #pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++) {
+                fn(i);
+            }
+        }
+
+        /*
+            Splits the plan into chunks of lines along the innermost dimension and calls
+            fn(offsets, begin, end) for every line, where offsets[n] is the start of the
+            line in operand n and [begin, end) the part of the line to process. work is the
+            total number of elements touched by fn, used to decide whether to use threads.
+        */
+        template <int N, typename Fn>
+        void for_each_line(const Plan& plan, Fn fn, long long work = -1) {
+            int d = plan.shape.size();
+            assert(d >= 1 && d <= MAX_DIMS);
+            assert(plan.operands == N);
+            if (plan.size == 0) {
+                return;
+            }
+            int inner = plan.shape[d - 1];
+            int lines = plan.size / inner;
+            if (work < 0) {
+                work = plan.size;
+            }
+            int threads = work >= PARALLEL_THRESHOLD ? omp_get_max_threads() : 1;
+            int blocks = 1;
+            if (lines < threads && inner >= 2 * GRAIN) {
+                blocks = std::min(threads, inner / GRAIN);
+            }
+            int block = (inner + blocks - 1) / blocks;
+            int chunks = std::min(lines * blocks, threads);
+            parallel_for(chunks, chunks > 1, [&](int c) {
+                int task_begin = (long long)lines * blocks * c / chunks;
+                int task_end = (long long)lines * blocks * (c + 1) / chunks;
+                int index[MAX_DIMS];
+                int offsets[N];
+                int line = task_begin / blocks;
+                for (int n = 0; n < N; n++) {
+                    offsets[n] = 0;
+                }
+                for (int k = d - 2, rem = line; k >= 0; k--) {
+                    index[k] = rem % plan.shape[k];
+                    rem /= plan.shape[k];
+                    for (int n = 0; n < N; n++) {
+                        offsets[n] += index[k] * plan.strides[n][k];
+                    }
+                }
+                for (int task = task_begin; task < task_end; task++) {
+                    int b = task % blocks;
+                    fn(offsets, b * block, std::min(inner, (b + 1) * block));
+                    if (b + 1 < blocks) {
+                        continue;
+                    }
+                    for (int k = d - 2; k >= 0; k--) {
+                        index[k]++;
+                        for (int n = 0; n < N; n++) {
+                            offsets[n] += plan.strides[n][k];
+                        }
+                        if (index[k] < plan.shape[k]) {
+                            break;
+                        }
+                        for (int n = 0; n < N; n++) {
+                            offsets[n] -= index[k] * plan.strides[n][k];
+                        }
+                        index[k] = 0;
+                    }
+                }
+            });
+        }
+
+        namespace detail {
+            template <int N, typename Fn, size_t... I>
+            inline void apply(Fn& fn, float* const* p, int i, std::index_sequence<I...>) {
+                fn(p[I][i]...);
+            }
+
+            template <int N, typename Fn, size_t... I>
+            inline void apply(Fn& fn, float* const* p, const int* s, int i, std::index_sequence<I...>) {
+                fn(p[I][i * s[I]]...);
+            }
+        }
+
+        /*
+            Calls fn(p0[i], ..., pN-1[i]) with references to the elements of every operand
+            at each position of the plan. Used for strided (non-contiguous) unary kernels.
+        */
+        template <int N, typename Fn>
+        void elementwise(const Plan& plan, const std::array<float*, N>& ptrs, Fn fn) {
+            int d = plan.shape.size();
+            int s[N];
+            bool unit = true;
+            for (int n = 0; n < N; n++) {
+                s[n] = plan.strides[n][d - 1];
+                unit &= s[n] == 1;
+            }
+            for_each_line<N>(plan, [&](const int* offsets, int begin, int end) {
+                float* p[N];
+                for (int n = 0; n < N; n++) {
+                    p[n] = ptrs[n] + offsets[n];
+                }
+                if (unit) {
+                    #pragma omp simd
+                    for (int i = begin; i < end; i++) {
+                        detail::apply<N>(fn, p, i, std::make_index_sequence<N>());
+                    }
+                } else {
+                    for (int i = begin; i < end; i++) {
+                        detail::apply<N>(fn, p, s, i, std::make_index_sequence<N>());
+                    }
+                }
+            });
+        }
+
+        /*
+            w = op(u, v) with plan operands (w, u, v), w contiguous
+        */
+        template <typename Op>
+        void binary(const Plan& plan, float* w, const float* u, const float* v, Op op) {
+            int d = plan.shape.size();
+            int su = plan.strides[1][d - 1];
+            int sv = plan.strides[2][d - 1];
+            for_each_line<3>(plan, [&](const int* offsets, int begin, int end) {
+                float* wp = w + offsets[0];
+                const float* up = u + offsets[1];
+                const float* vp = v + offsets[2];
+                if (su == 1 && sv == 1) {
+                    #pragma omp simd
+                    for (int i = begin; i < end; i++) {
+                        wp[i] = op(up[i], vp[i]);
+                    }
+                } else if (su == 0 && sv == 1) {
+                    float a = up[0];
+                    #pragma omp simd
+                    for (int i = begin; i < end; i++) {
+                        wp[i] = op(a, vp[i]);
+                    }
+                } else if (su == 1 && sv == 0) {
+                    float b = vp[0];
+                    #pragma omp simd
+                    for (int i = begin; i < end; i++) {
+                        wp[i] = op(up[i], b);
+                    }
+                } else {
+                    for (int i = begin; i < end; i++) {
+                        wp[i] = op(up[i * su], vp[i * sv]);
+                    }
+                }
+            });
+        }
+
+        /*
+            Accumulates x_grad += g(w_grad, u, v) with plan operands (w_grad, u, v, x_grad),
+            summing over every dimension along which x is broadcast. Each element of x_grad
+            is owned by exactly one thread, so the result is race free and deterministic.
+        */
+        template <typename G>
+        void reduce_binary(const Plan& plan, float* x_grad, const float* w_grad, const float* u, const float* v, G g) {
+            int d = plan.shape.size();
+            const Dims& sx = plan.strides[3];
+            bool broadcast = false;
+            for (int k = 0; k < d; k++) {
+                broadcast |= sx[k] == 0;
+            }
+            if (!broadcast) {
+                int su = plan.strides[1][d - 1];
+                int sv = plan.strides[2][d - 1];
+                for_each_line<4>(plan, [&](const int* offsets, int begin, int end) {
+                    const float* dw = w_grad + offsets[0];
+                    const float* up = u + offsets[1];
+                    const float* vp = v + offsets[2];
+                    float* xg = x_grad + offsets[3];
+                    if (su == 1 && sv == 1) {
+                        #pragma omp simd
+                        for (int i = begin; i < end; i++) {
+                            xg[i] += g(dw[i], up[i], vp[i]);
+                        }
+                    } else {
+                        for (int i = begin; i < end; i++) {
+                            xg[i] += g(dw[i], up[i * su], vp[i * sv]);
+                        }
+                    }
+                });
+                return;
+            }
+            // Split into dimensions kept in x and reduced dimensions. The kept part is
+            // distributed over threads, the reduced part is walked sequentially for every
+            // kept position with the innermost dimension as the vectorized loop.
+            bool inner_reduced = sx[d - 1] == 0;
+            int inner = plan.shape[d - 1];
+            int si[4];
+            for (int n = 0; n < 4; n++) {
+                si[n] = plan.strides[n][d - 1];
+            }
+            Plan outer, reduced;
+            outer.operands = reduced.operands = 4;
+            for (int k = 0; k < d - 1; k++) {
+                Plan& part = (sx[k] == 0) ? reduced : outer;
+                part.shape.push_back(plan.shape[k]);
+                for (int n = 0; n < 4; n++) {
+                    part.strides[n].push_back(plan.strides[n][k]);
+                }
+            }
+            outer.shape.push_back(inner_reduced ? 1 : inner);
+            for (int n = 0; n < 4; n++) {
+                outer.strides[n].push_back(inner_reduced ? 0 : si[n]);
+            }
+            outer.size = 1;
+            for (int s : outer.shape) {
+                outer.size *= s;
+            }
+            reduced.size = plan.size / outer.size / (inner_reduced ? inner : 1);
+            int rd = reduced.shape.size();
+            for_each_line<4>(outer, [&](const int* offsets, int begin, int end) {
+                int index[MAX_DIMS];
+                int off[3] = {offsets[0], offsets[1], offsets[2]};
+                for (int k = 0; k < rd; k++) {
+                    index[k] = 0;
+                }
+                float* xg = x_grad + offsets[3];
+                float acc = 0.0f;
+                for (int r = 0; r < reduced.size; r++) {
+                    const float* dw = w_grad + off[0];
+                    const float* up = u + off[1];
+                    const float* vp = v + off[2];
+                    if (inner_reduced && si[0] == 1 && si[1] == 1 && si[2] == 1) {
+                        #pragma omp simd reduction(+:acc)
+                        for (int i = 0; i < inner; i++) {
+                            acc += g(dw[i], up[i], vp[i]);
+                        }
+                    } else if (inner_reduced) {
+                        for (int i = 0; i < inner; i++) {
+                            acc += g(dw[i * si[0]], up[i * si[1]], vp[i * si[2]]);
+                        }
+                    } else if (si[0] == 1 && si[1] == 1 && si[2] == 0 && si[3] == 1) {
+                        float b = vp[0];
+                        #pragma omp simd
+                        for (int i = begin; i < end; i++) {
+                            xg[i] += g(dw[i], up[i], b);
+                        }
+                    } else if (si[0] == 1 && si[1] == 0 && si[2] == 1 && si[3] == 1) {
+                        float a = up[0];
+                        #pragma omp simd
+                        for (int i = begin; i < end; i++) {
+                            xg[i] += g(dw[i], a, vp[i]);
+                        }
+                    } else {
+                        for (int i = begin; i < end; i++) {
+                            xg[i * si[3]] += g(dw[i * si[0]], up[i * si[1]], vp[i * si[2]]);
+                        }
+                    }
+                    for (int k = rd - 1; k >= 0; k--) {
+                        index[k]++;
+                        for (int n = 0; n < 3; n++) {
+                            off[n] += reduced.strides[n][k];
+                        }
+                        if (index[k] < reduced.shape[k]) {
+                            break;
+                        }
+                        for (int n = 0; n < 3; n++) {
+                            off[n] -= index[k] * reduced.strides[n][k];
+                        }
+                        index[k] = 0;
+                    }
+                }
+                if (inner_reduced) {
+                    xg[0] += acc;
+                }
+            }, (long long)plan.size);
+        }
+    }
+}
+
+#endif
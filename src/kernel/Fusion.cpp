@@ -0,0 +1,317 @@
+#include "Fusion.h"
+#include "Math.h"
+
+namespace RevGrad {
+    namespace FusionUtill {
+        namespace {
+            // elements evaluated at once, every register of a block stays in L1
+            const int BLOCK = 256;
+
+            typedef float Registers[MAX_INSTRUCTIONS][BLOCK];
+
+            /*
+                Calls fn(offsets, length) for every run of the elements [begin, end) of the
+                plan that lies within one line, where offsets[n] is the start of the run in
+                operand n, which advances by its innermost stride
+            */
+            template <typename Fn>
+            void for_each_run(const BroadcastUtill::Plan& plan, int begin, int end, Fn fn) {
+                int d = plan.shape.size();
+                int inner = plan.shape[d - 1];
+                int offsets[BroadcastUtill::MAX_OPERANDS];
+                for (int index = begin; index < end;) {
+                    int position = index % inner;
+                    int length = std::min(inner - position, end - index);
+                    for (int n = 0; n < plan.operands; n++) {
+                        offsets[n] = position * plan.strides[n][d - 1];
+                    }
+                    for (int k = d - 2, rem = index / inner; k >= 0; k--) {
+                        int i = rem % plan.shape[k];
+                        rem /= plan.shape[k];
+                        for (int n = 0; n < plan.operands; n++) {
+                            offsets[n] += i * plan.strides[n][k];
+                        }
+                    }
+                    fn(offsets, length);
+                    index += length;
+                }
+            }
+
+            /*
+                Fills the registers for a run of length elements, input i is plan operand i + 1
+            */
+            template <MathUtill::Mode M>
+            void evaluate(
+                const Program& program, const BroadcastUtill::Plan& plan, const void* const* inputs, 
+                const DType* types, const int* offsets, int length, Registers& r
+            ) {
+                int d = plan.shape.size();
+                for (int k = 0; k < program.size; k++) {
+                    const Instruction& in = program.instructions[k];
+                    float* w = r[k];
+                    const float* a = r[in.a];
+                    const float* b = r[in.b];
+                    switch (in.code) {
+                        case Code::Load: {
+                            int s = plan.strides[in.a + 1][d - 1];
+                            DType type = types[in.a];
+                            if (type != DType::Float32) {
+                                const Half* u = static_cast<const Half*>(inputs[in.a]) + offsets[in.a + 1];
+                                if (s == 1) {
+                                    HalfUtill::to_float(type, u, w, length);
+                                } else {
+                                    for (int i = 0; i < length; i++) {
+                                        w[i] = HalfUtill::to_float(type, u[i * s]);
+                                    }
+                                }
+                                break;
+                            }
+                            const float* u = static_cast<const float*>(inputs[in.a]) + offsets[in.a + 1];
+                            if (s == 1) {
+                                std::copy(u, u + length, w);
+                            } else {
+                                for (int i = 0; i < length; i++) {
+                                    w[i] = u[i * s];
+                                }
+                            }
+                            break;
+                        }
+                        case Code::Add:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = a[i] + b[i];
+                            break;
+                        case Code::Subtract:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = a[i] - b[i];
+                            break;
+                        case Code::Multiply:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = a[i] * b[i];
+                            break;
+                        case Code::Divide:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = a[i] / b[i];
+                            break;
+                        case Code::Exp:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = MathUtill::exp<M>(a[i]);
+                            break;
+                        case Code::Log:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = MathUtill::log<M>(a[i]);
+                            break;
+                        case Code::Relu:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = std::max(0.0f, a[i]);
+                            break;
+                        case Code::Sigmoid:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = MathUtill::sigmoid<M>(a[i]);
+                            break;
+                        case Code::Tanh:
+                            #pragma omp simd
+                            for (int i = 0; i < length; i++) w[i] = MathUtill::tanh<M>(a[i]);
+                            break;
+                    }
+                }
+            }
+
+            /*
+                Sums are taken per block of fixed size and added in block order, so the result
+                does not depend on the number of threads
+            */
+            template <MathUtill::Mode M>
+            void forward_kernel(
+                const Program& program, const BroadcastUtill::Plan& plan, float* w,
+                const void* const* inputs, const DType* types
+            ) {
+                int d = plan.shape.size();
+                int result = program.size - 1;
+                int blocks = (plan.size + BLOCK - 1) / BLOCK;
+                std::vector<double> partials(program.reduce ? blocks : 0);
+                BroadcastUtill::parallel_for(blocks, plan.size >= BroadcastUtill::PARALLEL_THRESHOLD, [&](int block) {
+                    Registers r;
+                    float partial = 0.0f;
+                    int end = std::min(plan.size, (block + 1) * BLOCK);
+                    for_each_run(plan, block * BLOCK, end, [&](const int* offsets, int length) {
+                        evaluate<M>(program, plan, inputs, types, offsets, length, r);
+                        const float* value = r[result];
+                        if (program.reduce) {
+                            #pragma omp simd reduction(+:partial)
+                            for (int i = 0; i < length; i++) {
+                                partial += value[i];
+                            }
+                            return;
+                        }
+                        float* out = w + offsets[0];
+                        int s = plan.strides[0][d - 1];
+                        for (int i = 0; i < length; i++) {
+                            out[i * s] = value[i];
+                        }
+                    });
+                    if (program.reduce) {
+                        partials[block] = partial;
+                    }
+                });
+                if (program.reduce) {
+                    double total = 0.0;
+                    for (double partial : partials) {
+                        total += partial;
+                    }
+                    w[0] = total;
+                }
+            }
+
+            /*
+                du += dw, strided and possibly broadcast (stride 0) into the gradient of an input
+            */
+            void accumulate(float* du, int s, const float* dw, int length) {
+                if (s == 0) {
+                    float sum = 0.0f;
+                    #pragma omp simd reduction(+:sum)
+                    for (int i = 0; i < length; i++) {
+                        sum += dw[i];
+                    }
+                    du[0] += sum;
+                    return;
+                }
+                for (int i = 0; i < length; i++) {
+                    du[i * s] += dw[i];
+                }
+            }
+
+            /*
+                Reverse sweep over the registers of each run: adjoint k holds the gradient of
+                register k, pushed to the operands of its instruction and, for loads, added to
+                the gradient of the input. Derivatives match the unfused backward functions.
+            */
+            template <MathUtill::Mode M>
+            void backward_kernel(
+                const Program& program, const BroadcastUtill::Plan& plan,
+                const float* w_grad, const void* const* inputs, const DType* types, float* const* grads, bool parallel
+            ) {
+                int d = plan.shape.size();
+                int n = program.inputs;
+                int result = program.size - 1;
+                int blocks = (plan.size + BLOCK - 1) / BLOCK;
+                BroadcastUtill::parallel_for(blocks, parallel, [&](int block) {
+                    Registers r;
+                    Registers adjoints;
+                    int end = std::min(plan.size, (block + 1) * BLOCK);
+                    for_each_run(plan, block * BLOCK, end, [&](const int* offsets, int length) {
+                        evaluate<M>(program, plan, inputs, types, offsets, length, r);
+                        for (int k = 0; k < result; k++) {
+                            std::fill(adjoints[k], adjoints[k] + length, 0.0f);
+                        }
+                        const float* seed = w_grad + offsets[0];
+                        int s = plan.strides[0][d - 1];
+                        for (int i = 0; i < length; i++) {
+                            adjoints[result][i] = seed[i * s];
+                        }
+                        for (int k = result; k >= 0; k--) {
+                            const Instruction& in = program.instructions[k];
+                            const float* dw = adjoints[k];
+                            const float* w = r[k];
+                            float* da = adjoints[in.a];
+                            float* db = adjoints[in.b];
+                            const float* a = r[in.a];
+                            const float* b = r[in.b];
+                            switch (in.code) {
+                                case Code::Load:
+                                    if (grads[in.a]) {
+                                        int g = n + 1 + in.a;
+                                        accumulate(grads[in.a] + offsets[g], plan.strides[g][d - 1], dw, length);
+                                    }
+                                    break;
+                                case Code::Add:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i];
+                                    for (int i = 0; i < length; i++) db[i] += dw[i];
+                                    break;
+                                case Code::Subtract:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i];
+                                    for (int i = 0; i < length; i++) db[i] -= dw[i];
+                                    break;
+                                case Code::Multiply:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] * b[i];
+                                    for (int i = 0; i < length; i++) db[i] += dw[i] * a[i];
+                                    break;
+                                case Code::Divide:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] * (1.0f / b[i]);
+                                    for (int i = 0; i < length; i++) db[i] += dw[i] * (-a[i] / (b[i] * b[i]));
+                                    break;
+                                case Code::Exp:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] * w[i];
+                                    break;
+                                case Code::Log:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] / a[i];
+                                    break;
+                                case Code::Relu:
+                                    for (int i = 0; i < length; i++) da[i] += w[i] > 0.0f ? dw[i] : 0.0f;
+                                    break;
+                                case Code::Sigmoid:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] * (w[i] * (1 - w[i]));
+                                    break;
+                                case Code::Tanh:
+                                    for (int i = 0; i < length; i++) da[i] += dw[i] * (1 - w[i] * w[i]);
+                                    break;
+                            }
+                        }
+                    });
+                });
+            }
+        }
+
+        int Program::ops() const {
+            int count = reduce ? 1 : 0;
+            for (int k = 0; k < size; k++) {
+                count += instructions[k].code != Code::Load;
+            }
+            return count;
+        }
+
+        Code code(BinaryOp op) {
+            switch (op) {
+                case BinaryOp::Add: return Code::Add;
+                case BinaryOp::Subtract: return Code::Subtract;
+                case BinaryOp::Multiply: return Code::Multiply;
+                case BinaryOp::Divide: return Code::Divide;
+            }
+            return Code::Add;
+        }
+
+        Code code(UnaryOp op) {
+            switch (op) {
+                case UnaryOp::Exp: return Code::Exp;
+                case UnaryOp::Log: return Code::Log;
+                case UnaryOp::Relu: return Code::Relu;
+                case UnaryOp::Sigmoid: return Code::Sigmoid;
+                case UnaryOp::Tanh: return Code::Tanh;
+            }
+            return Code::Exp;
+        }
+
+        void forward(
+            const Program& program, const BroadcastUtill::Plan& plan, float* w,
+            const void* const* inputs, const DType* types
+        ) {
+            assert(program.size > 0 && plan.operands == program.inputs + 1);
+            if (MathUtill::mode() == MathUtill::Mode::Fast) {
+                forward_kernel<MathUtill::Mode::Fast>(program, plan, w, inputs, types);
+            } else {
+                forward_kernel<MathUtill::Mode::Precise>(program, plan, w, inputs, types);
+            }
+        }
+
+        void backward(
+            const Program& program, const BroadcastUtill::Plan& plan,
+            const float* w_grad, const void* const* inputs, const DType* types, float* const* grads, bool parallel
+        ) {
+            assert(program.size > 0 && plan.operands == 2 * program.inputs + 1);
+            if (MathUtill::mode() == MathUtill::Mode::Fast) {
+                backward_kernel<MathUtill::Mode::Fast>(program, plan, w_grad, inputs, types, grads, parallel);
+            } else {
+                backward_kernel<MathUtill::Mode::Precise>(program, plan, w_grad, inputs, types, grads, parallel);
+            }
+        }
+    }
+}
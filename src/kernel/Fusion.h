@@ -0,0 +1,65 @@
+#ifndef REVGRAD_FUSION_H
+#define REVGRAD_FUSION_H
+
+#include "Broadcast.h"
+#include "Half.h"
+#include "../backend/Backend.h"
+
+namespace RevGrad {
+    namespace FusionUtill {
+        const int MAX_INPUTS = 7;
+        const int MAX_INSTRUCTIONS = 24;
+
+        enum class Code { Load, Add, Subtract, Multiply, Divide, Exp, Log, Relu, Sigmoid, Tanh };
+
+        /*
+            Load reads input a, the other codes read registers a (and b for binary codes).
+            Instruction k writes register k.
+        */
+        struct Instruction {
+            Code code = Code::Load;
+            int a = 0;
+            int b = 0;
+        };
+
+        /*
+            Chain of elementwise ops over broadcast inputs, evaluated in a single pass. The
+            result is the last register, summed over every element if reduce is set.
+        */
+        struct Program {
+            Instruction instructions[MAX_INSTRUCTIONS];
+            int size = 0;
+            int inputs = 0;
+            bool reduce = false;
+            /*
+                @return number of ops the program stands for, reduction included
+            */
+            int ops() const;
+        };
+
+        Code code(BinaryOp op);
+        Code code(UnaryOp op);
+
+        /*
+            Evaluates program with plan operands (w, inputs...). w has the shape of the plan,
+            or is a single element holding the sum if program.reduce. Input i holds elements
+            of types[i], converted to float as they are loaded.
+        */
+        void forward(
+            const Program& program, const BroadcastUtill::Plan& plan, float* w,
+            const void* const* inputs, const DType* types
+        );
+        /*
+            Accumulates the gradients of the inputs with plan operands (w_grad, inputs...,
+            grads...), recomputing the registers on the fly. Inputs with a null gradient
+            are skipped. Threads are only used if parallel, which requires that no two
+            elements of the output write the same gradient element.
+        */
+        void backward(
+            const Program& program, const BroadcastUtill::Plan& plan,
+            const float* w_grad, const void* const* inputs, const DType* types, float* const* grads, bool parallel
+        );
+    }
+}
+
+#endif
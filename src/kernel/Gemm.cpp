@@ -0,0 +1,450 @@
+#include "Gemm.h"
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REVGRAD_GEMM_X86
+#endif
+
+namespace RevGrad {
+    namespace GemmUtill {
+        namespace {
+            const int KC = 256; // depth of a packed block, keeps a micro-panel of B in L1
+            const int MC_PANELS = 16; // micro-panels of A per packed block, sized for L2
+            const int NC = 2048; // columns of a packed block of B, sized for L3
+            const long long PARALLEL_THRESHOLD = 1 << 18; // m * n * k
+            const long long SMALL_THRESHOLD = 1 << 12; // m * n * k below which nothing is packed
+            const int DIRECT_B_PANELS = 4; // below this many row panels B is read in place instead of packed
+
+            /*
+                C[mr, nr] += alpha * A[mr, kc] * B[kc, nr] with A packed as kc columns of mr
+                values and B given as kc rows of nr values, ldb apart
+            */
+            typedef void (*MicroKernel)(int kc, const float* a, const float* b, int ldb, float* c, int ldc, float alpha);
+
+            struct Kernel {
+                const char* name;
+                int mr;
+                int nr;
+                MicroKernel fn;
+            };
+
+            template <int MR, int NR>
+            void kernel_generic(int kc, const float* a, const float* b, int ldb, float* c, int ldc, float alpha) {
+                float acc[MR][NR] = {};
+                for (int p = 0; p < kc; p++) {
+                    #pragma GCC unroll 8
+                    for (int i = 0; i < MR; i++) {
+                        #pragma omp simd
+                        for (int j = 0; j < NR; j++) {
+                            acc[i][j] += a[i] * b[j];
+                        }
+                    }
+                    a += MR;
+                    b += ldb;
+                }
+                for (int i = 0; i < MR; i++) {
+                    for (int j = 0; j < NR; j++) {
+                        c[i * ldc + j] += alpha * acc[i][j];
+                    }
+                }
+            }
+
+#ifdef REVGRAD_GEMM_X86
+            __attribute__((target("avx2,fma")))
+            void kernel_avx2(int kc, const float* a, const float* b, int ldb, float* c, int ldc, float alpha) {
+                const int MR = 6;
+                __m256 acc[MR][2];
+                #pragma GCC unroll 6
+                for (int i = 0; i < MR; i++) {
+                    acc[i][0] = _mm256_setzero_ps();
+                    acc[i][1] = _mm256_setzero_ps();
+                }
+                for (int p = 0; p < kc; p++) {
+                    __m256 b0 = _mm256_loadu_ps(b);
+                    __m256 b1 = _mm256_loadu_ps(b + 8);
+                    #pragma GCC unroll 6
+                    for (int i = 0; i < MR; i++) {
+                        __m256 ai = _mm256_broadcast_ss(a + i);
+                        acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+                        acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+                    }
+                    a += MR;
+                    b += ldb;
+                }
+                __m256 alpha_v = _mm256_set1_ps(alpha);
+                #pragma GCC unroll 6
+                for (int i = 0; i < MR; i++) {
+                    float* ci = c + i * ldc;
+                    _mm256_storeu_ps(ci, _mm256_fmadd_ps(alpha_v, acc[i][0], _mm256_loadu_ps(ci)));
+                    _mm256_storeu_ps(ci + 8, _mm256_fmadd_ps(alpha_v, acc[i][1], _mm256_loadu_ps(ci + 8)));
+                }
+            }
+
+            __attribute__((target("avx512f")))
+            void kernel_avx512(int kc, const float* a, const float* b, int ldb, float* c, int ldc, float alpha) {
+                const int MR = 6;
+                __m512 acc[MR][2];
+                #pragma GCC unroll 6
+                for (int i = 0; i < MR; i++) {
+                    acc[i][0] = _mm512_setzero_ps();
+                    acc[i][1] = _mm512_setzero_ps();
+                }
+                for (int p = 0; p < kc; p++) {
+                    __m512 b0 = _mm512_loadu_ps(b);
+                    __m512 b1 = _mm512_loadu_ps(b + 16);
+                    #pragma GCC unroll 6
+                    for (int i = 0; i < MR; i++) {
+                        __m512 ai = _mm512_set1_ps(a[i]);
+                        acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+                        acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+                    }
+                    a += MR;
+                    b += ldb;
+                }
+                __m512 alpha_v = _mm512_set1_ps(alpha);
+                #pragma GCC unroll 6
+                for (int i = 0; i < MR; i++) {
+                    float* ci = c + i * ldc;
+                    _mm512_storeu_ps(ci, _mm512_fmadd_ps(alpha_v, acc[i][0], _mm512_loadu_ps(ci)));
+                    _mm512_storeu_ps(ci + 16, _mm512_fmadd_ps(alpha_v, acc[i][1], _mm512_loadu_ps(ci + 16)));
+                }
+            }
+#endif
+
+            const Kernel GENERIC = {"generic", 4, 16, kernel_generic<4, 16>};
+#ifdef REVGRAD_GEMM_X86
+            const Kernel AVX2 = {"avx2", 6, 16, kernel_avx2};
+            const Kernel AVX512 = {"avx512", 6, 32, kernel_avx512};
+#endif
+
+            /*
+                Picks the widest microkernel the CPU supports. REVGRAD_GEMM_KERNEL=generic|avx2|avx512
+                forces a kernel, which is used to validate the fallbacks on wide machines.
+            */
+            Kernel detect_kernel() {
+                const char* forced = std::getenv("REVGRAD_GEMM_KERNEL");
+                std::string name = forced ? forced : "";
+                if (name == "generic") {
+                    return GENERIC;
+                }
+#ifdef REVGRAD_GEMM_X86
+                __builtin_cpu_init();
+                bool has_avx512 = __builtin_cpu_supports("avx512f");
+                bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+                if (has_avx512 && (name.empty() || name == "avx512")) {
+                    return AVX512;
+                }
+                if (has_avx2 && (name.empty() || name == "avx2" || name == "avx512")) {
+                    return AVX2;
+                }
+#endif
+                return GENERIC;
+            }
+
+            const Kernel& kernel() {
+                static const Kernel kernel = detect_kernel();
+                return kernel;
+            }
+
+            /*
+                Element i of an operand, half operands (see DType) are widened as they are read
+            */
+            inline float element(const float* u, long long i, DType) {
+                return u[i];
+            }
+
+            inline float element(const Half* u, long long i, DType type) {
+                return HalfUtill::to_float(type, u[i]);
+            }
+
+            inline void copy_row(const float* u, float* w, int n, DType) {
+                std::memcpy(w, u, n * sizeof(float));
+            }
+
+            inline void copy_row(const Half* u, float* w, int n, DType type) {
+                HalfUtill::to_float(type, u, w, n);
+            }
+
+            /*
+                Packs the (mc, kc) block of op(A) at (i0, p0) into micro-panels of mr rows,
+                zero padding the last panel
+            */
+            template <typename T>
+            void pack_a(bool trans, const T* a, DType type, int lda, int i0, int p0, int mc, int kc, int mr, float* dst) {
+                for (int ir = 0; ir < mc; ir += mr) {
+                    int rows = std::min(mr, mc - ir);
+                    for (int p = 0; p < kc; p++) {
+                        for (int r = 0; r < rows; r++) {
+                            int i = i0 + ir + r;
+                            dst[r] = element(a, trans ? (long long)(p0 + p) * lda + i : (long long)i * lda + p0 + p, type);
+                        }
+                        for (int r = rows; r < mr; r++) {
+                            dst[r] = 0.0f;
+                        }
+                        dst += mr;
+                    }
+                }
+            }
+
+            /*
+                Packs the (kc, nc) block of op(B) at (p0, j0) into micro-panels of nr columns,
+                zero padding the last panel
+            */
+            template <typename T>
+            void pack_b(bool trans, const T* b, DType type, int ldb, int p0, int j0, int kc, int nc, int nr, float* dst) {
+                for (int jr = 0; jr < nc; jr += nr) {
+                    int cols = std::min(nr, nc - jr);
+                    for (int p = 0; p < kc; p++) {
+                        if (!trans && cols == nr) {
+                            copy_row(b + (long long)(p0 + p) * ldb + j0 + jr, dst, nr, type);
+                        } else {
+                            for (int c = 0; c < cols; c++) {
+                                int j = j0 + jr + c;
+                                dst[c] = element(b, trans ? (long long)j * ldb + p0 + p : (long long)(p0 + p) * ldb + j, type);
+                            }
+                            for (int c = cols; c < nr; c++) {
+                                dst[c] = 0.0f;
+                            }
+                        }
+                        dst += nr;
+                    }
+                }
+            }
+
+            void scale(float* c, int ldc, int i0, int i1, int j0, int j1, float beta) {
+                if (beta == 1.0f) {
+                    return;
+                }
+                for (int i = i0; i < i1; i++) {
+                    float* ci = c + (long long)i * ldc;
+                    for (int j = j0; j < j1; j++) {
+                        ci[j] = beta == 0.0f ? 0.0f : beta * ci[j];
+                    }
+                }
+            }
+
+            /*
+                Computes the rows [i0, i1) and columns [j0, j1) of C with thread private packing
+                buffers, applying epilogue to each (mc, nc) block after its last depth block
+            */
+            template <typename TA, typename TB>
+            void gemm_block(
+                bool trans_a, bool trans_b, int k, float alpha,
+                const TA* a, DType a_type, int lda, const TB* b, DType b_type, int ldb, float* c, int ldc,
+                int i0, int i1, int j0, int j1, const Epilogue& epilogue
+            ) {
+                const Kernel& kr = kernel();
+                int mr = kr.mr, nr = kr.nr, mc_max = MC_PANELS * mr;
+                thread_local std::vector<float> a_pack, b_pack;
+                a_pack.resize((size_t)mc_max * KC);
+                b_pack.resize((size_t)KC * (NC + nr));
+                float tile[6 * 32];
+                // With few rows of A a packed panel of B is reused too little to pay for
+                // packing, so full panels of a non-transposed float B are streamed in place.
+                bool direct_b = std::is_same<TB, float>::value && !trans_b && i1 - i0 <= DIRECT_B_PANELS * mr;
+                for (int jc = j0; jc < j1; jc += NC) {
+                    int nc = std::min(NC, j1 - jc);
+                    for (int pc = 0; pc < k; pc += KC) {
+                        int kc = std::min(KC, k - pc);
+                        int packed_from = direct_b ? nc / nr * nr : 0;
+                        pack_b(trans_b, b, b_type, ldb, pc, jc + packed_from, kc, nc - packed_from, nr, b_pack.data());
+                        for (int ic = i0; ic < i1; ic += mc_max) {
+                            int mc = std::min(mc_max, i1 - ic);
+                            pack_a(trans_a, a, a_type, lda, ic, pc, mc, kc, mr, a_pack.data());
+                            for (int jr = 0; jr < nc; jr += nr) {
+                                int cols = std::min(nr, nc - jr);
+                                const float* bp = b_pack.data() + (size_t)(jr - packed_from) * kc;
+                                int bs = nr;
+                                if constexpr (std::is_same<TB, float>::value) {
+                                    if (jr < packed_from) {
+                                        bp = b + (long long)pc * ldb + jc + jr;
+                                        bs = ldb;
+                                    }
+                                }
+                                for (int ir = 0; ir < mc; ir += mr) {
+                                    int rows = std::min(mr, mc - ir);
+                                    const float* ap = a_pack.data() + (size_t)ir * kc;
+                                    float* cp = c + (long long)(ic + ir) * ldc + jc + jr;
+                                    if (rows == mr && cols == nr) {
+                                        kr.fn(kc, ap, bp, bs, cp, ldc, alpha);
+                                        continue;
+                                    }
+                                    std::fill(tile, tile + mr * nr, 0.0f);
+                                    kr.fn(kc, ap, bp, bs, tile, nr, alpha);
+                                    for (int i = 0; i < rows; i++) {
+                                        for (int j = 0; j < cols; j++) {
+                                            cp[(long long)i * ldc + j] += tile[i * nr + j];
+                                        }
+                                    }
+                                }
+                            }
+                            if (epilogue && pc + kc >= k) {
+                                epilogue(c, ldc, ic, ic + mc, jc, jc + nc);
+                            }
+                        }
+                    }
+                }
+            }
+
+            /*
+                C += alpha * op(A) * op(B) without packing or blocking, for products so small
+                that setting up the blocked path costs more than the arithmetic
+            */
+            template <typename TA, typename TB>
+            void gemm_small(
+                bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+                const TA* a, DType a_type, int lda, const TB* b, DType b_type, int ldb, float* c, int ldc
+            ) {
+                for (int i = 0; i < m; i++) {
+                    float* ci = c + (long long)i * ldc;
+                    if (trans_b || n < 16) {
+                        // C[i, j] as a dot product: rows of B^T are contiguous, and narrow
+                        // rows of C are too short for a vector loop over j
+                        for (int j = 0; j < n; j++) {
+                            float sum = 0.0f;
+                            for (int p = 0; p < k; p++) {
+                                float aip = element(a, trans_a ? (long long)p * lda + i : (long long)i * lda + p, a_type);
+                                sum += aip * element(b, trans_b ? (long long)j * ldb + p : (long long)p * ldb + j, b_type);
+                            }
+                            ci[j] += alpha * sum;
+                        }
+                        continue;
+                    }
+                    for (int p = 0; p < k; p++) {
+                        float aip = alpha * element(a, trans_a ? (long long)p * lda + i : (long long)i * lda + p, a_type);
+                        const TB* bp = b + (long long)p * ldb;
+                        #pragma omp simd
+                        for (int j = 0; j < n; j++) {
+                            ci[j] += aip * element(bp, j, b_type);
+                        }
+                    }
+                }
+            }
+
+            /*
+                Splits threads into a (tm, tn) grid over the micro-tiles of C so that both
+                tall and wide (skinny) outputs give every thread a similar share
+            */
+            void partition(int m, int n, int mr, int nr, int threads, int& tm, int& tn) {
+                long long m_tiles = (m + mr - 1) / mr;
+                long long n_tiles = (n + nr - 1) / nr;
+                threads = (int)std::max(1LL, std::min((long long)threads, m_tiles * n_tiles));
+                long long best = -1;
+                for (int i = 1; i <= threads; i++) {
+                    if (threads % i) {
+                        continue;
+                    }
+                    int j = threads / i;
+                    long long cost = ((m_tiles + i - 1) / i) * mr * ((n_tiles + j - 1) / j) * nr;
+                    if (best < 0 || cost < best) {
+                        best = cost, tm = i, tn = j;
+                    }
+                }
+            }
+
+            /*
+                gemm over operands stored as TA and TB, float or Half
+            */
+            template <typename TA, typename TB>
+            void gemm_typed(
+                bool trans_a, bool trans_b, int m, int n, int k,
+                float alpha, const TA* a, DType a_type, int lda, const TB* b, DType b_type, int ldb,
+                float beta, float* c, int ldc, const Epilogue& epilogue
+            ) {
+                if (m <= 0 || n <= 0) {
+                    return;
+                }
+                if ((long long)m * n * k <= SMALL_THRESHOLD) {
+                    scale(c, ldc, 0, m, 0, n, beta);
+                    if (k > 0 && alpha != 0.0f) {
+                        gemm_small(trans_a, trans_b, m, n, k, alpha, a, a_type, lda, b, b_type, ldb, c, ldc);
+                    }
+                    if (epilogue) {
+                        epilogue(c, ldc, 0, m, 0, n);
+                    }
+                    return;
+                }
+                const Kernel& kr = kernel();
+                // inside a parallel region, e.g. the parallel backward, a nested team has one thread
+                int threads = (long long)m * n * k >= PARALLEL_THRESHOLD && !omp_in_parallel() ? omp_get_max_threads() : 1;
+                int tm = 1, tn = 1;
+                partition(m, n, kr.mr, kr.nr, threads, tm, tn);
+                int m_tiles = (m + kr.mr - 1) / kr.mr;
+                int n_tiles = (n + kr.nr - 1) / kr.nr;
+                auto thread_block = [&](int t) {
+                    int ti = t / tn, tj = t % tn;
+                    int i0 = std::min(m, (int)((long long)m_tiles * ti / tm) * kr.mr);
+                    int i1 = std::min(m, (int)((long long)m_tiles * (ti + 1) / tm) * kr.mr);
+                    int j0 = std::min(n, (int)((long long)n_tiles * tj / tn) * kr.nr);
+                    int j1 = std::min(n, (int)((long long)n_tiles * (tj + 1) / tn) * kr.nr);
+                    if (i0 < i1 && j0 < j1) {
+                        scale(c, ldc, i0, i1, j0, j1, beta);
+                        if (k > 0 && alpha != 0.0f) {
+                            gemm_block(trans_a, trans_b, k, alpha, a, a_type, lda, b, b_type, ldb, c, ldc, i0, i1, j0, j1, epilogue);
+                        } else if (epilogue) {
+                            epilogue(c, ldc, i0, i1, j0, j1);
+                        }
+                    }
+                };
+                // a parallel region costs more than a small product, even with a false if clause
+                if (tm * tn == 1) {
+                    thread_block(0);
+                    return;
+                }
+                // the team may be smaller than asked for, so threads loop over the blocks
+                #pragma omp parallel num_threads(tm * tn)
+                for (int t = omp_get_thread_num(); t < tm * tn; t += omp_get_num_threads()) {
+                    thread_block(t);
+                }
+            }
+        }
+
+        void sgemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc
+        ) {
+            sgemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, Epilogue());
+        }
+
+        void sgemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc, const Epilogue& epilogue
+        ) {
+            gemm_typed(trans_a, trans_b, m, n, k, alpha, a, DType::Float32, lda, b, DType::Float32, ldb, beta, c, ldc, epilogue);
+        }
+
+        void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            float beta, float* c, int ldc, const Epilogue& epilogue
+        ) {
+            const float* a_float = static_cast<const float*>(a);
+            const float* b_float = static_cast<const float*>(b);
+            const Half* a_half = static_cast<const Half*>(a);
+            const Half* b_half = static_cast<const Half*>(b);
+            if (a_type == DType::Float32 && b_type == DType::Float32) {
+                gemm_typed(trans_a, trans_b, m, n, k, alpha, a_float, a_type, lda, b_float, b_type, ldb, beta, c, ldc, epilogue);
+            } else if (a_type == DType::Float32) {
+                gemm_typed(trans_a, trans_b, m, n, k, alpha, a_float, a_type, lda, b_half, b_type, ldb, beta, c, ldc, epilogue);
+            } else if (b_type == DType::Float32) {
+                gemm_typed(trans_a, trans_b, m, n, k, alpha, a_half, a_type, lda, b_float, b_type, ldb, beta, c, ldc, epilogue);
+            } else {
+                gemm_typed(trans_a, trans_b, m, n, k, alpha, a_half, a_type, lda, b_half, b_type, ldb, beta, c, ldc, epilogue);
+            }
+        }
+
+        const char* kernel_name() {
+            return kernel().name;
+        }
+    }
+}
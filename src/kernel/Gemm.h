@@ -0,0 +1,55 @@
+#ifndef REVGRAD_GEMM_H
+#define REVGRAD_GEMM_H
+
+#include <functional>
+
+#include "Half.h"
+
+namespace RevGrad {
+    namespace GemmUtill {
+        /*
+            Called as fn(c, ldc, i0, i1, j0, j1) on every block of rows [i0, i1) and columns
+            [j0, j1) of C once it holds its final product, while the block is still in cache.
+            Blocks do not overlap and may be visited by several threads at once.
+        */
+        typedef std::function<void(float* c, int ldc, int i0, int i1, int j0, int j1)> Epilogue;
+
+        /*
+            C = alpha * op(A) * op(B) + beta * C for row-major matrices, where op(X) is X
+            or X^T depending on trans_x. op(A) is (m, k), op(B) is (k, n) and C is (m, n).
+            Operands are packed into cache blocks and multiplied by a register-tiled
+            microkernel picked at runtime (AVX-512, AVX2 or a portable fallback).
+        */
+        void sgemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc
+        );
+
+        /*
+            sgemm followed by epilogue on every block of C, e.g. a bias and an activation
+        */
+        void sgemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const float* a, int lda, const float* b, int ldb,
+            float beta, float* c, int ldc, const Epilogue& epilogue
+        );
+
+        /*
+            sgemm over operands stored as a_type and b_type, half operands are converted to
+            float while they are packed, so they take no float copy of their own
+        */
+        void gemm(
+            bool trans_a, bool trans_b, int m, int n, int k,
+            float alpha, const void* a, DType a_type, int lda, const void* b, DType b_type, int ldb,
+            float beta, float* c, int ldc, const Epilogue& epilogue = Epilogue()
+        );
+
+        /*
+            @return name of the microkernel used by sgemm on this machine
+        */
+        const char* kernel_name();
+    }
+}
+
+#endif
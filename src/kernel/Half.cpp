@@ -0,0 +1,129 @@
+#include "Half.h"
+
+#if defined(__AVX512F__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace RevGrad {
+    namespace HalfUtill {
+        namespace {
+            void fp16_to_float(const Half* u, float* w, int n) {
+                int i = 0;
+#if defined(__AVX512F__)
+                for (; i + 16 <= n; i += 16) {
+                    __m256i h = _mm256_loadu_si256((const __m256i*)(u + i));
+                    _mm512_storeu_ps(w + i, _mm512_cvtph_ps(h));
+                }
+#elif defined(__F16C__)
+                for (; i + 8 <= n; i += 8) {
+                    __m128i h = _mm_loadu_si128((const __m128i*)(u + i));
+                    _mm256_storeu_ps(w + i, _mm256_cvtph_ps(h));
+                }
+#endif
+                for (; i < n; i++) {
+                    w[i] = HalfUtill::fp16_to_float(u[i]);
+                }
+            }
+
+            void float_to_fp16(const float* u, Half* w, int n) {
+                int i = 0;
+#if defined(__AVX512F__)
+                for (; i + 16 <= n; i += 16) {
+                    __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(u + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                    _mm256_storeu_si256((__m256i*)(w + i), h);
+                }
+#elif defined(__F16C__)
+                for (; i + 8 <= n; i += 8) {
+                    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(u + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                    _mm_storeu_si128((__m128i*)(w + i), h);
+                }
+#endif
+                for (; i < n; i++) {
+                    w[i] = HalfUtill::float_to_fp16(u[i]);
+                }
+            }
+
+            void bf16_to_float(const Half* u, float* w, int n) {
+                // a shift, which the compiler vectorizes on its own
+                #pragma omp simd
+                for (int i = 0; i < n; i++) {
+                    w[i] = HalfUtill::bf16_to_float(u[i]);
+                }
+            }
+
+            void float_to_bf16(const float* u, Half* w, int n) {
+                int i = 0;
+#if defined(__AVX512BF16__)
+                for (; i + 16 <= n; i += 16) {
+                    __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(u + i));
+                    std::memcpy(w + i, &h, sizeof(h));
+                }
+#endif
+                #pragma omp simd
+                for (int j = i; j < n; j++) {
+                    w[j] = HalfUtill::float_to_bf16(u[j]);
+                }
+            }
+
+            inline float load(DType type, const void* u, int i) {
+                if (type == DType::Float32) {
+                    return static_cast<const float*>(u)[i];
+                }
+                return to_float(type, static_cast<const Half*>(u)[i]);
+            }
+
+            inline void store(DType type, void* w, int i, float value) {
+                if (type == DType::Float32) {
+                    static_cast<float*>(w)[i] = value;
+                } else {
+                    static_cast<Half*>(w)[i] = from_float(type, value);
+                }
+            }
+        }
+
+        int size_of(DType type) {
+            return type == DType::Float32 ? sizeof(float) : sizeof(Half);
+        }
+
+        void to_float(DType type, const Half* u, float* w, int n) {
+            if (type == DType::BFloat16) {
+                bf16_to_float(u, w, n);
+            } else {
+                fp16_to_float(u, w, n);
+            }
+        }
+
+        void from_float(DType type, const float* u, Half* w, int n) {
+            if (type == DType::BFloat16) {
+                float_to_bf16(u, w, n);
+            } else {
+                float_to_fp16(u, w, n);
+            }
+        }
+
+        void convert(const BroadcastUtill::Plan& plan, void* w, DType w_type, const void* u, DType u_type) {
+            int d = plan.shape.size();
+            int sw = plan.strides[0][d - 1];
+            int su = plan.strides[1][d - 1];
+            int w_size = size_of(w_type), u_size = size_of(u_type);
+            BroadcastUtill::for_each_line<2>(plan, [&](const int* offsets, int begin, int end) {
+                char* wp = static_cast<char*>(w) + (long long)(offsets[0] + begin * sw) * w_size;
+                const char* up = static_cast<const char*>(u) + (long long)(offsets[1] + begin * su) * u_size;
+                int n = end - begin;
+                if (sw == 1 && su == 1 && (w_type == u_type || u_type == DType::Float32 || w_type == DType::Float32)) {
+                    if (w_type == u_type) {
+                        std::memcpy(wp, up, (size_t)n * w_size);
+                    } else if (w_type == DType::Float32) {
+                        to_float(u_type, (const Half*)up, (float*)wp, n);
+                    } else {
+                        from_float(w_type, (const float*)up, (Half*)wp, n);
+                    }
+                    return;
+                }
+                for (int i = 0; i < n; i++) {
+                    store(w_type, wp, i * sw, load(u_type, up, i * su));
+                }
+            });
+        }
+    }
+}
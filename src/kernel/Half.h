@@ -0,0 +1,119 @@
+#ifndef REVGRAD_HALF_H
+#define REVGRAD_HALF_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "Broadcast.h"
+
+namespace RevGrad {
+    /*
+        Element type of a tensor storage. BFloat16 keeps the range of float with 8 bits of
+        precision, Float16 (IEEE half) has 11 bits but overflows past 65504. Both take half
+        the memory and bandwidth of float, arithmetic is always done in float, and only 
+        leaves are stored in them (see Tensor::dtype).
+    */
+    enum class DType { Float32, BFloat16, Float16 };
+
+    typedef uint16_t Half; // bits of a BFloat16 or Float16 element
+
+    namespace HalfUtill {
+        namespace detail {
+            inline float as_float(uint32_t i) {
+                float f;
+                std::memcpy(&f, &i, sizeof(f));
+                return f;
+            }
+
+            inline uint32_t as_int(float f) {
+                uint32_t i;
+                std::memcpy(&i, &f, sizeof(i));
+                return i;
+            }
+        }
+
+        inline float bf16_to_float(Half h) {
+            return detail::as_float((uint32_t)h << 16);
+        }
+
+        /*
+            Rounds to nearest even, nan stays a (quiet) nan. Subnormals become zeros of the
+            same sign, as in the AVX512-BF16 conversion, so both paths give the same bits.
+        */
+        inline Half float_to_bf16(float f) {
+            uint32_t x = detail::as_int(f);
+            if ((x & 0x7f800000) == 0) {
+                return (x >> 16) & 0x8000;
+            }
+            if ((x & 0x7fffffff) > 0x7f800000) {
+                return (x >> 16) | 0x40;
+            }
+            return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+        }
+
+        inline float fp16_to_float(Half h) {
+            uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+            uint32_t exponent = (h >> 10) & 0x1f;
+            uint32_t mantissa = h & 0x3ff;
+            if (exponent == 0) {
+                // zero or subnormal, mantissa * 2^-24
+                float value = mantissa * 5.9604644775390625e-8f;
+                return sign ? -value : value;
+            }
+            if (exponent == 31) {
+                return detail::as_float(sign | 0x7f800000 | (mantissa << 13));
+            }
+            return detail::as_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+        }
+
+        /*
+            Rounds to nearest even, values past the half range become infinities
+        */
+        inline Half float_to_fp16(float f) {
+            uint32_t x = detail::as_int(f);
+            uint32_t sign = (x >> 16) & 0x8000;
+            x &= 0x7fffffff;
+            if (x >= 0x47800000) {
+                // 2^16 and above, infinity and nan
+                return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+            }
+            if (x < 0x38800000) {
+                // below 2^-14 the result is subnormal: adding 0.5 aligns its mantissa bits
+                // to the bottom of the float, rounded by the float addition
+                return sign | (detail::as_int(detail::as_float(x) + 0.5f) - 0x3f000000);
+            }
+            uint32_t odd = (x >> 13) & 1;
+            // rebias the exponent from 127 to 15 and round the 13 dropped bits
+            x += 0xc8000fffu + odd;
+            return sign | (x >> 13);
+        }
+
+        inline float to_float(DType type, Half h) {
+            return type == DType::BFloat16 ? bf16_to_float(h) : fp16_to_float(h);
+        }
+
+        inline Half from_float(DType type, float f) {
+            return type == DType::BFloat16 ? float_to_bf16(f) : float_to_fp16(f);
+        }
+
+        /*
+            @return bytes per element
+        */
+        int size_of(DType type);
+
+        /*
+            Converts n contiguous elements of a half type, with AVX-512 (BF16) or F16C
+            instructions when the build targets them
+        */
+        void to_float(DType type, const Half* u, float* w, int n);
+        void from_float(DType type, const float* u, Half* w, int n);
+
+        /*
+            w = u with plan operands (w, u), converting between the element types of the
+            buffers. Float32 buffers are float arrays, the others Half arrays.
+        */
+        void convert(const BroadcastUtill::Plan& plan, void* w, DType w_type, const void* u, DType u_type);
+    }
+}
+
+#endif
@@ -0,0 +1,31 @@
+#include "Math.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+namespace RevGrad {
+    namespace MathUtill {
+        namespace {
+            Mode& current() {
+                static Mode mode = [] {
+                    const char* name = std::getenv("REVGRAD_MATH");
+                    if (name == nullptr || std::string(name) == "precise") {
+                        return Mode::Precise;
+                    }
+                    assert(std::string(name) == "fast");
+                    return Mode::Fast;
+                }();
+                return mode;
+            }
+        }
+
+        Mode mode() {
+            return current();
+        }
+
+        void set_mode(Mode mode) {
+            current() = mode;
+        }
+    }
+}
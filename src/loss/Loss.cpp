@@ -1,6 +1,12 @@
 #include "Loss.h"
 
 namespace RevGrad {
+    namespace {
+        int class_axis(Layout layout) {
+            return layout == Layout::BatchFirst ? 1 : 0;
+        }
+    }
+
     Tensor Loss::operator()(Tensor prediction, Tensor correct) {
         return compute(prediction, correct);
     }
@@ -9,19 +15,25 @@ namespace RevGrad {
         int n = correct.size();
         assert(prediction.size() == n);
 
-        prediction.flatten();
-        correct.flatten();
+        prediction = prediction.flatten();
+        correct = correct.flatten();
         
+        // one pass over the inputs in the forward and one in the backward
+        LazyGuard lazy;
         return Tensor::sum((prediction - correct) * (prediction - correct)) / (2.0f * n);
     }
 
+    Tensor SoftmaxCrossEntropyLoss::compute(Tensor prediction, Tensor correct) {
+        return Tensor::softmax_cross_entropy(prediction, correct, class_axis(layout));
+    }
+
     Tensor CrossEntropyLoss::compute(Tensor prediction, Tensor correct) {
         assert(prediction.shape() == correct.shape());
-        return -Tensor::mean(Tensor::sum(correct * Tensor::log(prediction), 0));
+        return -Tensor::mean(Tensor::sum(correct * Tensor::log(prediction), class_axis(layout)));
     }
 
     Tensor NLLLoss::compute(Tensor prediction, Tensor correct) {
         assert(prediction.shape() == correct.shape());
-        return -Tensor::mean(Tensor::sum(correct * prediction, 0));
+        return -Tensor::mean(Tensor::sum(correct * prediction, class_axis(layout)));
     }
 }
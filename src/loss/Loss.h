@@ -17,21 +17,31 @@ namespace RevGrad {
         Tensor compute(Tensor prediction, Tensor correct) override;
     };
 
+    /*
+        Takes logits of shape (classes, batch size), or (batch size, classes) for BatchFirst,
+        and the class index of every sample
+    */
     class SoftmaxCrossEntropyLoss : public Loss {
     public:
-        SoftmaxCrossEntropyLoss() {}
+        Layout layout;
+        SoftmaxCrossEntropyLoss(Layout layout = Layout::FeaturesFirst) : layout(layout) {}
         Tensor compute(Tensor prediction, Tensor correct) override;
     };
 
+    /*
+        Prediction and correct share the layout, classes along the feature axis
+    */
     class CrossEntropyLoss : public Loss {
     public:
-        CrossEntropyLoss() {}
+        Layout layout;
+        CrossEntropyLoss(Layout layout = Layout::FeaturesFirst) : layout(layout) {}
         Tensor compute(Tensor prediction, Tensor correct) override;
     };
 
     class NLLLoss : public Loss { // negative log likelihood loss
     public:
-        NLLLoss() {}
+        Layout layout;
+        NLLLoss(Layout layout = Layout::FeaturesFirst) : layout(layout) {}
         Tensor compute(Tensor prediction, Tensor correct) override;
     };
 }
@@ -0,0 +1,333 @@
+#include "Allocator.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <new>
+
+namespace RevGrad {
+    namespace AllocatorUtill {
+        namespace {
+            const int BUFFER_CLASSES = 4 + 4 * 40; // size classes up to 2^48 bytes
+            const size_t THREAD_CACHE_LIMIT = 1 << 20; // larger buffers skip the thread caches
+            const int THREAD_CACHE_BUFFERS = 32; // buffers a thread keeps per class
+            const size_t OBJECT_GRANULE = 16;
+            const int OBJECT_CLASSES = 64; // objects up to 1 KB, larger ones use the heap directly
+            const int THREAD_CACHE_OBJECTS = 256;
+
+            /*
+                Read by every allocation, also from threads of the parallel backward
+            */
+            std::atomic<Mode>& current() {
+                static std::atomic<Mode> mode([] {
+                    const char* name = std::getenv("REVGRAD_ALLOCATOR");
+                    if (name == nullptr || std::string(name) == "caching") {
+                        return Mode::Caching;
+                    }
+                    assert(std::string(name) == "system");
+                    return Mode::System;
+                }());
+                return mode;
+            }
+
+            /*
+                @return index of size, a size class, in the free list arrays
+            */
+            int buffer_class(size_t size) {
+                if (size <= 4 * ALIGNMENT) {
+                    return size / ALIGNMENT - 1;
+                }
+                // power < size <= 2 * power, split into four classes of power / 4
+                int k = 63 - __builtin_clzll(size - 1);
+                size_t power = size_t(1) << k;
+                int index = 4 + (k - 8) * 4 + (int)((size - power) / (power / 4)) - 1;
+                assert(index < BUFFER_CLASSES);
+                return index;
+            }
+
+            /*
+                @return size class with index k, the inverse of buffer_class
+            */
+            size_t class_size(int k) {
+                if (k < 4) {
+                    return (k + 1) * ALIGNMENT;
+                }
+                size_t power = (4 * ALIGNMENT) << ((k - 4) / 4);
+                return power + ((k - 4) % 4 + 1) * (power / 4);
+            }
+
+            /*
+                Lock of a thread cache, whose owner takes it on every call and other threads
+                only in empty_cache, so it is practically never waited on. Releasing it is a
+                plain store, unlike a mutex.
+            */
+            class CacheLock {
+                std::atomic<bool> locked{false};
+            public:
+                void lock() {
+                    while (locked.exchange(true, std::memory_order_acquire)) {}
+                }
+                void unlock() {
+                    locked.store(false, std::memory_order_release);
+                }
+            };
+
+            struct FreeList {
+                std::mutex mutex;
+                std::vector<void*> items;
+            };
+
+            /*
+                Free lists and counters of one thread, searched before the shared lists. Only
+                the owner writes the counters, stats() sums them over all threads.
+            */
+            struct ThreadCache {
+                CacheLock mutex;
+                std::vector<void*> buffers[BUFFER_CLASSES];
+                std::vector<void*> objects[OBJECT_CLASSES];
+                std::atomic<long long> allocations{0}, reuse_hits{0};
+                ThreadCache();
+                ~ThreadCache();
+            };
+
+            struct Pool {
+                FreeList buffers[BUFFER_CLASSES];
+                FreeList objects[OBJECT_CLASSES];
+                std::mutex registry_mutex;
+                std::vector<ThreadCache*> caches;
+                std::atomic<long long> reserved{0}, in_use{0}, peak{0};
+                long long allocations = 0, reuse_hits = 0; // of finished threads, under registry_mutex
+            };
+
+            /*
+                Never destroyed, buffers of static tensors are freed after main returns
+            */
+            Pool& pool() {
+                static Pool* pool = new Pool();
+                return *pool;
+            }
+
+            ThreadCache::ThreadCache() {
+                Pool& p = pool();
+                std::lock_guard<std::mutex> lock(p.registry_mutex);
+                p.caches.push_back(this);
+            }
+
+            /*
+                A finished thread hands what it cached to the shared free lists
+            */
+            ThreadCache::~ThreadCache() {
+                Pool& p = pool();
+                std::lock_guard<std::mutex> lock(p.registry_mutex);
+                p.caches.erase(std::find(p.caches.begin(), p.caches.end(), this));
+                p.allocations += allocations.load();
+                p.reuse_hits += reuse_hits.load();
+                for (int k = 0; k < BUFFER_CLASSES; k++) {
+                    std::lock_guard<std::mutex> shared(p.buffers[k].mutex);
+                    p.buffers[k].items.insert(p.buffers[k].items.end(), buffers[k].begin(), buffers[k].end());
+                }
+                for (int k = 0; k < OBJECT_CLASSES; k++) {
+                    std::lock_guard<std::mutex> shared(p.objects[k].mutex);
+                    p.objects[k].items.insert(p.objects[k].items.end(), objects[k].begin(), objects[k].end());
+                }
+            }
+
+            thread_local ThreadCache* cache_pointer = nullptr;
+            thread_local bool cache_finished = false;
+
+            struct CacheOwner {
+                ThreadCache cache;
+                CacheOwner() { cache_pointer = &cache; }
+                ~CacheOwner() {
+                    cache_pointer = nullptr;
+                    cache_finished = true;
+                }
+            };
+
+            /*
+                @return cache of the calling thread, null once the thread is shutting down and
+                its thread locals are gone, e.g. for tensors freed by static destructors
+            */
+            ThreadCache* thread_cache() {
+                if (cache_pointer == nullptr && !cache_finished) {
+                    thread_local CacheOwner owner;
+                }
+                return cache_pointer;
+            }
+
+            /*
+                Only the owner of cache writes its counters, threads that are shutting down
+                (null cache) are not counted
+            */
+            void count(ThreadCache* cache, std::atomic<long long> ThreadCache::*counter) {
+                if (cache) {
+                    std::atomic<long long>& value = cache->*counter;
+                    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+            }
+
+            void* pop(std::vector<void*>& items) {
+                if (items.empty()) {
+                    return nullptr;
+                }
+                void* item = items.back();
+                items.pop_back();
+                return item;
+            }
+
+            /*
+                @return a cached item of class k, from the thread cache if given or else the
+                shared lists
+            */
+            template <int N>
+            void* take(ThreadCache* cache, std::vector<void*> (ThreadCache::*lists)[N], FreeList* shared, int k) {
+                if (cache) {
+                    std::lock_guard<CacheLock> lock(cache->mutex);
+                    if (void* item = pop((cache->*lists)[k])) {
+                        return item;
+                    }
+                }
+                std::lock_guard<std::mutex> lock(shared[k].mutex);
+                return pop(shared[k].items);
+            }
+
+            template <int N>
+            void give(ThreadCache* cache, std::vector<void*> (ThreadCache::*lists)[N], FreeList* shared, int k, void* item, int limit) {
+                if (cache) {
+                    std::lock_guard<CacheLock> lock(cache->mutex);
+                    std::vector<void*>& items = (cache->*lists)[k];
+                    if ((int)items.size() < limit) {
+                        items.push_back(item);
+                        return;
+                    }
+                }
+                std::lock_guard<std::mutex> lock(shared[k].mutex);
+                shared[k].items.push_back(item);
+            }
+
+            void free_buffers(std::vector<void*>& items, size_t size) {
+                for (void* buffer : items) {
+                    std::free(buffer);
+                }
+                pool().reserved -= (long long)(size * items.size());
+                items.clear();
+            }
+        }
+
+        Mode mode() {
+            return current().load();
+        }
+
+        void set_mode(Mode mode) {
+            if (mode == Mode::System) {
+                empty_cache();
+            }
+            current().store(mode);
+        }
+
+        size_t size_class(size_t bytes) {
+            if (bytes <= ALIGNMENT) {
+                return ALIGNMENT;
+            }
+            // power < bytes <= 2 * power
+            size_t power = size_t(1) << (63 - __builtin_clzll(bytes - 1));
+            size_t step = std::max(ALIGNMENT, power / 4);
+            return (bytes + step - 1) / step * step;
+        }
+
+        void* allocate(size_t bytes) {
+            size_t size = size_class(bytes);
+            Pool& p = pool();
+            ThreadCache* cache = thread_cache();
+            count(cache, &ThreadCache::allocations);
+            long long in_use = p.in_use.fetch_add(size, std::memory_order_relaxed) + size;
+            long long peak = p.peak.load(std::memory_order_relaxed);
+            while (in_use > peak && !p.peak.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {}
+            if (current().load(std::memory_order_relaxed) == Mode::Caching) {
+                void* buffer = take(size <= THREAD_CACHE_LIMIT ? cache : nullptr, &ThreadCache::buffers, p.buffers, buffer_class(size));
+                if (buffer) {
+                    count(cache, &ThreadCache::reuse_hits);
+                    return buffer;
+                }
+            }
+            void* buffer = std::aligned_alloc(ALIGNMENT, size);
+            if (buffer == nullptr) {
+                throw std::bad_alloc();
+            }
+            p.reserved.fetch_add(size, std::memory_order_relaxed);
+            return buffer;
+        }
+
+        void deallocate(void* buffer, size_t bytes) {
+            size_t size = size_class(bytes);
+            Pool& p = pool();
+            p.in_use.fetch_sub(size, std::memory_order_relaxed);
+            if (current().load(std::memory_order_relaxed) == Mode::Caching) {
+                ThreadCache* cache = size <= THREAD_CACHE_LIMIT ? thread_cache() : nullptr;
+                give(cache, &ThreadCache::buffers, p.buffers, buffer_class(size), buffer, THREAD_CACHE_BUFFERS);
+                return;
+            }
+            p.reserved.fetch_sub(size, std::memory_order_relaxed);
+            std::free(buffer);
+        }
+
+        void empty_cache() {
+            Pool& p = pool();
+            std::lock_guard<std::mutex> lock(p.registry_mutex);
+            for (ThreadCache* cache : p.caches) {
+                std::lock_guard<CacheLock> cache_lock(cache->mutex);
+                for (int k = 0; k < BUFFER_CLASSES; k++) {
+                    free_buffers(cache->buffers[k], class_size(k));
+                }
+            }
+            for (int k = 0; k < BUFFER_CLASSES; k++) {
+                std::lock_guard<std::mutex> shared(p.buffers[k].mutex);
+                free_buffers(p.buffers[k].items, class_size(k));
+            }
+        }
+
+        AllocatorStats stats() {
+            Pool& p = pool();
+            AllocatorStats stats;
+            stats.reserved = p.reserved.load();
+            stats.in_use = p.in_use.load();
+            stats.peak = p.peak.load();
+            std::lock_guard<std::mutex> lock(p.registry_mutex);
+            stats.allocations = p.allocations;
+            stats.reuse_hits = p.reuse_hits;
+            for (ThreadCache* cache : p.caches) {
+                stats.allocations += cache->allocations.load();
+                stats.reuse_hits += cache->reuse_hits.load();
+            }
+            return stats;
+        }
+
+        void reset_peak() {
+            Pool& p = pool();
+            p.peak = p.in_use.load();
+        }
+
+        void* allocate_object(size_t bytes) {
+            int k = (bytes + OBJECT_GRANULE - 1) / OBJECT_GRANULE - 1;
+            if (k >= OBJECT_CLASSES) {
+                return ::operator new(bytes);
+            }
+            if (void* object = take(thread_cache(), &ThreadCache::objects, pool().objects, k)) {
+                return object;
+            }
+            return ::operator new((k + 1) * OBJECT_GRANULE);
+        }
+
+        void deallocate_object(void* object, size_t bytes) {
+            int k = (bytes + OBJECT_GRANULE - 1) / OBJECT_GRANULE - 1;
+            if (k >= OBJECT_CLASSES || current().load(std::memory_order_relaxed) == Mode::System) {
+                ::operator delete(object);
+                return;
+            }
+            give(thread_cache(), &ThreadCache::objects, pool().objects, k, object, THREAD_CACHE_OBJECTS);
+        }
+    }
+}
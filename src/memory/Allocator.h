@@ -0,0 +1,112 @@
+#ifndef REVGRAD_ALLOCATOR_H
+#define REVGRAD_ALLOCATOR_H
+
+#include <cstddef>
+#include <vector>
+
+namespace RevGrad {
+    /*
+        Byte counts of the tensor buffer allocator. Reserved is everything taken from the
+        system and not returned yet, in use the part of it held by live buffers, the rest
+        is cached for reuse. Sizes are counted after rounding to the size class.
+    */
+    struct AllocatorStats {
+        long long reserved = 0;
+        long long in_use = 0;
+        long long peak = 0; // highest in_use since the start or the last reset_peak
+        long long allocations = 0;
+        long long reuse_hits = 0; // allocations served from the cache
+    };
+
+    namespace AllocatorUtill {
+        const size_t ALIGNMENT = 64;
+
+        /*
+            Caching: freed buffers are kept in a free list per size class and handed out
+            again, so the intermediates of a step reuse the buffers of those that died
+            before them. Every thread keeps a few buffers per class (up to 1 MB each) in a
+            cache of its own, so threads running ops in parallel do not wait on each other;
+            the other buffers go through free lists shared by all threads. System: freed
+            buffers go back to the system right away, useful with memory checkers. Both
+            align buffers to cache lines.
+        */
+        enum class Mode { Caching, System };
+
+        /*
+            @return the active mode. On first use it is taken from the REVGRAD_ALLOCATOR
+            environment variable ("caching" or "system"), caching otherwise
+        */
+        Mode mode();
+        void set_mode(Mode mode);
+
+        /*
+            @return bytes rounded up to its size class: multiples of 64 bytes, four classes
+            between consecutive powers of two, so at most 25% is wasted
+        */
+        size_t size_class(size_t bytes);
+        void* allocate(size_t bytes);
+        void deallocate(void* p, size_t bytes);
+        /*
+            Returns every cached buffer to the system
+        */
+        void empty_cache();
+        AllocatorStats stats();
+        void reset_peak();
+
+        /*
+            Free lists for the small bookkeeping objects of the graph (nodes, storages, edge
+            lists), kept apart from the tensor buffers and their stats. Objects are reused
+            by exact size and never returned to the system in caching mode.
+        */
+        void* allocate_object(size_t bytes);
+        void deallocate_object(void* p, size_t bytes);
+    }
+
+    /*
+        Standard allocator interface over AllocatorUtill, for the containers of tensor buffers
+    */
+    template <typename T>
+    class PoolAllocator {
+    public:
+        typedef T value_type;
+        PoolAllocator() {}
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U>&) {}
+        T* allocate(size_t n) {
+            return static_cast<T*>(AllocatorUtill::allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t n) {
+            AllocatorUtill::deallocate(p, n * sizeof(T));
+        }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+    template <typename T, typename U>
+    bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+    /*
+        Standard allocator interface over the object free lists, e.g. for std::allocate_shared
+    */
+    template <typename T>
+    class ObjectAllocator {
+    public:
+        typedef T value_type;
+        ObjectAllocator() {}
+        template <typename U>
+        ObjectAllocator(const ObjectAllocator<U>&) {}
+        T* allocate(size_t n) {
+            return static_cast<T*>(AllocatorUtill::allocate_object(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t n) {
+            AllocatorUtill::deallocate_object(p, n * sizeof(T));
+        }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const ObjectAllocator<T>&, const ObjectAllocator<U>&) { return true; }
+    template <typename T, typename U>
+    bool operator!=(const ObjectAllocator<T>&, const ObjectAllocator<U>&) { return false; }
+}
+
+#endif
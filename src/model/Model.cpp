@@ -16,8 +16,10 @@ namespace RevGrad {
     void Model::save_parameters(const std::string& filename) {
         std::ofstream file(filename);
         assert(file.is_open());
+        NoGradGuard no_grad;
         for (const auto& param : parameters) {
-            std::vector<float> values = param.values();
+            Tensor widened = param.to(DType::Float32);
+            const Values& values = widened.values();
             int size = (int)values.size();
             file << size << "\n";
             for (int i = 0; i < size; i++) {
@@ -39,32 +41,56 @@ namespace RevGrad {
         std::string line;
         while (std::getline(file, line)) {
             int size = std::stoi(line);
-            assert(size == (int)parameters[index].values().size());
+            assert(size == parameters[index].size());
             assert(std::getline(file, line));
-            std::vector<float> values;
+            Values values;
             std::stringstream ss(line);
             std::string s;
             while (std::getline(ss, s, ',')) {
                 values.push_back(std::stof(s));
             }
             assert((int)values.size() == size);
-            parameters[index].values() = values;
+            Tensor& param = parameters[index];
+            if (param.dtype() == DType::Float32) {
+                param.values() = values;
+            } else {
+                HalfUtill::from_float(param.dtype(), values.data(), param.halves().data(), size);
+            }
+            param.bump_version();
             index++;
         }
         file.close();
     }
 
-    Linear::Linear(Model* parent_model, int in_features, int out_features) 
+    Linear::Linear(Model* parent_model, int in_features, int out_features, Activation activation, Layout layout) 
         : in_features(in_features),
           out_features(out_features),
           weights(Tensor::random(Shape({out_features, in_features}), in_features)), 
-          bias(Tensor(Shape({out_features, 1})))
+          bias(Tensor(Shape({out_features, 1}))),
+          activation(activation),
+          layout(layout)
     {
         parent_model->parameters.push_back(weights);
         parent_model->parameters.push_back(bias);
     }
 
     Tensor Linear::forward(Tensor x) {
-        return Tensor::matmul(weights, x) + bias;
+        return Tensor::linear(x, weights, bias, activation, layout);
+    }
+
+    Checkpoint::Checkpoint(Model* parent_model, Model* block) : block(block) {
+        checkpoint.forward = [block](const Tensor& x) { return block->forward(x); };
+        checkpoint.parameters = block->parameters;
+        for (const Tensor& param : block->parameters) {
+            parent_model->parameters.push_back(param);
+        }
+    }
+
+    Tensor Checkpoint::forward(Tensor x) {
+        return Tensor::checkpoint(x, checkpoint);
+    }
+
+    const CheckpointStats& Checkpoint::stats() const {
+        return checkpoint.stats;
     }
 }
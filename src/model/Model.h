@@ -14,6 +14,10 @@ namespace RevGrad {
         std::vector<Tensor> get_params();
         Tensor operator()(Tensor x);
         virtual Tensor forward(Tensor x) = 0;
+        /*
+            Parameters stored as a half type are saved as float and rounded when loaded.
+            Load before Strategy::set_precision, which takes float master copies.
+        */
         void save_parameters(const std::string& filename);
         void load_parameters(const std::string& filename);
     };
@@ -24,12 +28,43 @@ namespace RevGrad {
         int out_features;
         Tensor weights;
         Tensor bias;
+        Activation activation;
+        Layout layout;
         Linear() {}
-        Linear(Model* parent_model, int in_features, int out_features);
         /*
-            @param x tensor of shape (features, batch size)
+            @param activation applied to the output inside the same fused op
+            @param layout layout of the input and output batches
+        */
+        Linear(
+            Model* parent_model, int in_features, int out_features, 
+            Activation activation = Activation::None, Layout layout = Layout::FeaturesFirst
+        );
+        /*
+            @param x tensor of shape (features, batch size), or (batch size, features) for BatchFirst
+        */
+        Tensor forward(Tensor x) override;
+    };
+
+    /*
+        Runs a sub-block of a model as a single checkpoint node (Tensor::checkpoint): of its
+        forward pass only the input of the block is kept, the internals are recomputed in
+        the backward pass. Meant for deep models whose intermediates limit the batch size.
+    */
+    class Checkpoint : public Model {
+    public:
+        Model* block;
+        CheckpointBlock checkpoint;
+        Checkpoint() : block(nullptr) {}
+        /*
+            @param block sub-block, e.g. a member model of the parent, its parameters are 
+            registered with the parent model
         */
+        Checkpoint(Model* parent_model, Model* block);
         Tensor forward(Tensor x) override;
+        /*
+            @return activation memory saved and time spent recomputing by the last step
+        */
+        const CheckpointStats& stats() const;
     };
 }
 
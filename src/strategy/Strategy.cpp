@@ -1,6 +1,84 @@
 #include "Strategy.h"
 
 namespace RevGrad {
+    namespace {
+        const int BLOCK = 1024; // elements updated before they are rounded, a few KB that stay in L1
+    }
+
+    Strategy::Strategy() : dtype(DType::Float32), scale(1.0f), unscale(1.0f) {
+        scale.requires_grad() = false;
+    }
+
+    void Strategy::set_precision(DType dtype, float initial_scale, int growth_interval) {
+        assert(this->dtype == DType::Float32 && initial_scale > 0.0f && growth_interval > 0);
+        this->dtype = dtype;
+        scaling.scale = initial_scale;
+        scaling.growth_interval = growth_interval;
+        scale.values()[0] = initial_scale;
+        scale.bump_version();
+        if (dtype == DType::Float32) {
+            return;
+        }
+        for (Tensor& param : parameters) {
+            assert(param.dtype() == DType::Float32 && param.is_contiguous() && param.offset() == 0);
+            // the storage is converted in place, so views of the parameter follow
+            Storage& storage = *param.data()->storage;
+            masters.push_back(std::move(storage.values));
+            storage.values = Values();
+            storage.halves.resize(param.size());
+            storage.dtype = dtype;
+            HalfUtill::from_float(dtype, masters.back().data(), storage.halves.data(), param.size());
+            param.bump_version();
+        }
+    }
+
+    Tensor Strategy::scale_loss(const Tensor& loss) const {
+        return loss * scale;
+    }
+
+    float Strategy::loss_scale() const {
+        return scaling.scale;
+    }
+
+    const LossScaling& Strategy::loss_scaling() const {
+        return scaling;
+    }
+
+    bool Strategy::begin_update() {
+        unscale = 1.0f / scale.values()[0];
+        if (scaling.scale == 1.0f && dtype == DType::Float32) {
+            return true;
+        }
+        // inf * 0 and nan * 0 are nan, finite gradients add up to 0
+        float check = 0.0f;
+        for (Tensor& param : parameters) {
+            const float* g = param.grads().data();
+            int n = param.size();
+            #pragma omp simd reduction(+:check)
+            for (int i = 0; i < n; i++) {
+                check += g[i] * 0.0f;
+            }
+        }
+        bool finite = check == 0.0f;
+        if (!finite) {
+            scaling.scale = std::max(1.0f, scaling.scale / 2.0f);
+            scaling.good_steps = 0;
+            scaling.skipped_steps++;
+        } else if (++scaling.good_steps == scaling.growth_interval) {
+            scaling.scale *= 2.0f;
+            scaling.good_steps = 0;
+        }
+        if (scale.values()[0] != scaling.scale) {
+            scale.values()[0] = scaling.scale;
+            scale.bump_version();
+        }
+        return finite;
+    }
+
+    float* Strategy::master(int k) {
+        return masters.empty() ? parameters[k].values().data() : masters[k].data();
+    }
+
     SGD::SGD(std::vector<Tensor> parameters, float learning_rate, float momentum) 
         : learning_rate(learning_rate), momentum(momentum)
     {
@@ -21,13 +99,36 @@ namespace RevGrad {
     }
 
     void SGD::update() {
+        if (!begin_update()) {
+            return;
+        }
         int j = 0;
-        for (auto param : parameters) {
-            for (int i = 0; i < param.size(); i++) {
-                velocity[j] = momentum * velocity[j] - learning_rate * param.grads()[i];
-                param.values()[i] += velocity[j];
-                j++;
+        for (int k = 0; k < (int)parameters.size(); k++) {
+            Tensor& param = parameters[k];
+            const float* g = param.grads().data();
+            float* v = velocity.data() + j;
+            float* w = master(k);
+            int n = param.size();
+            if (dtype == DType::Float32) {
+                #pragma omp simd
+                for (int i = 0; i < n; i++) {
+                    v[i] = momentum * v[i] - learning_rate * (g[i] * unscale);
+                    w[i] += v[i];
+                }
+            } else {
+                Half* h = param.halves().data();
+                for (int i0 = 0; i0 < n; i0 += BLOCK) {
+                    int i1 = std::min(n, i0 + BLOCK);
+                    #pragma omp simd
+                    for (int i = i0; i < i1; i++) {
+                        v[i] = momentum * v[i] - learning_rate * (g[i] * unscale);
+                        w[i] += v[i];
+                    }
+                    HalfUtill::from_float(dtype, w + i0, h + i0, i1 - i0);
+                }
             }
+            param.bump_version();
+            j += n;
         }
     }
 }
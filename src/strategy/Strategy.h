@@ -4,12 +4,63 @@
 #include "../tensor/Tensor.h"
 
 namespace RevGrad {
+    /*
+        State of the dynamic loss scale of mixed precision training
+    */
+    struct LossScaling {
+        float scale = 1.0f;
+        int growth_interval = 2000; // good steps in a row after which the scale is doubled
+        int good_steps = 0;
+        long long skipped_steps = 0; // steps dropped for gradients with inf or nan
+    };
+
     class Strategy {
+    protected:
+        DType dtype;
+        std::vector<Values> masters; // float copies of the parameters, in mixed precision only
+        LossScaling scaling;
+        Tensor scale; // loss scale read by the graphs of scale_loss
+        float unscale; // inverse of the scale the gradients of the current update were computed with
+
+        /*
+            Checks the gradients before an update. With gradients holding inf or nan the
+            step is skipped and the loss scale halved, otherwise the scale grows after
+            growth_interval good steps. Sets unscale for the update.
+            @return whether the update should run
+        */
+        bool begin_update();
+        /*
+            @return float values the update of parameter k applies to, its master copy in
+            mixed precision
+        */
+        float* master(int k);
+
     public:
         std::vector<Tensor> parameters;
-        Strategy() {}
+        Strategy();
         virtual void zero() = 0;
         virtual void update() = 0;
+        /*
+            Mixed precision training: from here on the parameters are stored as dtype and
+            the strategy keeps float master copies. Updates apply to the master copies and
+            round them back into the parameters in the same pass. Ops widen half inputs to
+            float as they read them and compute in float, so this halves the memory of the
+            parameters the graph reads but does not make a step faster: there is no half
+            compute path, the conversions make a step slightly slower.
+
+            The loss is scaled by a dynamic factor (see scale_loss) and the gradients are
+            divided by it in the update. A step whose gradients hold inf or nan, e.g. after
+            an fp16 overflow, is skipped and the scale halved; after growth_interval good
+            steps in a row the scale is doubled.
+        */
+        void set_precision(DType dtype, float initial_scale = 65536.0f, int growth_interval = 2000);
+        /*
+            @return loss times the current loss scale, to run the backward pass from. It
+            reads the scale when the graph runs, so captured graphs follow its changes.
+        */
+        Tensor scale_loss(const Tensor& loss) const;
+        float loss_scale() const;
+        const LossScaling& loss_scaling() const;
     };
 
     class SGD : public Strategy {
@@ -19,6 +70,10 @@ namespace RevGrad {
     public:
         SGD(std::vector<Tensor> parameters, float learning_rate, float momentum = 0.9);
         void zero() override;
+        /*
+            Unscales the gradient, updates the velocity and the parameter and, in mixed
+            precision, rounds the parameter back to its type in a single pass
+        */
         void update() override;
     };
 }
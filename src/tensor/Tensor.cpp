@@ -1,12 +1,23 @@
 #include "Tensor.h"
 
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <stdexcept>
+#include <exception>
+#include <atomic>
+
+#include "../kernel/Broadcast.h"
+#include "../kernel/Fusion.h"
+#include "../backend/Backend.h"
+
 namespace RevGrad {
     namespace ViewUtill {
-        int shape_size(Shape shape) {
+        int shape_size(const Shape& shape) {
             return std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<int>());
         }
 
-        Strides strides_from_shape(Shape shape) {
+        Strides strides_from_shape(const Shape& shape) {
             int d = shape.size();
             Strides strides(d);
             int stride = 1;
@@ -67,478 +78,1489 @@ namespace RevGrad {
             }
             return reshaped_indices;
         }
+
+        bool is_contiguous(const Shape& shape, const Strides& strides) {
+            int stride = 1;
+            for (int i = (int)shape.size() - 1; i >= 0; i--) {
+                if (shape[i] != 1 && strides[i] != stride) {
+                    return false;
+                }
+                stride *= shape[i];
+            }
+            return true;
+        }
+    }
+
+    Storage::Storage(Values values) : values(std::move(values)) {}
+    Storage::Storage(Halves halves, DType dtype) : halves(std::move(halves)), dtype(dtype) {}
+
+    namespace {
+        /*
+            Nodes and storages share one block with their reference counts, taken from the
+            object free lists, so creating an op output costs no heap allocation once warm
+        */
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make_pooled(Args&&... args) {
+            return std::allocate_shared<T>(ObjectAllocator<T>(), std::forward<Args>(args)...);
+        }
+
+        /*
+            @return a new leaf on the values of u, where graphs recorded from it end
+        */
+        Tensor alias(const Tensor& u) {
+            TensorUtill::materialize(u);
+            return Tensor(make_pooled<Node>(u.shape(), u.strides(), u.data()->storage, u.offset()));
+        }
     }
 
     Node::Node(float value) 
-        : shape(Shape(1, 1))
+        : storage(make_pooled<Storage>(Values(1, value))),
+          offset(0),
+          shape(Shape(1, 1)),
+          op(Op::None),
+          parent_offset(0),
+          requires_grad(true),
+          pending(false),
+          saved_version(0),
+          visit_epoch(0)
     {
-        values = Values(1, value);
         strides = ViewUtill::strides_from_shape(shape);
-        grads = Gradients(1);
     }
 
     Node::Node(Shape shape, float value) 
-        : shape(shape), 
-          strides(ViewUtill::strides_from_shape(shape))
+        : offset(0),
+          shape(std::move(shape)), 
+          strides(ViewUtill::strides_from_shape(this->shape)),
+          op(Op::None),
+          parent_offset(0),
+          requires_grad(true),
+          pending(false),
+          saved_version(0),
+          visit_epoch(0)
     {
-        int size = ViewUtill::shape_size(shape);
-        values = Values(size, value);
-        grads = Gradients(size);
+        int size = ViewUtill::shape_size(this->shape);
+        storage = make_pooled<Storage>(Values(size, value));
     }
 
     Node::Node(Shape shape, Values values) 
-        : values(values),
-          shape(shape), 
-          strides(ViewUtill::strides_from_shape(shape)),
-          grads(Gradients((int)values.size()))
+        : offset(0),
+          shape(std::move(shape)), 
+          strides(ViewUtill::strides_from_shape(this->shape)),
+          op(Op::None),
+          parent_offset(0),
+          requires_grad(true),
+          pending(false),
+          saved_version(0),
+          visit_epoch(0)
+    {
+        assert(ViewUtill::shape_size(this->shape) == (int)values.size());
+        storage = make_pooled<Storage>(std::move(values));
+    }
+
+    Node::Node(Shape shape, Strides strides, std::shared_ptr<Storage> storage, int offset)
+        : storage(storage),
+          offset(offset),
+          shape(shape),
+          strides(strides),
+          op(Op::None),
+          parent_offset(0),
+          requires_grad(true),
+          pending(false),
+          saved_version(0),
+          visit_epoch(0)
     {
-        assert(ViewUtill::shape_size(shape) == (int)values.size());
+        assert(shape.size() == strides.size());
     }
 
     namespace TensorUtill {
-        Tensor addition(const Tensor& u, const Tensor& v) {
-            Shape shape = ViewUtill::broadcast_shape(u.shape(), v.shape());
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                float u_value = u.value(ViewUtill::reshape_indices(indices, u.shape()));
-                float v_value = v.value(ViewUtill::reshape_indices(indices, v.shape()));
-                w.values()[i] = u_value + v_value;
+        namespace {
+            float* data(const Tensor& u) {
+                if (u.data()->pending) {
+                    materialize(u);
+                }
+                assert(u.dtype() == DType::Float32);
+                return u.data()->storage->values.data() + u.offset();
             }
-            w.add_edge(u), w.add_edge(v);
-            return w;
+
+            /*
+                @return elements of u of any type, a float or a Half array
+            */
+            void* raw(const Tensor& u) {
+                if (u.dtype() == DType::Float32) {
+                    return data(u);
+                }
+                return u.data()->storage->halves.data() + u.offset();
+            }
+
+            /*
+                @return dense tensor of shape with uninitialized elements of type dtype
+            */
+            Tensor allocate(const Shape& shape, DType dtype) {
+                if (dtype == DType::Float32) {
+                    return Tensor(shape);
+                }
+                Halves halves(ViewUtill::shape_size(shape));
+                return Tensor(make_pooled<Node>(
+                    shape, ViewUtill::strides_from_shape(shape), make_pooled<Storage>(std::move(halves), dtype), 0
+                ));
+            }
+
+            /*
+                @return gradient buffer of u, allocated on the first write
+            */
+            float* grad_data(const Tensor& u) {
+                Gradients& grads = u.data()->grads;
+                if (grads.empty()) {
+                    grads.assign(u.size(), 0.0f);
+                }
+                return grads.data();
+            }
+
+            /*
+                @return the elements of u in row-major order, copied into scratch if u is a
+                strided view and converted to float there if u has a half type
+            */
+            const float* dense(const Tensor& u, Values& scratch) {
+                if (u.is_contiguous() && u.dtype() == DType::Float32) {
+                    return data(u);
+                }
+                scratch.resize(u.size());
+                BroadcastUtill::Plan plan = BroadcastUtill::make_plan(u.shape(), {
+                    ViewUtill::strides_from_shape(u.shape()), u.strides()
+                });
+                HalfUtill::convert(plan, scratch.data(), DType::Float32, raw(u), u.dtype());
+                return scratch.data();
+            }
+
+            /*
+                @return u as a row-major matrix of element type type with leading dimension ld 
+                for Backend::gemm, transposed if u is a transposed view and copied into float 
+                scratch if u has no matrix layout. Half matrices are passed as they are stored, 
+                the backend converts them.
+            */
+            const void* matrix(const Tensor& u, bool& trans, int& ld, DType& type, Values& scratch) {
+                const Shape& shape = u.shape();
+                const Strides& strides = u.strides();
+                assert((int)shape.size() == 2);
+                trans = false;
+                type = u.dtype();
+                if ((shape[1] == 1 || strides[1] == 1) && (shape[0] == 1 || strides[0] >= shape[1])) {
+                    ld = shape[0] == 1 ? shape[1] : strides[0];
+                    return raw(u);
+                }
+                if ((shape[0] == 1 || strides[0] == 1) && (shape[1] == 1 || strides[1] >= shape[0])) {
+                    trans = true;
+                    ld = shape[1] == 1 ? shape[0] : strides[1];
+                    return raw(u);
+                }
+                type = DType::Float32;
+                ld = shape[1];
+                return dense(u, scratch);
+            }
+
+            BroadcastUtill::Plan unary_plan(const Tensor& w, const Tensor& u) {
+                return BroadcastUtill::make_plan(w.shape(), {w.strides(), u.strides()});
+            }
+
+            /*
+                Plan over (u_grad, w_grad, u_value, w_value) for the backward of a unary op
+            */
+            BroadcastUtill::Plan unary_backward_plan(const Tensor& w, const Tensor& u) {
+                Strides strides = ViewUtill::strides_from_shape(w.shape());
+                return BroadcastUtill::make_plan(w.shape(), {strides, strides, u.strides(), w.strides()});
+            }
+
+            BroadcastUtill::Plan binary_plan(const Tensor& w, const Tensor& u, const Tensor& v) {
+                return BroadcastUtill::make_plan(w.shape(), {
+                    w.strides(),
+                    BroadcastUtill::broadcast_strides(u.shape(), u.strides(), w.shape()),
+                    BroadcastUtill::broadcast_strides(v.shape(), v.strides(), w.shape())
+                });
+            }
+
+            void binary_forward(const Tensor& w, const Tensor& u, const Tensor& v, BinaryOp op) {
+                BackendUtill::backend().binary(op, binary_plan(w, u, v), data(w), data(u), data(v));
+            }
+
+            Tensor binary(const Tensor& u, const Tensor& v, BinaryOp op) {
+                Tensor w(ViewUtill::broadcast_shape(u.shape(), v.shape()));
+                binary_forward(w, u, v, op);
+                w.add_edge(u), w.add_edge(v);
+                return w;
+            }
+
+            /*
+                Accumulates the gradient of operand x (0 for u, 1 for v) of w = op(u, v),
+                reduced over the dimensions along which it was broadcast.
+            */
+            void binary_backward(const Tensor& w, BinaryOp op, int x_index) {
+                Tensor x = w.edges()[x_index];
+                if (!x.requires_grad()) {
+                    return;
+                }
+                Tensor u = w.edges()[0];
+                Tensor v = w.edges()[1];
+                BroadcastUtill::Plan plan = BroadcastUtill::make_plan(w.shape(), {
+                    ViewUtill::strides_from_shape(w.shape()),
+                    BroadcastUtill::broadcast_strides(u.shape(), u.strides(), w.shape()),
+                    BroadcastUtill::broadcast_strides(v.shape(), v.strides(), w.shape()),
+                    BroadcastUtill::broadcast_strides(x.shape(), ViewUtill::strides_from_shape(x.shape()), w.shape())
+                });
+                BackendUtill::backend().binary_backward(
+                    op, x_index, plan, grad_data(x), grad_data(w), data(u), data(v)
+                );
+            }
+        }
+
+        Tensor addition(const Tensor& u, const Tensor& v) {
+            return binary(u, v, BinaryOp::Add);
+        }
+
+        void addition_forward_fn(const Tensor& w, const Edges& inputs) {
+            binary_forward(w, inputs[0], inputs[1], BinaryOp::Add);
         }
 
         void addition_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 2);
-            Tensor u = w.edges()[0];
-            Tensor v = w.edges()[1];
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                Indices u_indices = ViewUtill::reshape_indices(indices, u.shape());
-                Indices v_indices = ViewUtill::reshape_indices(indices, v.shape());
-                u.grad(u_indices) += w.grads()[i];
-                v.grad(v_indices) += w.grads()[i];
-            }
+            binary_backward(w, BinaryOp::Add, 0);
+            binary_backward(w, BinaryOp::Add, 1);
         }
 
         Tensor subtraction(const Tensor& u, const Tensor& v) {
-            Shape shape = ViewUtill::broadcast_shape(u.shape(), v.shape());
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                float u_value = u.value(ViewUtill::reshape_indices(indices, u.shape()));
-                float v_value = v.value(ViewUtill::reshape_indices(indices, v.shape()));
-                w.values()[i] = u_value - v_value;
-            }
-            w.add_edge(u), w.add_edge(v);
-            return w;
+            return binary(u, v, BinaryOp::Subtract);
+        }
+
+        void subtraction_forward_fn(const Tensor& w, const Edges& inputs) {
+            binary_forward(w, inputs[0], inputs[1], BinaryOp::Subtract);
         }
 
         void subtraction_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 2);
-            Tensor u = w.edges()[0];
-            Tensor v = w.edges()[1];
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                Indices u_indices = ViewUtill::reshape_indices(indices, u.shape());
-                Indices v_indices = ViewUtill::reshape_indices(indices, v.shape());
-                u.grad(u_indices) += w.grads()[i];
-                v.grad(v_indices) -= w.grads()[i];
-            }
+            binary_backward(w, BinaryOp::Subtract, 0);
+            binary_backward(w, BinaryOp::Subtract, 1);
         }
 
         Tensor multiplication(const Tensor& u, const Tensor& v) {
-            Shape shape = ViewUtill::broadcast_shape(u.shape(), v.shape());
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                float u_value = u.value(ViewUtill::reshape_indices(indices, u.shape()));
-                float v_value = v.value(ViewUtill::reshape_indices(indices, v.shape()));
-                w.values()[i] = u_value * v_value;
-            }
-            w.add_edge(u), w.add_edge(v);
-            return w;
+            return binary(u, v, BinaryOp::Multiply);
+        }
+
+        void multiplication_forward_fn(const Tensor& w, const Edges& inputs) {
+            binary_forward(w, inputs[0], inputs[1], BinaryOp::Multiply);
         }
 
         void multiplication_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 2);
-            Tensor u = w.edges()[0];
-            Tensor v = w.edges()[1];
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                Indices u_indices = ViewUtill::reshape_indices(indices, u.shape());
-                Indices v_indices = ViewUtill::reshape_indices(indices, v.shape());
-                u.grad(u_indices) += w.grads()[i] * v.value(v_indices);
-                v.grad(v_indices) += w.grads()[i] * u.value(u_indices);
-            }
+            binary_backward(w, BinaryOp::Multiply, 0);
+            binary_backward(w, BinaryOp::Multiply, 1);
         }
 
         Tensor division(const Tensor& u, const Tensor& v) {
-            Shape shape = ViewUtill::broadcast_shape(u.shape(), v.shape());
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                float u_value = u.value(ViewUtill::reshape_indices(indices, u.shape()));
-                float v_value = v.value(ViewUtill::reshape_indices(indices, v.shape()));
-                w.values()[i] = u_value / v_value;
-            }
-            w.add_edge(u), w.add_edge(v);
-            return w;
+            return binary(u, v, BinaryOp::Divide);
+        }
+
+        void division_forward_fn(const Tensor& w, const Edges& inputs) {
+            binary_forward(w, inputs[0], inputs[1], BinaryOp::Divide);
         }
 
         void division_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 2);
-            Tensor u = w.edges()[0];
-            Tensor v = w.edges()[1];
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                Indices u_indices = ViewUtill::reshape_indices(indices, u.shape());
-                Indices v_indices = ViewUtill::reshape_indices(indices, v.shape());
-                float u_value = u.value(u_indices);
-                float v_value = v.value(v_indices);
-                u.grad(u_indices) += w.grads()[i] * (1.0f / v_value);
-                v.grad(v_indices) += w.grads()[i] * (-u_value / (v_value * v_value));
-            }
+            binary_backward(w, BinaryOp::Divide, 0);
+            binary_backward(w, BinaryOp::Divide, 1);
         }
 
-        Tensor sum(const Tensor& u, int axis) {
-            if (axis == -1) {
-                float sum = 0.0f;
-                for (int i = 0; i < u.size(); i++) {
-                    sum += u.values()[i];
+        namespace {
+            /*
+                Layout of a reduction. The dimensions of u are ordered as (kept dimensions 
+                before the last reduced one, reduced dimensions, trailing kept dimensions), so
+                that the dense input reads as (outer, reduce, inner). When the reduced 
+                dimensions are not adjacent this order differs from the order of u and the 
+                input is copied in permuted order first.
+            */
+            struct Reduction {
+                Shape shape; // shape of u in permuted order
+                Strides strides; // strides of the dense layout of u in permuted order
+                std::vector<int> perm;
+                bool permuted;
+                int outer, reduce, inner;
+            };
+
+            int axes_mask(const Shape& shape, const Axes& axes) {
+                int d = shape.size();
+                assert(d < 31);
+                if (axes.empty()) {
+                    return (1 << d) - 1;
                 }
-                Tensor w(sum);
-                w.meta_data()["axis"] = axis;
-                w.add_edge(u);
-                return w;
+                int mask = 0;
+                for (int axis : axes) {
+                    assert(0 <= axis && axis < d);
+                    assert(!(mask >> axis & 1));
+                    mask |= 1 << axis;
+                }
+                return mask;
             }
-            Shape shape = u.shape();
-            shape.erase(shape.begin() + axis);
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                indices.insert(indices.begin() + axis, 0);
-                float sum = 0.0f;
-                for (int j = 0; j < u.shape()[axis]; j++) {
-                    indices[axis] = j;
-                    float value = u.value(indices);
-                    sum += value;
-                }
-                indices.erase(indices.begin() + axis);
-                w.values()[ViewUtill::ravel(indices, w.strides())] = sum;
-            }
-            if (shape.size() == 0) {
-                assert(w.size() == 1);
-                w.shape() = Shape({1});
-                w.strides() = ViewUtill::strides_from_shape(w.shape());
-            }
-            w.meta_data()["axis"] = axis;
+
+            Reduction reduction(const Shape& shape, int mask) {
+                int d = shape.size();
+                // unit dimensions do not affect the memory order, they count as kept
+                auto reduced = [&](int k) { return (mask >> k & 1) && shape[k] > 1; };
+                int last_reduced = -1;
+                for (int k = 0; k < d; k++) {
+                    if (reduced(k)) {
+                        last_reduced = k;
+                    }
+                }
+                Reduction r;
+                r.outer = r.reduce = r.inner = 1;
+                std::vector<int> reduced_dims, inner_dims;
+                for (int k = 0; k < d; k++) {
+                    if (reduced(k)) {
+                        reduced_dims.push_back(k), r.reduce *= shape[k];
+                    } else if (k > last_reduced) {
+                        inner_dims.push_back(k), r.inner *= shape[k];
+                    } else {
+                        r.perm.push_back(k), r.outer *= shape[k];
+                    }
+                }
+                r.perm.insert(r.perm.end(), reduced_dims.begin(), reduced_dims.end());
+                r.perm.insert(r.perm.end(), inner_dims.begin(), inner_dims.end());
+                Strides dense_strides = ViewUtill::strides_from_shape(shape);
+                r.permuted = false;
+                int previous = -1;
+                for (int k : r.perm) {
+                    r.shape.push_back(shape[k]);
+                    r.strides.push_back(dense_strides[k]);
+                    if (shape[k] > 1) {
+                        r.permuted |= k < previous;
+                        previous = k;
+                    }
+                }
+                return r;
+            }
+
+            /*
+                @return u as a dense buffer in the order of the reduction
+            */
+            const float* reduction_input(const Tensor& u, const Reduction& r, Values& scratch) {
+                if (!r.permuted) {
+                    return dense(u, scratch);
+                }
+                Strides strides;
+                for (int k : r.perm) {
+                    strides.push_back(u.strides()[k]);
+                }
+                scratch.resize(u.size());
+                BroadcastUtill::Plan plan = BroadcastUtill::make_plan(r.shape, {
+                    ViewUtill::strides_from_shape(r.shape), strides
+                });
+                HalfUtill::convert(plan, scratch.data(), DType::Float32, raw(u), u.dtype());
+                return scratch.data();
+            }
+
+            /*
+                @return offset in the dense layout of u of element index of the reduction input
+            */
+            int reduction_offset(const Reduction& r, int index) {
+                if (!r.permuted) {
+                    return index;
+                }
+                int offset = 0;
+                for (int k = (int)r.shape.size() - 1; k >= 0; k--) {
+                    offset += (index % r.shape[k]) * r.strides[k];
+                    index /= r.shape[k];
+                }
+                return offset;
+            }
+
+            Shape reduced_shape(const Shape& shape, int mask, bool keepdim) {
+                Shape reduced;
+                for (int k = 0; k < (int)shape.size(); k++) {
+                    if (!(mask >> k & 1)) {
+                        reduced.push_back(shape[k]);
+                    } else if (keepdim) {
+                        reduced.push_back(1);
+                    }
+                }
+                if (reduced.size() == 0) {
+                    reduced = Shape({1});
+                }
+                return reduced;
+            }
+        }
+
+        Tensor sum(const Tensor& u, const Axes& axes, bool keepdim) {
+            int mask = axes_mask(u.shape(), axes);
+            Tensor w(reduced_shape(u.shape(), mask, keepdim));
+            w.attributes().axes = mask;
+            sum_forward_fn(w, {u});
             w.add_edge(u);
             return w;
         }
 
+        void sum_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& u = inputs[0];
+            Reduction r = reduction(u.shape(), w.attributes().axes);
+            Values scratch;
+            const float* u_values = reduction_input(u, r, scratch);
+            BackendUtill::backend().sum(u_values, r.outer, r.reduce, r.inner, data(w));
+        }
+
         void sum_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            assert(w.meta_data().count("axis"));
-            int axis = w.meta_data().at("axis");
-            if (axis == -1) {
-                assert(w.size() == 1);
-                for (int i = 0; i < u.size(); i++) {
-                    u.grads()[i] += w.grads()[0];
-                }
+            int mask = w.attributes().axes;
+            Reduction r = reduction(u.shape(), mask);
+            if (!r.permuted) {
+                BackendUtill::backend().sum_backward(grad_data(w), r.outer, r.reduce, r.inner, grad_data(u));
                 return;
             }
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                indices.insert(indices.begin() + axis, 0);
-                for (int j = 0; j < u.shape()[axis]; j++) {
-                    indices[axis] = j;
-                    u.grad(indices) += w.grads()[i];
-                }
-            }
+            // u_grad += w_grad broadcast along the reduced dimensions
+            Shape kept = reduced_shape(u.shape(), mask, true);
+            BroadcastUtill::Plan plan = BroadcastUtill::make_plan(u.shape(), {
+                ViewUtill::strides_from_shape(u.shape()),
+                BroadcastUtill::broadcast_strides(kept, ViewUtill::strides_from_shape(kept), u.shape())
+            });
+            BroadcastUtill::elementwise<2>(plan, {grad_data(u), grad_data(w)}, [](float& du, float& dw) { du += dw; });
         }
 
-        Tensor max(const Tensor& u, int axis) {
-            Shape shape = u.shape();
-            shape.erase(shape.begin() + axis);
-            Tensor w(shape);
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                indices.insert(indices.begin() + axis, 0);
-                float max_value = std::numeric_limits<float>::lowest();
-                for (int j = 0; j < u.shape()[axis]; j++) {
-                    indices[axis] = j;
-                    float value = u.value(indices);
-                    if (value > max_value) {
-                        max_value = value;
+        Tensor max(const Tensor& u, const Axes& axes, bool keepdim) {
+            int mask = axes_mask(u.shape(), axes);
+            Tensor w(reduced_shape(u.shape(), mask, keepdim));
+            w.attributes().axes = mask;
+            max_forward_fn(w, {u});
+            w.add_edge(u);
+            return w;
+        }
+
+        void max_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& u = inputs[0];
+            Reduction r = reduction(u.shape(), w.attributes().axes);
+            Values scratch;
+            const float* u_values = reduction_input(u, r, scratch);
+            int n = w.size();
+            Indices& workspace = w.data()->index_workspace;
+            workspace.resize(2 * n);
+            int* argmax = workspace.data();
+            int* ties = argmax + n;
+            BackendUtill::backend().max(u_values, r.outer, r.reduce, r.inner, data(w), argmax, ties);
+            // offsets of the maxima in the gradient of u: the first maximum of every output,
+            // followed by (output, offset) pairs for the other maxima of tied outputs
+            Indices& saved = w.data()->saved_indices;
+            saved.resize(n);
+            for (int i = 0; i < n; i++) {
+                int o = i / r.inner, j = i % r.inner;
+                saved[i] = reduction_offset(r, (o * r.reduce + argmax[i]) * r.inner + j);
+                for (int k = argmax[i] + 1; ties[i] > 1 && k < r.reduce; k++) {
+                    int index = (o * r.reduce + k) * r.inner + j;
+                    if (u_values[index] == data(w)[i]) {
+                        saved.push_back(i);
+                        saved.push_back(reduction_offset(r, index));
                     }
                 }
-                indices.erase(indices.begin() + axis);
-                w.values()[ViewUtill::ravel(indices, w.strides())] = max_value;
             }
-            if (shape.size() == 0) {
-                assert(w.size() == 1);
-                w.shape() = Shape({1});
-                w.strides() = ViewUtill::strides_from_shape(w.shape());
-            }
-            w.meta_data()["axis"] = axis;
-            w.add_edge(u);
-            return w;
         }
 
         void max_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
-            assert(w.meta_data().count("axis"));
-            int axis = w.meta_data().at("axis");
             Tensor u = w.edges()[0];
-            for (int i = 0; i < w.size(); i++) {
-                Indices indices = ViewUtill::unravel(i, w.shape(), w.strides());
-                indices.insert(indices.begin() + axis, 0);
-                float max_value = w.values()[i];
-                float cnt = 0;
-                for (int j = 0; j < u.shape()[axis]; j++) {
-                    indices[axis] = j;
-                    if (u.value(indices) == max_value) {
-                        cnt++;
-                    }
-                }
-                for (int j = 0; j < u.shape()[axis]; j++) {
-                    indices[axis] = j;
-                    if (u.value(indices) == max_value) {
-                        u.grad(indices) += w.grads()[i] / cnt;
-                    }
+            const Indices& saved = w.data()->saved_indices;
+            int n = w.size();
+            assert((int)saved.size() >= n);
+            float* u_grad = grad_data(u);
+            const float* w_grad = grad_data(w);
+            if ((int)saved.size() == n) {
+                for (int i = 0; i < n; i++) {
+                    u_grad[saved[i]] += w_grad[i];
                 }
+                return;
+            }
+            // ties share the gradient equally, the argmax of the forward is not needed any more
+            Indices& count = w.data()->index_workspace;
+            count.assign(n, 1);
+            for (int p = n; p < (int)saved.size(); p += 2) {
+                count[saved[p]]++;
+            }
+            for (int i = 0; i < n; i++) {
+                u_grad[saved[i]] += w_grad[i] / count[i];
+            }
+            for (int p = n; p < (int)saved.size(); p += 2) {
+                u_grad[saved[p + 1]] += w_grad[saved[p]] / count[saved[p]];
             }
         }
 
-        Tensor exp(const Tensor& u) {
-            Tensor w(u.shape());
-            for (int i = 0; i < u.size(); i++) {
-                w.values()[i] = std::exp(u.values()[i]);
+        namespace {
+            void unary_forward(const Tensor& w, const Tensor& u, UnaryOp op) {
+                BackendUtill::backend().unary(op, unary_plan(w, u), data(w), data(u));
+            }
+
+            Tensor unary(const Tensor& u, UnaryOp op) {
+                Tensor w(u.shape());
+                unary_forward(w, u, op);
+                w.add_edge(u);
+                return w;
             }
-            w.add_edge(u);
-            return w;
+        }
+
+        Tensor exp(const Tensor& u) {
+            return unary(u, UnaryOp::Exp);
+        }
+
+        void exp_forward_fn(const Tensor& w, const Edges& inputs) {
+            unary_forward(w, inputs[0], UnaryOp::Exp);
         }
 
         void exp_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            for (int i = 0; i < u.size(); i++) {
-                u.grads()[i] += w.grads()[i] * std::exp(u.values()[i]);
-            }
+            BackendUtill::backend().unary_backward(
+                UnaryOp::Exp, unary_backward_plan(w, u), grad_data(u), grad_data(w), data(u), data(w)
+            );
         }
 
         Tensor log(const Tensor& u) {
-            Tensor w(u.shape());
-            for (int i = 0; i < u.size(); i++) {
-                float value = u.values()[i];
-                assert(!(value != value)); // nan
-                assert(value != 0.0f);
-                assert(value > 0.0f);
-                w.values()[i] = std::log(value);
-            }
-            w.add_edge(u);
-            return w;
+            return unary(u, UnaryOp::Log);
+        }
+
+        void log_forward_fn(const Tensor& w, const Edges& inputs) {
+            unary_forward(w, inputs[0], UnaryOp::Log);
         }
 
         void log_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            for (int i = 0; i < u.size(); i++) {
-                u.grads()[i] += w.grads()[i] * (1 / u.values()[i]);
-            }
+            BackendUtill::backend().unary_backward(
+                UnaryOp::Log, unary_backward_plan(w, u), grad_data(u), grad_data(w), data(u), data(w)
+            );
         }
 
         Tensor relu(const Tensor& u) {
-            Tensor w(u.shape());
-            for (int i = 0; i < u.size(); i++) {
-                w.values()[i] = std::max(0.0f, u.values()[i]);
-            }
-            w.add_edge(u);
-            return w;
+            return unary(u, UnaryOp::Relu);
+        }
+
+        void relu_forward_fn(const Tensor& w, const Edges& inputs) {
+            unary_forward(w, inputs[0], UnaryOp::Relu);
         }
 
         void relu_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            for (int i = 0; i < u.size(); i++) {
-                u.grads()[i] += w.grads()[i] * (u.values()[i] > 0.0f ? 1.0f : 0.0f);
-            }
+            BackendUtill::backend().unary_backward(
+                UnaryOp::Relu, unary_backward_plan(w, u), grad_data(u), grad_data(w), data(u), data(w)
+            );
         }
 
         Tensor sigmoid(const Tensor& u) {
-            Tensor w(u.shape());
-            for (int i = 0; i < u.size(); i++) {
-                float value = u.values()[i];
-                if (0 < value) {
-                    w.values()[i] = 1.0f / (1.0f + std::exp(-value));
-                } else {
-                    float exp_value = std::exp(value);
-                    w.values()[i] = exp_value / (1.0f + exp_value);
-                }
-            }
-            w.add_edge(u);
-            return w;
+            return unary(u, UnaryOp::Sigmoid);
+        }
+
+        void sigmoid_forward_fn(const Tensor& w, const Edges& inputs) {
+            unary_forward(w, inputs[0], UnaryOp::Sigmoid);
         }
 
         void sigmoid_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            for (int i = 0; i < u.size(); i++) {
-                float value = w.values()[i];
-                u.grads()[i] += w.grads()[i] * (value * (1 - value));
-            }
+            BackendUtill::backend().unary_backward(
+                UnaryOp::Sigmoid, unary_backward_plan(w, u), grad_data(u), grad_data(w), data(u), data(w)
+            );
         }
 
-        Tensor softmax(const Tensor& u) {
-            Tensor mx = Tensor::max(u);
-            Tensor exp = Tensor::exp(u - mx);
-            Tensor s = exp / Tensor::sum(exp, 0);
-            Tensor w(u.shape());
-            w.values() = s.values();
-            w.add_edge(u);
-            return w;
+        Tensor tanh(const Tensor& u) {
+            return unary(u, UnaryOp::Tanh);
         }
 
-        void softmax_backward_fn(const Tensor& w) {
+        void tanh_forward_fn(const Tensor& w, const Edges& inputs) {
+            unary_forward(w, inputs[0], UnaryOp::Tanh);
+        }
+
+        void tanh_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 1);
             Tensor u = w.edges()[0];
-            Shape shape = u.shape();
-            assert((int)shape.size() == 2); // {features, batch_size}
-            for (int k = 0; k < shape[1]; k++) { // batch_size
-                for (int i = 0; i < shape[0]; i++) { // features
-                    float value_i = w.values()[i * shape[1] + k];
-                    for (int j = 0; j < shape[0]; j++) { // features
-                        float value_j = w.values()[j * shape[1] + k];
-                        u.grads()[i * shape[1] + k] += w.grads()[j * shape[1] + k] * (value_i * ((i == j) - value_j));
-                    }
-                }
+            BackendUtill::backend().unary_backward(
+                UnaryOp::Tanh, unary_backward_plan(w, u), grad_data(u), grad_data(w), data(u), data(w)
+            );
+        }
+
+        namespace {
+            void softmax_forward(const Tensor& w, const Tensor& u, bool log) {
+                Reduction r = reduction(u.shape(), 1 << w.attributes().axis);
+                Values scratch;
+                const float* u_values = dense(u, scratch);
+                BackendUtill::backend().softmax(u_values, r.outer, r.reduce, r.inner, data(w), log);
+            }
+
+            Tensor softmax(const Tensor& u, int axis, bool log) {
+                assert(0 <= axis && axis < (int)u.shape().size());
+                Tensor w(u.shape());
+                w.attributes().axis = axis;
+                softmax_forward(w, u, log);
+                w.add_edge(u);
+                return w;
+            }
+
+            void softmax_backward(const Tensor& w, bool log) {
+                assert((int)w.edges().size() == 1);
+                Tensor u = w.edges()[0];
+                Reduction r = reduction(u.shape(), 1 << w.attributes().axis);
+                BackendUtill::backend().softmax_backward(
+                    data(w), grad_data(w), r.outer, r.reduce, r.inner, grad_data(u), log
+                );
             }
         }
 
-        Tensor log_softmax(const Tensor& u) {
-            Tensor mx = Tensor::max(u);
-            Tensor s = u - mx - Tensor::log(Tensor::sum(Tensor::exp(u - mx), 0));
-            Tensor w(u.shape());
-            assert(s.shape() == w.shape());
-            w.values() = s.values();
-            w.add_edge(u);
-            return w;
+        Tensor softmax(const Tensor& u, int axis) {
+            return softmax(u, axis, false);
+        }
+
+        void softmax_forward_fn(const Tensor& w, const Edges& inputs) {
+            softmax_forward(w, inputs[0], false);
+        }
+
+        void softmax_backward_fn(const Tensor& w) {
+            softmax_backward(w, false);
+        }
+
+        Tensor log_softmax(const Tensor& u, int axis) {
+            return softmax(u, axis, true);
+        }
+
+        void log_softmax_forward_fn(const Tensor& w, const Edges& inputs) {
+            softmax_forward(w, inputs[0], true);
         }
 
         void log_softmax_backward_fn(const Tensor& w) {
-            assert((int)w.edges().size() == 1);
-            Tensor u = w.edges()[0];
-            Tensor mx = Tensor::max(u);
-            Tensor exp = Tensor::exp(u - mx);
-            Tensor s = exp / Tensor::sum(exp, 0);
-            Shape shape = u.shape();
-            assert((int)shape.size() == 2);
-            for (int k = 0; k < shape[1]; k++) { // batch_size
-                for (int i = 0; i < shape[0]; i++) { // features
-                    float value_i = s.values()[i * shape[1] + k];
-                    for (int j = 0; j < shape[0]; j++) { // features
-                        u.grads()[i * shape[1] + k] += w.grads()[j * shape[1] + k] * ((i == j) - value_i);
-                    }
+            softmax_backward(w, true);
+        }
+
+        Tensor softmax_cross_entropy(const Tensor& u, const Tensor& labels, int axis) {
+            assert(0 <= axis && axis < (int)u.shape().size());
+            Tensor w(0.0f);
+            w.attributes().axis = axis;
+            softmax_cross_entropy_forward_fn(w, {u, labels});
+            w.add_edge(u), w.add_edge(labels);
+            return w;
+        }
+
+        void softmax_cross_entropy_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& u = inputs[0];
+            const Tensor& labels = inputs[1];
+            Reduction r = reduction(u.shape(), 1 << w.attributes().axis);
+            int n = r.outer * r.inner;
+            assert(labels.size() == n);
+            Values scratch, label_scratch;
+            const float* u_values = dense(u, scratch);
+            const float* label_values = dense(labels, label_scratch);
+            // class indices and the log-sum-exp of every sample are kept for the backward
+            Indices& classes = w.data()->saved_indices;
+            Values& lse = w.data()->saved_values;
+            classes.resize(n), lse.resize(n);
+            for (int i = 0; i < n; i++) {
+                // checked in release builds too, the kernels index the logits with it
+                float label = label_values[i];
+                if (!(0.0f <= label && label < r.reduce && label == (int)label)) {
+                    throw std::out_of_range(
+                        "softmax_cross_entropy: label " + std::to_string(label) + " is not a class index in [0, " +
+                        std::to_string(r.reduce) + ")"
+                    );
                 }
+                classes[i] = (int)label;
             }
+            Values& loss = w.data()->workspace;
+            loss.resize(n);
+            BackendUtill::backend().softmax_cross_entropy(
+                u_values, classes.data(), r.outer, r.reduce, r.inner, loss.data(), lse.data()
+            );
+            double total = 0.0;
+            for (int i = 0; i < n; i++) {
+                total += loss[i];
+            }
+            data(w)[0] = total / n;
         }
 
-        Tensor matmul(const Tensor& u, const Tensor& v) {
-            Shape w_shape = Shape({u.shape()[0], v.shape()[1]});
-            Tensor w(w_shape);
-            std::vector<float> w_values = w.values();
-            std::vector<float> u_values = u.values();
-            std::vector<float> v_values = v.values();
-            Shape u_shape = u.shape();
-            Shape v_shape = v.shape();
-            #pragma omp parallel for
-            for (int i = 0; i < w_shape[0]; i++) {
-                for (int k = 0; k < u_shape[1]; k++) {
-                    for (int j = 0; j < w_shape[1]; j++) {
-                        w_values[i * w_shape[1] + j] += u_values[i * u_shape[1] + k] * v_values[k * v_shape[1] + j];
-                    }
-                }
+        void softmax_cross_entropy_backward_fn(const Tensor& w) {
+            assert((int)w.edges().size() == 2);
+            Tensor u = w.edges()[0];
+            if (!u.requires_grad()) {
+                return;
             }
-            w.values() = w_values;
+            Reduction r = reduction(u.shape(), 1 << w.attributes().axis);
+            const Indices& classes = w.data()->saved_indices;
+            Values scratch;
+            const float* u_values = dense(u, scratch);
+            BackendUtill::backend().softmax_cross_entropy_backward(
+                u_values, classes.data(), w.data()->saved_values.data(), r.outer, r.reduce, r.inner,
+                grad_data(w)[0] / classes.size(), grad_data(u)
+            );
+        }
+
+        Tensor matmul(const Tensor& u, const Tensor& v) {
+            Tensor w(Shape({u.shape()[0], v.shape()[1]}));
+            matmul_forward_fn(w, {u, v});
             w.add_edge(u), w.add_edge(v);
             return w;
         }
 
+        void matmul_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& u = inputs[0];
+            const Tensor& v = inputs[1];
+            const Shape& w_shape = w.shape();
+            bool u_trans, v_trans;
+            int u_ld, v_ld;
+            DType u_type, v_type;
+            Values u_scratch, v_scratch;
+            const void* u_values = matrix(u, u_trans, u_ld, u_type, u_scratch);
+            const void* v_values = matrix(v, v_trans, v_ld, v_type, v_scratch);
+            BackendUtill::backend().gemm(
+                u_trans, v_trans, w_shape[0], w_shape[1], u.shape()[1],
+                1.0f, u_values, u_type, u_ld, v_values, v_type, v_ld, 0.0f, data(w), w_shape[1]
+            );
+        }
+
         void matmul_backward_fn(const Tensor& w) {
             assert((int)w.edges().size() == 2);
             Tensor u = w.edges()[0];
             Tensor v = w.edges()[1];
-            std::vector<float> u_values = u.values();
-            std::vector<float> v_values = v.values();
-            std::vector<float> w_grads = w.grads();
-            std::vector<float> u_grads = u.grads();
-            std::vector<float> v_grads = v.grads();
-            Shape w_shape = w.shape();
-            Shape u_shape = u.shape();
-            Shape v_shape = v.shape();
-            #pragma omp parallel for
-            for (int i = 0; i < w_shape[0]; i++) {
-                for (int k = 0; k < u_shape[1]; k++) {
-                    for (int j = 0; j < w_shape[1]; j++) {
-                        u_grads[i * u_shape[1] + k] += (
-                            w_grads[i * w_shape[1] + j] * 
-                            v_values[k * v_shape[1] + j]
-                        );
-                        v_grads[k * v_shape[1] + j] += (
-                            w_grads[i * w_shape[1] + j] * 
-                            u_values[i * u_shape[1] + k]
-                        );
-                    }
-                }
+            int m = w.shape()[0], n = w.shape()[1], k = u.shape()[1];
+            bool u_trans, v_trans;
+            int u_ld, v_ld;
+            DType u_type, v_type;
+            Values u_scratch, v_scratch;
+            // du = dw * v^T, accumulated into the gradient of u
+            if (u.requires_grad()) {
+                const void* v_values = matrix(v, v_trans, v_ld, v_type, v_scratch);
+                BackendUtill::backend().gemm(
+                    false, !v_trans, m, k, n,
+                    1.0f, grad_data(w), DType::Float32, n, v_values, v_type, v_ld, 1.0f, grad_data(u), k
+                );
+            }
+            // dv = u^T * dw, accumulated into the gradient of v
+            if (v.requires_grad()) {
+                const void* u_values = matrix(u, u_trans, u_ld, u_type, u_scratch);
+                BackendUtill::backend().gemm(
+                    !u_trans, false, k, n, m,
+                    1.0f, u_values, u_type, u_ld, grad_data(w), DType::Float32, n, 1.0f, grad_data(v), n
+                );
             }
-            u.grads() = u_grads;
-            v.grads() = v_grads;
         }
-    }
 
-    std::random_device Tensor::rd = std::random_device();
-    std::mt19937 Tensor::rng = std::mt19937(rd());
-    std::vector<float> Tensor::random_vector(int n, int in_degree) {
-        std::vector<float> r(n);
-        std::normal_distribution<float> he_dist(0.0f, std::sqrt(2.0f / in_degree));
-        for (int i = 0; i < n; i++) {
-            r[i] = he_dist(rng);
+        Tensor linear(const Tensor& x, const Tensor& weights, const Tensor& bias, Activation activation, Layout layout) {
+            bool batch_first = layout == Layout::BatchFirst;
+            int features = weights.shape()[0], batch = x.shape()[batch_first ? 0 : 1];
+            Tensor w(batch_first ? Shape({batch, features}) : Shape({features, batch}));
+            w.attributes().activation = activation;
+            w.attributes().layout = layout;
+            linear_forward_fn(w, {x, weights, bias});
+            w.add_edge(x), w.add_edge(weights), w.add_edge(bias);
+            return w;
         }
-        return r;
-    }
 
-    Tensor::Tensor(float value) : _data(std::make_shared<Node>(value)) {}
-    Tensor::Tensor(Shape shape, float value) : _data(std::make_shared<Node>(shape, value)) {}
-    Tensor::Tensor(Shape shape, Values values) : _data(std::make_shared<Node>(shape, values)) {}
+        void linear_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& x = inputs[0];
+            const Tensor& weights = inputs[1];
+            const Tensor& bias = inputs[2];
+            Activation activation = w.attributes().activation;
+            bool batch_first = w.attributes().layout == Layout::BatchFirst;
+            int features = weights.shape()[0], batch = x.shape()[batch_first ? 0 : 1];
+            bool x_trans, weights_trans;
+            int x_ld, weights_ld;
+            DType x_type, weights_type;
+            Values x_scratch, weights_scratch, bias_scratch;
+            const void* x_values = matrix(x, x_trans, x_ld, x_type, x_scratch);
+            const void* weights_values = matrix(weights, weights_trans, weights_ld, weights_type, weights_scratch);
+            const float* bias_values = dense(bias, bias_scratch);
+            if (batch_first) {
+                // x * weights^T, the bias is added along rows
+                BackendUtill::backend().linear(
+                    activation, x_trans, !weights_trans, batch, features, x.shape()[1], 
+                    x_values, x_type, x_ld, weights_values, weights_type, weights_ld, bias_values, 1, data(w), features
+                );
+            } else {
+                BackendUtill::backend().linear(
+                    activation, weights_trans, x_trans, features, batch, x.shape()[0], 
+                    weights_values, weights_type, weights_ld, x_values, x_type, x_ld, bias_values, 0, data(w), batch
+                );
+            }
+        }
 
-    Tensor Tensor::from_csv(const std::string& filename) {
-        std::ifstream file(filename);
-        assert(file.is_open());
-        std::vector<std::vector<float>> rows;
-        std::string line;    
-        while (std::getline(file, line)) {
-            std::stringstream ss(line);
-            std::string s;
-            std::vector<float> row;
-            while (std::getline(ss, s, ',')) {
-                row.push_back(std::stoi(s));
+        void linear_backward_fn(const Tensor& w) {
+            assert((int)w.edges().size() == 3);
+            Tensor x = w.edges()[0];
+            Tensor weights = w.edges()[1];
+            Tensor bias = w.edges()[2];
+            Activation activation = w.attributes().activation;
+            bool batch_first = w.attributes().layout == Layout::BatchFirst;
+            int m = w.shape()[0], n = w.shape()[1];
+            int features = weights.shape()[0], in_features = weights.shape()[1], batch = batch_first ? m : n;
+            // dz = dw * activation'(w), the bias gradient is reduced in the same pass
+            Values& z_grad = w.data()->workspace;
+            z_grad.resize((long long)m * n);
+            BackendUtill::backend().linear_backward(
+                activation, m, n, data(w), grad_data(w), z_grad.data(), batch_first ? 1 : 0,
+                bias.requires_grad() ? grad_data(bias) : nullptr
+            );
+            bool x_trans, weights_trans;
+            int x_ld, weights_ld;
+            DType x_type, weights_type;
+            Values x_scratch, weights_scratch;
+            // dweights = dz * x^T, or dz^T * x for BatchFirst
+            if (weights.requires_grad()) {
+                const void* x_values = matrix(x, x_trans, x_ld, x_type, x_scratch);
+                if (batch_first) {
+                    BackendUtill::backend().gemm(
+                        true, x_trans, features, in_features, batch,
+                        1.0f, z_grad.data(), DType::Float32, n, x_values, x_type, x_ld, 1.0f, grad_data(weights), in_features
+                    );
+                } else {
+                    BackendUtill::backend().gemm(
+                        false, !x_trans, features, in_features, batch,
+                        1.0f, z_grad.data(), DType::Float32, n, x_values, x_type, x_ld, 1.0f, grad_data(weights), in_features
+                    );
+                }
+            }
+            // dx = weights^T * dz, or dz * weights for BatchFirst
+            if (x.requires_grad()) {
+                const void* weights_values = matrix(weights, weights_trans, weights_ld, weights_type, weights_scratch);
+                if (batch_first) {
+                    BackendUtill::backend().gemm(
+                        false, weights_trans, batch, in_features, features,
+                        1.0f, z_grad.data(), DType::Float32, n, weights_values, weights_type, weights_ld, 1.0f, grad_data(x), in_features
+                    );
+                } else {
+                    BackendUtill::backend().gemm(
+                        !weights_trans, false, in_features, batch, features,
+                        1.0f, weights_values, weights_type, weights_ld, z_grad.data(), DType::Float32, n, 1.0f, grad_data(x), batch
+                    );
+                }
             }
-            rows.push_back(row);
         }
-        file.close();
+
+        Tensor view(const Tensor& u, Shape shape, Strides strides, int offset, Strides parent_strides, int parent_offset) {
+            materialize(u);
+            Tensor w(make_pooled<Node>(shape, strides, u.data()->storage, offset));
+            w.requires_grad() = u.requires_grad();
+            w.data()->parent_strides = parent_strides;
+            w.data()->parent_offset = parent_offset;
+            w.add_edge(u);
+            return w;
+        }
+
+        void view_backward_fn(const Tensor& w) {
+            assert((int)w.edges().size() == 1);
+            Tensor u = w.edges()[0];
+            BroadcastUtill::Plan plan = BroadcastUtill::make_plan(w.shape(), {
+                w.data()->parent_strides, ViewUtill::strides_from_shape(w.shape())
+            });
+            BroadcastUtill::elementwise<2>(
+                plan, {grad_data(u) + w.data()->parent_offset, grad_data(w)},
+                [](float& du, float& dw) { du += dw; }
+            );
+        }
+
+        Tensor contiguous(const Tensor& u) {
+            return cast(u, u.dtype());
+        }
+
+        Tensor cast(const Tensor& u, DType dtype) {
+            Tensor w = allocate(u.shape(), dtype);
+            w.requires_grad() = u.requires_grad();
+            contiguous_forward_fn(w, {u});
+            w.add_edge(u);
+            return w;
+        }
+
+        void contiguous_forward_fn(const Tensor& w, const Edges& inputs) {
+            const Tensor& u = inputs[0];
+            HalfUtill::convert(unary_plan(w, u), raw(w), w.dtype(), raw(u), u.dtype());
+        }
+
+        void contiguous_backward_fn(const Tensor& w) {
+            assert((int)w.edges().size() == 1);
+            Tensor u = w.edges()[0];
+            float* u_grad = grad_data(u);
+            const float* w_grad = grad_data(w);
+            for (int i = 0; i < w.size(); i++) {
+                u_grad[i] += w_grad[i];
+            }
+        }
+
+        namespace {
+            /*
+                @return bytes held by the op outputs in the graph of w, other than w itself
+            */
+            long long intermediate_bytes(const Tensor& w) {
+                std::set<Node*> visited = {w.data().get()};
+                std::set<Storage*> storages = {w.data()->storage.get()};
+                std::vector<Node*> stack = {w.data().get()};
+                long long bytes = 0;
+                while (!stack.empty()) {
+                    Node* node = stack.back();
+                    stack.pop_back();
+                    for (const Tensor& edge : node->edges) {
+                        Node* child = edge.data().get();
+                        if (child->edges.empty() || !visited.insert(child).second) {
+                            continue;
+                        }
+                        if (storages.insert(child->storage.get()).second) {
+                            bytes += child->storage->values.size() * sizeof(float) + child->storage->halves.size() * sizeof(Half);
+                        }
+                        bytes += (child->saved_values.size() + child->workspace.size()) * sizeof(float) + (child->saved_indices.size() + child->index_workspace.size()) * sizeof(int);
+                        stack.push_back(child);
+                    }
+                }
+                return bytes;
+            }
+        }
+
+        Tensor checkpoint(const Tensor& x, CheckpointBlock& block) {
+            auto start = std::chrono::steady_clock::now();
+            Tensor y;
+            {
+                NoGradGuard guard;
+                y = block.forward(x);
+            }
+            // the output node of the block is reused unless it shares its node or values with 
+            // something else, e.g. x for a view
+            bool owned = y.data().use_count() == 1 && y.data()->storage.use_count() == 1 && y.is_contiguous() && y.offset() == 0;
+            Tensor w = owned ? y : Tensor(y.shape());
+            if (owned) {
+                Indices().swap(w.data()->saved_indices);
+                Values().swap(w.data()->saved_values);
+                Values().swap(w.data()->workspace);
+                Indices().swap(w.data()->index_workspace);
+            } else {
+                contiguous_forward_fn(w, {y});
+            }
+            w.add_edge(x);
+            for (const Tensor& parameter : block.parameters) {
+                w.add_edge(parameter);
+            }
+            if (!owned && y.has_tangent()) {
+                w.set_tangent(y.tangent());
+            }
+            w.attributes().block = &block;
+            block.stats.forward_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return w;
+        }
+
+        void checkpoint_forward_fn(const Tensor& w, const Edges& inputs) {
+            Tensor y;
+            {
+                NoGradGuard guard;
+                y = w.attributes().block->forward(inputs[0]);
+            }
+            assert(y.shape() == w.shape());
+            contiguous_forward_fn(w, {y});
+        }
+
+        void checkpoint_backward_fn(const Tensor& w) {
+            CheckpointBlock& block = *w.attributes().block;
+            Tensor x = w.edges()[0];
+            auto start = std::chrono::steady_clock::now();
+            Tensor input = alias(x);
+            input.requires_grad() = x.requires_grad();
+            Tensor y = block.forward(input);
+            assert(y.shape() == w.shape());
+            block.stats.recompute_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            block.stats.saved_bytes = intermediate_bytes(y);
+            if (!y.requires_grad()) {
+                return;
+            }
+            y.backward(Tensor(w.shape(), Values(w.data()->grads.begin(), w.data()->grads.end())));
+            if (x.requires_grad() && !input.data()->grads.empty()) {
+                float* x_grad = grad_data(x);
+                const float* input_grad = input.data()->grads.data();
+                for (int i = 0; i < x.size(); i++) {
+                    x_grad[i] += input_grad[i];
+                }
+            }
+        }
+
+        namespace {
+            /*
+                Runs the in place update fn on a float copy of the half precision tensor u 
+                and stores the result back, rounded
+            */
+            template <typename Fn>
+            void through_float(const Tensor& u, Fn fn) {
+                Values scratch;
+                const float* values = dense(u, scratch);
+                Tensor copy(u.shape(), Values(values, values + u.size()));
+                fn(copy);
+                BroadcastUtill::Plan plan = BroadcastUtill::make_plan(u.shape(), {
+                    u.strides(), ViewUtill::strides_from_shape(u.shape())
+                });
+                HalfUtill::convert(plan, raw(u), u.dtype(), data(copy), DType::Float32);
+            }
+        }
+
+        void binary_in_place(const Tensor& u, const Tensor& v, BinaryOp op) {
+            assert(ViewUtill::broadcast_shape(u.shape(), v.shape()) == u.shape());
+            if (u.dtype() != DType::Float32) {
+                through_float(u, [&](const Tensor& copy) { binary_in_place(copy, v, op); });
+                return;
+            }
+            Tensor operand = v;
+            if (v.data()->storage == u.data()->storage || v.dtype() != DType::Float32) {
+                // v may overlap elements of u written before they are read
+                operand = Tensor(v.shape());
+                contiguous_forward_fn(operand, {v});
+            }
+            BroadcastUtill::Plan plan = binary_plan(u, u, operand);
+            if (plan.strides[0][plan.shape.size() - 1] == 1) {
+                BackendUtill::backend().binary(op, plan, data(u), data(u), data(operand));
+                return;
+            }
+            BroadcastUtill::elementwise<3>(plan, {data(u), data(u), data(operand)}, [op](float& w, float& a, float& b) {
+                switch (op) {
+                    case BinaryOp::Add: w = a + b; break;
+                    case BinaryOp::Subtract: w = a - b; break;
+                    case BinaryOp::Multiply: w = a * b; break;
+                    case BinaryOp::Divide: w = a / b; break;
+                }
+            });
+        }
+
+        namespace {
+            template <typename Fn>
+            void map_in_place(const Tensor& u, Fn fn) {
+                if (u.dtype() != DType::Float32) {
+                    through_float(u, [&](const Tensor& copy) { map_in_place(copy, fn); });
+                    return;
+                }
+                BroadcastUtill::Plan plan = BroadcastUtill::make_plan(u.shape(), {u.strides()});
+                BroadcastUtill::elementwise<1>(plan, {data(u)}, [fn](float& a) { a = fn(a); });
+            }
+        }
+
+        void add_in_place(const Tensor& u, float value) {
+            map_in_place(u, [value](float a) { return a + value; });
+        }
+
+        void mul_in_place(const Tensor& u, float value) {
+            map_in_place(u, [value](float a) { return a * value; });
+        }
+
+        void clamp_in_place(const Tensor& u, float min, float max) {
+            assert(min <= max);
+            map_in_place(u, [min, max](float a) { return std::min(std::max(a, min), max); });
+        }
+    }
+
+    namespace {
+        std::atomic<long long> fused_kernels(0);
+        std::atomic<long long> fused_ops(0);
+
+        void count_fused(const FusionUtill::Program& program) {
+            fused_kernels++;
+            fused_ops += program.ops();
+        }
+    }
+
+    namespace TensorUtill {
+        namespace {
+            /*
+                Fused op under construction: the expressions of pending operands are copied 
+                in, every other operand is loaded as an input
+            */
+            struct Expression {
+                FusionUtill::Program program;
+                Edges inputs;
+
+                /*
+                    @return index of u among the inputs, -1 if there is no room for it
+                */
+                int input(const Tensor& u) {
+                    for (int i = 0; i < (int)inputs.size(); i++) {
+                        if (inputs[i].data() == u.data()) {
+                            return i;
+                        }
+                    }
+                    if ((int)inputs.size() == FusionUtill::MAX_INPUTS) {
+                        return -1;
+                    }
+                    inputs.push_back(u);
+                    return program.inputs++;
+                }
+
+                /*
+                    @return register of the new instruction, -1 if the program is full
+                */
+                int emit(FusionUtill::Code code, int a, int b = 0) {
+                    if (a < 0 || b < 0 || program.size == FusionUtill::MAX_INSTRUCTIONS) {
+                        return -1;
+                    }
+                    program.instructions[program.size] = {code, a, b};
+                    return program.size++;
+                }
+
+                /*
+                    @return register holding the values of u, -1 if it does not fit
+                */
+                int operand(const Tensor& u, bool inline_pending) {
+                    if (!inline_pending || !u.data()->pending || u.attributes().program->reduce) {
+                        return emit(FusionUtill::Code::Load, input(u));
+                    }
+                    const FusionUtill::Program& other = *u.attributes().program;
+                    int base = program.size;
+                    for (int k = 0; k < other.size; k++) {
+                        FusionUtill::Instruction in = other.instructions[k];
+                        if (in.code == FusionUtill::Code::Load) {
+                            in.a = input(u.edges()[in.a]);
+                        } else {
+                            in.a += base, in.b += base;
+                        }
+                        if (emit(in.code, in.a, in.b) < 0) {
+                            return -1;
+                        }
+                    }
+                    return program.size - 1;
+                }
+            };
+
+            /*
+                @return a pending output of the expression, whose inputs are recorded as
+                edges even without a graph since its values are computed from them
+            */
+            Tensor pending(const Expression& e, const Shape& shape) {
+                Tensor w(make_pooled<Node>(
+                    shape, ViewUtill::strides_from_shape(shape), make_pooled<Storage>(Values()), 0
+                ));
+                w.data()->pending = true;
+                w.attributes().program = make_pooled<FusionUtill::Program>(e.program);
+                for (const Tensor& input : e.inputs) {
+                    if (NoGradGuard::active()) {
+                        w.data()->requires_grad = false;
+                        w.edges().push_back(input);
+                    } else {
+                        w.add_edge(input);
+                    }
+                }
+                return w;
+            }
+
+            /*
+                @return shape over which the expression of w is evaluated, that of w unless
+                it is reduced
+            */
+            Shape expression_shape(const Edges& inputs) {
+                Shape shape = inputs[0].shape();
+                for (const Tensor& input : inputs) {
+                    shape = ViewUtill::broadcast_shape(shape, input.shape());
+                }
+                return shape;
+            }
+        }
+
+        Tensor fuse(const Tensor& u, const Tensor& v, BinaryOp op) {
+            Shape shape = ViewUtill::broadcast_shape(u.shape(), v.shape());
+            for (bool inline_pending : {true, false}) {
+                Expression e;
+                int a = e.operand(u, inline_pending);
+                int b = u.data() == v.data() ? a : e.operand(v, inline_pending);
+                if (e.emit(FusionUtill::code(op), a, b) >= 0) {
+                    return pending(e, shape);
+                }
+            }
+            assert(false);
+            return Tensor();
+        }
+
+        Tensor fuse(const Tensor& u, UnaryOp op) {
+            for (bool inline_pending : {true, false}) {
+                Expression e;
+                if (e.emit(FusionUtill::code(op), e.operand(u, inline_pending)) >= 0) {
+                    return pending(e, u.shape());
+                }
+            }
+            assert(false);
+            return Tensor();
+        }
+
+        Tensor fuse_sum(const Tensor& u, bool keepdim) {
+            assert(u.data()->pending && !u.attributes().program->reduce);
+            Expression e;
+            e.program = *u.attributes().program;
+            e.program.reduce = true;
+            e.inputs = u.edges();
+            return pending(e, reduced_shape(u.shape(), axes_mask(u.shape(), {}), keepdim));
+        }
+
+        void fused_forward_fn(const Tensor& w, const Edges& inputs) {
+            const FusionUtill::Program& program = *w.attributes().program;
+            int n = inputs.size();
+            Values& values = w.data()->storage->values;
+            if (values.empty()) {
+                values.resize(w.size());
+            }
+            Shape shape = expression_shape(inputs);
+            BroadcastUtill::Dims strides[FusionUtill::MAX_INPUTS + 1];
+            const void* input_values[FusionUtill::MAX_INPUTS];
+            DType types[FusionUtill::MAX_INPUTS];
+            strides[0] = BroadcastUtill::broadcast_strides(w.shape(), w.strides(), shape);
+            for (int i = 0; i < n; i++) {
+                strides[i + 1] = BroadcastUtill::broadcast_strides(inputs[i].shape(), inputs[i].strides(), shape);
+                input_values[i] = raw(inputs[i]);
+                types[i] = inputs[i].dtype();
+            }
+            BroadcastUtill::Plan plan = BroadcastUtill::make_plan(shape, strides, n + 1);
+            // not data(w), which would materialize w again
+            FusionUtill::forward(program, plan, values.data() + w.offset(), input_values, types);
+            count_fused(program);
+        }
+
+        void fused_backward_fn(const Tensor& w) {
+            // the values stay readable once the graph is released
+            materialize(w);
+            const FusionUtill::Program& program = *w.attributes().program;
+            const Edges& inputs = w.edges();
+            int n = inputs.size();
+            Shape shape = expression_shape(inputs);
+            int size = ViewUtill::shape_size(shape);
+            BroadcastUtill::Dims strides[2 * FusionUtill::MAX_INPUTS + 1];
+            const void* input_values[FusionUtill::MAX_INPUTS];
+            DType types[FusionUtill::MAX_INPUTS];
+            float* input_grads[FusionUtill::MAX_INPUTS];
+            // threads write disjoint gradient elements unless a gradient is broadcast
+            bool parallel = size >= BroadcastUtill::PARALLEL_THRESHOLD;
+            strides[0] = BroadcastUtill::broadcast_strides(w.shape(), ViewUtill::strides_from_shape(w.shape()), shape);
+            for (int i = 0; i < n; i++) {
+                const Tensor& x = inputs[i];
+                strides[i + 1] = BroadcastUtill::broadcast_strides(x.shape(), x.strides(), shape);
+                strides[n + i + 1] = BroadcastUtill::broadcast_strides(x.shape(), ViewUtill::strides_from_shape(x.shape()), shape);
+                input_values[i] = raw(x);
+                types[i] = x.dtype();
+                input_grads[i] = x.requires_grad() ? grad_data(x) : nullptr;
+                parallel &= !x.requires_grad() || x.size() == size;
+            }
+            BroadcastUtill::Plan plan = BroadcastUtill::make_plan(shape, strides, 2 * n + 1);
+            FusionUtill::backward(program, plan, grad_data(w), input_values, types, input_grads, parallel);
+            count_fused(program);
+        }
+
+        void materialize(const Tensor& u) {
+            Node* node = u.data().get();
+            if (!node->pending) {
+                return;
+            }
+            fused_forward_fn(u, u.edges());
+            node->pending = false;
+            if (u.op() == Op::None) {
+                // no graph was recorded, the inputs were only kept for the values
+                Edges().swap(node->edges);
+                node->attributes.program.reset();
+            }
+        }
+    }
+
+    namespace TensorUtill {
+        namespace {
+            // indexed by Op
+            const OpInfo OP_TABLE[] = {
+                {"none", nullptr, nullptr, nullptr, 0, false},
+                {"addition", addition_forward_fn, addition_backward_fn, addition_jvp_fn, 0, false},
+                {"subtraction", subtraction_forward_fn, subtraction_backward_fn, subtraction_jvp_fn, 0, false},
+                {"multiplication", multiplication_forward_fn, multiplication_backward_fn, multiplication_jvp_fn, 0b11, false},
+                {"division", division_forward_fn, division_backward_fn, division_jvp_fn, 0b11, false},
+                {"sum", sum_forward_fn, sum_backward_fn, sum_jvp_fn, 0, false},
+                {"max", max_forward_fn, max_backward_fn, max_jvp_fn, 0, false},
+                {"exp", exp_forward_fn, exp_backward_fn, exp_jvp_fn, 0, true},
+                {"log", log_forward_fn, log_backward_fn, log_jvp_fn, 0b1, false},
+                {"relu", relu_forward_fn, relu_backward_fn, relu_jvp_fn, 0b1, true},
+                {"sigmoid", sigmoid_forward_fn, sigmoid_backward_fn, sigmoid_jvp_fn, 0, true},
+                {"tanh", tanh_forward_fn, tanh_backward_fn, tanh_jvp_fn, 0, true},
+                {"softmax", softmax_forward_fn, softmax_backward_fn, softmax_jvp_fn, 0, true},
+                {"log_softmax", log_softmax_forward_fn, log_softmax_backward_fn, log_softmax_jvp_fn, 0, true},
+                {"softmax_cross_entropy", softmax_cross_entropy_forward_fn, softmax_cross_entropy_backward_fn, softmax_cross_entropy_jvp_fn, 0b11, false},
+                {"matmul", matmul_forward_fn, matmul_backward_fn, matmul_jvp_fn, 0b11, false},
+                {"linear", linear_forward_fn, linear_backward_fn, linear_jvp_fn, 0b11, true},
+                {"view", nullptr, view_backward_fn, view_jvp_fn, 0, false},
+                {"contiguous", contiguous_forward_fn, contiguous_backward_fn, contiguous_jvp_fn, 0, false},
+                {"checkpoint", checkpoint_forward_fn, checkpoint_backward_fn, nullptr, ALL_INPUTS, false},
+                {"fused", fused_forward_fn, fused_backward_fn, nullptr, ALL_INPUTS, false},
+                {"cast", contiguous_forward_fn, contiguous_backward_fn, contiguous_jvp_fn, 0, false}
+            };
+            static_assert(sizeof(OP_TABLE) / sizeof(OpInfo) == (int)Op::Cast + 1);
+        }
+
+        const OpInfo& op_info(Op op) {
+            return OP_TABLE[(int)op];
+        }
+
+        unsigned long long read_version(const Tensor& w) {
+            const OpInfo& info = op_info(w.op());
+            unsigned long long version = info.saved_output ? w.data()->storage->version : 0;
+            for (int i = 0; i < (int)w.edges().size(); i++) {
+                if (info.saved_inputs == ALL_INPUTS || (i < 31 && info.saved_inputs >> i & 1)) {
+                    version += w.edges()[i].data()->storage->version;
+                }
+            }
+            return version;
+        }
+
+        void save_version(const Tensor& w) {
+            w.data()->saved_version = read_version(w);
+        }
+    }
+
+    namespace {
+        thread_local bool no_grad = false;
+        thread_local bool forward_mode = false;
+        thread_local bool lazy = false;
+
+        /*
+            Computes the tangent of an op output in forward mode, the ops doing so get no
+            tangents of their own
+        */
+        void propagate_tangent(Tensor& w, Op op) {
+            JvpFn jvp_fn = TensorUtill::op_info(op).jvp_fn;
+            bool tangents = false;
+            for (const Tensor& edge : w.edges()) {
+                tangents |= edge.has_tangent();
+            }
+            if (!jvp_fn || !tangents) {
+                return;
+            }
+            forward_mode = false;
+            Tensor tangent = jvp_fn(w);
+            forward_mode = true;
+            if (tangent.data()) {
+                w.set_tangent(tangent);
+            }
+        }
+
+        /*
+            Records the op of an output, unless no graph is recorded
+        */
+        void set_op(Tensor& w, Op op) {
+            if (forward_mode) {
+                propagate_tangent(w, op);
+            }
+            if (!no_grad) {
+                w.op() = op;
+                TensorUtill::save_version(w);
+            } else if (forward_mode) {
+                Edges().swap(w.edges());
+            }
+        }
+
+        bool is_half(const Tensor& u) {
+            return u.dtype() != DType::Float32;
+        }
+
+        /*
+            Elementwise ops are fused under a LazyGuard, and whenever an input has a half
+            type since the fused kernel converts it on load. Tangents are only computed by 
+            the unfused ops, which read half inputs through a cast.
+        */
+        bool fusing(const Tensor& u) {
+            return !forward_mode && (lazy || is_half(u));
+        }
+
+        bool fusing(const Tensor& u, const Tensor& v) {
+            return !forward_mode && (lazy || is_half(u) || is_half(v));
+        }
+
+        Tensor widen(const Tensor& u) {
+            return is_half(u) ? u.to(DType::Float32) : u;
+        }
+
+        Tensor fused(Tensor w) {
+            set_op(w, Op::Fused);
+            return w;
+        }
+    }
+
+    NoGradGuard::NoGradGuard() : previous(no_grad) {
+        no_grad = true;
+    }
+
+    NoGradGuard::~NoGradGuard() {
+        no_grad = previous;
+    }
+
+    bool NoGradGuard::active() {
+        return no_grad;
+    }
+
+    ForwardModeGuard::ForwardModeGuard() : previous(forward_mode) {
+        forward_mode = true;
+    }
+
+    ForwardModeGuard::~ForwardModeGuard() {
+        forward_mode = previous;
+    }
+
+    bool ForwardModeGuard::active() {
+        return forward_mode;
+    }
+
+    LazyGuard::LazyGuard() : previous(lazy) {
+        lazy = true;
+    }
+
+    LazyGuard::~LazyGuard() {
+        lazy = previous;
+    }
+
+    bool LazyGuard::active() {
+        return lazy;
+    }
+
+    FusionStats LazyGuard::stats() {
+        FusionStats stats;
+        stats.kernels = fused_kernels;
+        stats.ops = fused_ops;
+        stats.passes_saved = stats.ops - stats.kernels;
+        return stats;
+    }
+
+    void LazyGuard::reset_stats() {
+        fused_kernels = 0;
+        fused_ops = 0;
+    }
+
+    std::random_device Tensor::rd = std::random_device();
+    std::mt19937 Tensor::rng = std::mt19937(rd());
+    Values Tensor::random_vector(int n, int in_degree) {
+        Values r(n);
+        std::normal_distribution<float> he_dist(0.0f, std::sqrt(2.0f / in_degree));
+        for (int i = 0; i < n; i++) {
+            r[i] = he_dist(rng);
+        }
+        return r;
+    }
+
+    Tensor::Tensor(float value) : _data(make_pooled<Node>(value)) {}
+    Tensor::Tensor(Shape shape, float value) : _data(make_pooled<Node>(std::move(shape), value)) {}
+    Tensor::Tensor(Shape shape, Values values) : _data(make_pooled<Node>(std::move(shape), std::move(values))) {}
+    Tensor::Tensor(const Data& data) : _data(data) {}
+
+    Tensor Tensor::from_csv(const std::string& filename) {
+        std::ifstream file(filename);
+        assert(file.is_open());
+        std::vector<std::vector<float>> rows;
+        std::string line;    
+        while (std::getline(file, line)) {
+            std::stringstream ss(line);
+            std::string s;
+            std::vector<float> row;
+            while (std::getline(ss, s, ',')) {
+                row.push_back(std::stoi(s));
+            }
+            rows.push_back(row);
+        }
+        file.close();
         for (int i = 1; i < (int)rows.size(); i++) {
             assert(rows[i].size() == rows[0].size());
         }
-        std::vector<float> values;
+        Values values;
         for (int i = 0; i < (int)rows.size(); i++) {
             for (auto value : rows[i]) {
                 values.push_back(value);
             }
         }
-        return Tensor(Shape({(int)rows.size(), (int)rows[0].size()}), values);
+        Tensor tensor(Shape({(int)rows.size(), (int)rows[0].size()}), values);
+        tensor.requires_grad() = false;
+        return tensor;
     }
 
     Tensor Tensor::random(Shape shape, int in_degree) {
@@ -548,81 +1570,247 @@ namespace RevGrad {
     const Data& Tensor::data() const { return _data; }
 
     Tensor Tensor::clone() {
-        Tensor tensor;
-        tensor.values() = values();
-        tensor.shape() = shape();
-        tensor.strides() = strides();
-        tensor.grads() = grads();
-        tensor.edges() = edges();
-        tensor.backward_fn() = backward_fn();
+        TensorUtill::materialize(*this);
+        Tensor tensor(make_pooled<Node>(*_data));
+        tensor._data->storage = make_pooled<Storage>(*_data->storage);
         return tensor;
     }
 
-    Values& Tensor::values() { return _data->values; }
-    const Values& Tensor::values() const { return _data->values; }
+    Values& Tensor::values() { 
+        TensorUtill::materialize(*this);
+        assert(dtype() == DType::Float32);
+        return _data->storage->values; 
+    }
+    const Values& Tensor::values() const { 
+        TensorUtill::materialize(*this);
+        assert(dtype() == DType::Float32);
+        return _data->storage->values; 
+    }
+    Halves& Tensor::halves() { 
+        assert(dtype() != DType::Float32);
+        return _data->storage->halves; 
+    }
+    const Halves& Tensor::halves() const { 
+        assert(dtype() != DType::Float32);
+        return _data->storage->halves; 
+    }
+    DType Tensor::dtype() const { return _data->storage->dtype; }
+    int Tensor::offset() const { return _data->offset; }
     Shape& Tensor::shape() { return _data->shape; }
     const Shape& Tensor::shape() const { return _data->shape; }
     Strides& Tensor::strides() { return _data->strides; }
     const Strides& Tensor::strides() const { return _data->strides; }
-    Gradients& Tensor::grads() { return _data->grads; }
-    const Gradients& Tensor::grads() const { return _data->grads; }
+    Gradients& Tensor::grads() { 
+        if (_data->grads.empty()) {
+            _data->grads.assign(size(), 0.0f);
+        }
+        return _data->grads; 
+    }
+
+    const Gradients& Tensor::grads() const { 
+        if (_data->grads.empty()) {
+            _data->grads.assign(size(), 0.0f);
+        }
+        return _data->grads; 
+    }
     Edges& Tensor::edges() { return _data->edges; }
     const Edges& Tensor::edges() const { return _data->edges; }
-    BackwardFn& Tensor::backward_fn() { return _data->backward_fn; }
-    const BackwardFn& Tensor::backward_fn() const { return _data->backward_fn; }
-    MetaData& Tensor::meta_data() { return _data->meta_data; }
-    const MetaData& Tensor::meta_data() const { return _data->meta_data; }
+    Op& Tensor::op() { return _data->op; }
+    Op Tensor::op() const { return _data->op; }
+    ForwardFn Tensor::forward_fn() const { return TensorUtill::op_info(_data->op).forward_fn; }
+    BackwardFn Tensor::backward_fn() const { 
+        return _data->requires_grad ? TensorUtill::op_info(_data->op).backward_fn : nullptr; 
+    }
+    OpAttributes& Tensor::attributes() { return _data->attributes; }
+    const OpAttributes& Tensor::attributes() const { return _data->attributes; }
+    bool& Tensor::requires_grad() { return _data->requires_grad; }
+    bool Tensor::requires_grad() const { return _data->requires_grad; }
+    bool Tensor::has_tangent() const { return (bool)_data->tangent; }
+
+    Tensor Tensor::tangent() const {
+        assert(has_tangent());
+        return Tensor(_data->tangent);
+    }
+
+    void Tensor::set_tangent(const Tensor& tangent) {
+        assert(tangent.shape() == shape());
+        _data->tangent = tangent.data();
+    }
+
+    void Tensor::clear_tangent() { _data->tangent.reset(); }
 
     float& Tensor::value(const Indices& indices) {
-        return values()[ViewUtill::ravel(indices, strides())];
+        return values()[offset() + ViewUtill::ravel(indices, strides())];
     }
     const float& Tensor::value(const std::vector<int>& indices) const {
-        return values()[ViewUtill::ravel(indices, strides())];
+        return values()[offset() + ViewUtill::ravel(indices, strides())];
     }
+
+    namespace {
+        // gradients are always dense in the shape of their tensor
+        int grad_offset(const Indices& indices, const Shape& shape) {
+            int offset = 0;
+            for (int i = (int)shape.size() - 1, stride = 1; i >= 0; i--) {
+                if (i < (int)indices.size()) {
+                    offset += indices[i] * stride;
+                }
+                stride *= shape[i];
+            }
+            return offset;
+        }
+    }
+
     float& Tensor::grad(const Indices& indices) {
-        return grads()[ViewUtill::ravel(indices, strides())];
+        return grads()[grad_offset(indices, shape())];
     }
     const float& Tensor::grad(const std::vector<int>& indices) const {
-        return grads()[ViewUtill::ravel(indices, strides())];
+        return grads()[grad_offset(indices, shape())];
     }
 
-    void Tensor::add_edge(const Tensor& tensor) { _data->edges.push_back(tensor); }
+    namespace {
+        // bumped whenever a node that has been part of a backward pass gains an edge, 
+        // which invalidates the cached topological order. Atomic because checkpoint
+        // backward functions build and run graphs on several threads of a parallel backward.
+        std::atomic<unsigned long long> graph_generation(0);
+    }
+
+    void Tensor::add_edge(const Tensor& tensor) { 
+        if (no_grad) {
+            _data->requires_grad = false;
+            if (forward_mode) {
+                // read by set_op for the tangent, then dropped
+                _data->edges.push_back(tensor);
+            }
+            return;
+        }
+        if (_data->visit_epoch) {
+            graph_generation++;
+        }
+        // the first edge makes this tensor an op output, which requires gradients if
+        // any of its inputs does
+        _data->requires_grad = (!_data->edges.empty() && _data->requires_grad) || tensor.requires_grad();
+        _data->edges.push_back(tensor); 
+    }
 
     bool Tensor::operator<(const Tensor& other) const { return _data < other._data; }
     
     Tensor operator+(const Tensor& u, const Tensor& v) {
-        Tensor w = TensorUtill::addition(u, v);
-        w.backward_fn() = TensorUtill::addition_backward_fn;
+        if (fusing(u, v)) {
+            return fused(TensorUtill::fuse(u, v, BinaryOp::Add));
+        }
+        Tensor w = TensorUtill::addition(widen(u), widen(v));
+        set_op(w, Op::Addition);
         return w;
     }
 
     Tensor operator-(const Tensor& u, const Tensor& v) {
-        Tensor w = TensorUtill::subtraction(u, v);
-        w.backward_fn() = TensorUtill::subtraction_backward_fn;
+        if (fusing(u, v)) {
+            return fused(TensorUtill::fuse(u, v, BinaryOp::Subtract));
+        }
+        Tensor w = TensorUtill::subtraction(widen(u), widen(v));
+        set_op(w, Op::Subtraction);
         return w;
     }
 
     Tensor operator*(const Tensor& u, const Tensor& v) {
-        Tensor w = TensorUtill::multiplication(u, v);
-        w.backward_fn() = TensorUtill::multiplication_backward_fn;
+        if (fusing(u, v)) {
+            return fused(TensorUtill::fuse(u, v, BinaryOp::Multiply));
+        }
+        Tensor w = TensorUtill::multiplication(widen(u), widen(v));
+        set_op(w, Op::Multiplication);
         return w;
     }
 
     Tensor operator/(const Tensor& u, const Tensor& v) {
-        Tensor w = TensorUtill::division(u, v);
-        w.backward_fn() = TensorUtill::division_backward_fn;
+        if (fusing(u, v)) {
+            return fused(TensorUtill::fuse(u, v, BinaryOp::Divide));
+        }
+        Tensor w = TensorUtill::division(widen(u), widen(v));
+        set_op(w, Op::Division);
         return w;
     }
 
-    Tensor& Tensor::operator+=(const Tensor& other) { return *this = *this + other; }
-    Tensor& Tensor::operator-=(const Tensor& other) { return *this = *this - other; }
-    Tensor& Tensor::operator*=(const Tensor& other) { return *this = *this * other; }
-    Tensor& Tensor::operator/=(const Tensor& other) { return *this = *this / other; }
+    namespace {
+        /*
+            In place writes record no graph, so they throw on tensors that take part in a 
+            recorded graph; writes to tensors that are only read are caught by the version 
+            check of the backward
+        */
+        void check_in_place(const Tensor& u) {
+            if (!no_grad && u.requires_grad()) {
+                throw std::runtime_error(
+                    "in place op on a tensor that requires gradients while the graph is recorded, "
+                    "use a NoGradGuard for parameter updates"
+                );
+            }
+        }
+    }
+
+    Tensor& Tensor::operator+=(const Tensor& other) {
+        check_in_place(*this);
+        TensorUtill::binary_in_place(*this, other, BinaryOp::Add);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::operator-=(const Tensor& other) {
+        check_in_place(*this);
+        TensorUtill::binary_in_place(*this, other, BinaryOp::Subtract);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::operator*=(const Tensor& other) {
+        check_in_place(*this);
+        TensorUtill::binary_in_place(*this, other, BinaryOp::Multiply);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::operator/=(const Tensor& other) {
+        check_in_place(*this);
+        TensorUtill::binary_in_place(*this, other, BinaryOp::Divide);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::add_(float value) {
+        check_in_place(*this);
+        TensorUtill::add_in_place(*this, value);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::mul_(float value) {
+        check_in_place(*this);
+        TensorUtill::mul_in_place(*this, value);
+        bump_version();
+        return *this;
+    }
+
+    Tensor& Tensor::clamp_(float min, float max) {
+        check_in_place(*this);
+        TensorUtill::clamp_in_place(*this, min, max);
+        bump_version();
+        return *this;
+    }
+
+    unsigned long long Tensor::version() const { return _data->storage->version; }
+    void Tensor::bump_version() { _data->storage->version++; }
+
     Tensor Tensor::operator-() const { return Tensor() - *this; }
 
     Tensor Tensor::sum(const Tensor& u, int axis) {
-        Tensor w = TensorUtill::sum(u, axis);
-        w.backward_fn() = TensorUtill::sum_backward_fn;
+        assert(axis >= -1 && axis < (int)u.shape().size());
+        return Tensor::sum(u, axis == -1 ? Axes() : Axes({axis}));
+    }
+
+    Tensor Tensor::sum(const Tensor& u, const Axes& axes, bool keepdim) {
+        if (lazy && !forward_mode && axes.empty() && u.data()->pending && !u.attributes().program->reduce) {
+            return fused(TensorUtill::fuse_sum(u, keepdim));
+        }
+        Tensor w = TensorUtill::sum(u, axes, keepdim);
+        set_op(w, Op::Sum);
         return w;
     }
 
@@ -631,47 +1819,78 @@ namespace RevGrad {
     }
 
     Tensor Tensor::max(const Tensor& u, int axis) {
-        assert(axis >= 0 && axis < (int)u.shape().size());
-        Tensor w = TensorUtill::max(u, axis);
-        w.backward_fn() = TensorUtill::max_backward_fn;
+        assert(axis >= -1 && axis < (int)u.shape().size());
+        return Tensor::max(u, axis == -1 ? Axes() : Axes({axis}));
+    }
+
+    Tensor Tensor::max(const Tensor& u, const Axes& axes, bool keepdim) {
+        Tensor w = TensorUtill::max(u, axes, keepdim);
+        set_op(w, Op::Max);
         return w;
     }
 
     Tensor Tensor::exp(const Tensor& u) {
-        Tensor w = TensorUtill::exp(u);
-        w.backward_fn() = TensorUtill::exp_backward_fn;
+        if (fusing(u)) {
+            return fused(TensorUtill::fuse(u, UnaryOp::Exp));
+        }
+        Tensor w = TensorUtill::exp(widen(u));
+        set_op(w, Op::Exp);
         return w;
     }
 
     Tensor Tensor::log(const Tensor& u) {
-        Tensor w = TensorUtill::log(u);
-        w.backward_fn() = TensorUtill::log_backward_fn;
+        if (fusing(u)) {
+            return fused(TensorUtill::fuse(u, UnaryOp::Log));
+        }
+        Tensor w = TensorUtill::log(widen(u));
+        set_op(w, Op::Log);
         return w;
     }
 
     Tensor Tensor::relu(const Tensor& u) {
-        Tensor w = TensorUtill::relu(u);
-        w.backward_fn() = TensorUtill::relu_backward_fn;
+        if (fusing(u)) {
+            return fused(TensorUtill::fuse(u, UnaryOp::Relu));
+        }
+        Tensor w = TensorUtill::relu(widen(u));
+        set_op(w, Op::Relu);
         return w;
     }
     
     Tensor Tensor::sigmoid(const Tensor& u) {
-        Tensor w = TensorUtill::sigmoid(u);
-        w.backward_fn() = TensorUtill::sigmoid_backward_fn;
+        if (fusing(u)) {
+            return fused(TensorUtill::fuse(u, UnaryOp::Sigmoid));
+        }
+        Tensor w = TensorUtill::sigmoid(widen(u));
+        set_op(w, Op::Sigmoid);
         return w;
     }
 
-    Tensor Tensor::softmax(const Tensor& u) {
-        assert((int)u.shape().size() == 2); // {features, batch_size}
-        Tensor w = TensorUtill::softmax(u);
-        w.backward_fn() = TensorUtill::softmax_backward_fn;
+    Tensor Tensor::tanh(const Tensor& u) {
+        if (fusing(u)) {
+            return fused(TensorUtill::fuse(u, UnaryOp::Tanh));
+        }
+        Tensor w = TensorUtill::tanh(widen(u));
+        set_op(w, Op::Tanh);
+        return w;
+    }
+
+    Tensor Tensor::softmax(const Tensor& u, int axis) {
+        assert(0 <= axis && axis < (int)u.shape().size());
+        Tensor w = TensorUtill::softmax(u, axis);
+        set_op(w, Op::Softmax);
         return w;
     }
 
-    Tensor Tensor::log_softmax(const Tensor& u) {
-        assert((int)u.shape().size() == 2); // {features, batch_size}
-        Tensor w = TensorUtill::log_softmax(u);
-        w.backward_fn() = TensorUtill::log_softmax_backward_fn;
+    Tensor Tensor::log_softmax(const Tensor& u, int axis) {
+        assert(0 <= axis && axis < (int)u.shape().size());
+        Tensor w = TensorUtill::log_softmax(u, axis);
+        set_op(w, Op::LogSoftmax);
+        return w;
+    }
+
+    Tensor Tensor::softmax_cross_entropy(const Tensor& u, const Tensor& labels, int axis) {
+        Tensor w = TensorUtill::softmax_cross_entropy(u, labels, axis);
+        set_op(w, Op::SoftmaxCrossEntropy);
         return w;
     }
 
@@ -679,7 +1898,22 @@ namespace RevGrad {
         assert((int)u.shape().size() == 2 && (int)v.shape().size() == 2);
         assert(u.shape()[1] == v.shape()[0]);
         Tensor w = TensorUtill::matmul(u, v);
-        w.backward_fn() = TensorUtill::matmul_backward_fn;
+        set_op(w, Op::Matmul);
+        return w;
+    }
+
+    Tensor Tensor::linear(const Tensor& x, const Tensor& weights, const Tensor& bias, Activation activation, Layout layout) {
+        assert((int)x.shape().size() == 2 && (int)weights.shape().size() == 2);
+        assert(weights.shape()[1] == x.shape()[layout == Layout::BatchFirst ? 1 : 0]);
+        assert(bias.size() == weights.shape()[0]);
+        Tensor w = TensorUtill::linear(x, weights, bias, activation, layout);
+        set_op(w, Op::Linear);
+        return w;
+    }
+
+    Tensor Tensor::checkpoint(const Tensor& x, CheckpointBlock& block) {
+        Tensor w = TensorUtill::checkpoint(x, block);
+        set_op(w, Op::Checkpoint);
         return w;
     }
 
@@ -687,96 +1921,625 @@ namespace RevGrad {
         return ViewUtill::shape_size(shape());
     }
 
-    void Tensor::reshape(const Shape& shape) {
-        this->shape() = shape;
-        strides() = ViewUtill::strides_from_shape(this->shape());
+    bool Tensor::is_contiguous() const {
+        return ViewUtill::is_contiguous(shape(), strides());
+    }
+
+    Tensor Tensor::contiguous() const {
+        int stored = dtype() == DType::Float32 ? values().size() : halves().size();
+        if (is_contiguous() && offset() == 0 && stored == size()) {
+            return *this;
+        }
+        Tensor w = TensorUtill::contiguous(*this);
+        set_op(w, Op::Contiguous);
+        return w;
+    }
+
+    Tensor Tensor::to(DType dtype) const {
+        if (dtype == this->dtype()) {
+            return contiguous();
+        }
+        Tensor w = TensorUtill::cast(*this, dtype);
+        set_op(w, Op::Cast);
+        return w;
+    }
+
+    Tensor Tensor::reshape(const Shape& shape) const {
+        assert(ViewUtill::shape_size(shape) == size());
+        if (!is_contiguous()) {
+            return contiguous().reshape(shape);
+        }
+        Strides strides = ViewUtill::strides_from_shape(shape);
+        Tensor w = TensorUtill::view(*this, shape, strides, offset(), strides, 0);
+        set_op(w, Op::View);
+        return w;
     }
 
-    void Tensor::flatten() {
-        Shape shape({size()});
-        this->shape() = shape;
-        strides() = ViewUtill::strides_from_shape(this->shape());
+    Tensor Tensor::flatten() const {
+        return reshape(Shape({size()}));
     }
 
-    void Tensor::transpose() {
+    Tensor Tensor::transpose() const {
         assert((int)this->shape().size() == 2);
         Shape shape = {this->shape()[1], this->shape()[0]};
-        int n = size();
-        Values values(n);
-        Gradients grads(n);
-        Strides strides = ViewUtill::strides_from_shape(shape);
-        for (int i = 0; i < this->shape()[0]; i++) {
-            for (int j = 0; j < this->shape()[1]; j++) {
-                float value =this->values()[i * this->strides()[0] + j * this->strides()[1]];
-                float grad =this->grads()[i * this->strides()[0] + j * this->strides()[1]];
-                values[j * strides[0] + i * strides[1]] = value;
-                grads[j * strides[0] + i * strides[1]] = grad;
-            }
-        }
-        this->shape() = shape;
-        this->values() = values;
-        this->grads() = grads;
-        this->strides() = strides;
+        Strides strides = {this->strides()[1], this->strides()[0]};
+        Strides grad_strides = ViewUtill::strides_from_shape(this->shape());
+        std::swap(grad_strides[0], grad_strides[1]);
+        Tensor w = TensorUtill::view(*this, shape, strides, offset(), grad_strides, 0);
+        set_op(w, Op::View);
+        return w;
     }
 
     Tensor Tensor::slice(const std::vector<std::pair<int, int>>& ranges) const {
         int n = this->shape().size();
         assert(n == (int)ranges.size());
         Shape shape(n);
+        Indices start_indices(n);
         for (int i = 0; i < n; i++) {
             auto [start, end] = ranges[i];
             assert(start < this->shape()[i] && end <= this->shape()[i] && start < end);
             shape[i] = end - start;
+            start_indices[i] = start;
         }
-        Tensor tensor(shape);
-        int size = tensor.size();
-        for (int i = 0; i < size; i++) {
-            Indices indices = ViewUtill::unravel(i, tensor.shape(), tensor.strides());
-            for (int j = 0; j < n; j++) {
-                auto [start, _] = ranges[j];
-                indices[j] += start;
+        Strides grad_strides = ViewUtill::strides_from_shape(this->shape());
+        Tensor w = TensorUtill::view(
+            *this, shape, strides(), offset() + ViewUtill::ravel(start_indices, strides()), 
+            grad_strides, ViewUtill::ravel(start_indices, grad_strides)
+        );
+        set_op(w, Op::View);
+        return w;
+    }
+
+    namespace TensorUtill {
+        namespace {
+            Tensor zero_tangent() {
+                return Tensor(Data());
+            }
+
+            Tensor tangent_of(const Tensor& u) {
+                return u.has_tangent() ? u.tangent() : zero_tangent();
+            }
+
+            Tensor constant(const Shape& shape, Values values) {
+                Tensor c(shape, std::move(values));
+                c.requires_grad() = false;
+                return c;
+            }
+
+            Tensor constant(float value) {
+                return constant(Shape({1}), Values(1, value));
+            }
+
+            /*
+                @return a + b, where null tangents are zero
+            */
+            Tensor add_tangents(const Tensor& a, const Tensor& b) {
+                if (!a.data()) {
+                    return b;
+                }
+                return b.data() ? a + b : a;
+            }
+
+            /*
+                @return t broadcast to shape, for tangents of inputs broadcast by their op
+            */
+            Tensor expand(const Tensor& t, const Shape& shape) {
+                if (!t.data() || t.shape() == shape) {
+                    return t;
+                }
+                return t + constant(shape, Values(ViewUtill::shape_size(shape), 0.0f));
+            }
+
+            /*
+                @return 1 where u > 0 and 0 elsewhere, in the shape of u
+            */
+            Tensor positive(const Tensor& u) {
+                Values mask(u.size());
+                Values scratch;
+                const float* u_values = dense(u, scratch);
+                for (int i = 0; i < u.size(); i++) {
+                    mask[i] = u_values[i] > 0.0f;
+                }
+                return constant(u.shape(), std::move(mask));
+            }
+
+            Axes axes_of(int mask, int dims) {
+                Axes axes;
+                for (int k = 0; k < dims; k++) {
+                    if (mask >> k & 1) {
+                        axes.push_back(k);
+                    }
+                }
+                return axes;
+            }
+
+            /*
+                Sums t over the axes w reduced from u
+            */
+            Tensor reduce_like(const Tensor& w, const Tensor& u, const Tensor& t) {
+                int dims = u.shape().size();
+                bool keepdim = (int)w.shape().size() == dims && dims > 1;
+                return Tensor::sum(t, axes_of(w.attributes().axes, dims), keepdim);
             }
-            tensor.values()[i] = value(indices);
         }
-        return tensor;
+
+        Tensor addition_jvp_fn(const Tensor& w) {
+            return expand(add_tangents(tangent_of(w.edges()[0]), tangent_of(w.edges()[1])), w.shape());
+        }
+
+        Tensor subtraction_jvp_fn(const Tensor& w) {
+            Tensor tu = tangent_of(w.edges()[0]), tv = tangent_of(w.edges()[1]);
+            return expand(tu.data() ? (tv.data() ? tu - tv : tu) : -tv, w.shape());
+        }
+
+        Tensor multiplication_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            const Tensor& v = w.edges()[1];
+            Tensor tu = tangent_of(u), tv = tangent_of(v);
+            return expand(add_tangents(tu.data() ? tu * v : tu, tv.data() ? u * tv : tv), w.shape());
+        }
+
+        Tensor division_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            const Tensor& v = w.edges()[1];
+            Tensor tu = tangent_of(u), tv = tangent_of(v);
+            // (tu - w * tv) / v
+            Tensor numerator = tv.data() ? (tu.data() ? tu - w * tv : -(w * tv)) : tu;
+            return expand(numerator / v, w.shape());
+        }
+
+        Tensor sum_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            return reduce_like(w, u, u.tangent());
+        }
+
+        Tensor max_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            // the tangent of the maximum, averaged over ties like the gradient
+            const Indices& saved = w.data()->saved_indices;
+            int n = w.size();
+            std::vector<int> count(n, 1);
+            for (int p = n; p < (int)saved.size(); p += 2) {
+                count[saved[p]]++;
+            }
+            Values weights(u.size(), 0.0f);
+            for (int i = 0; i < n; i++) {
+                weights[saved[i]] = 1.0f / count[i];
+            }
+            for (int p = n; p < (int)saved.size(); p += 2) {
+                weights[saved[p + 1]] = 1.0f / count[saved[p]];
+            }
+            return reduce_like(w, u, u.tangent() * constant(u.shape(), std::move(weights)));
+        }
+
+        Tensor exp_jvp_fn(const Tensor& w) {
+            return w.edges()[0].tangent() * w;
+        }
+
+        Tensor log_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            return u.tangent() / u;
+        }
+
+        Tensor relu_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            return u.tangent() * positive(u);
+        }
+
+        Tensor sigmoid_jvp_fn(const Tensor& w) {
+            return w.edges()[0].tangent() * (w * (constant(1.0f) - w));
+        }
+
+        Tensor tanh_jvp_fn(const Tensor& w) {
+            return w.edges()[0].tangent() * (constant(1.0f) - w * w);
+        }
+
+        Tensor softmax_jvp_fn(const Tensor& w) {
+            Tensor tu = w.edges()[0].tangent();
+            return w * (tu - Tensor::sum(w * tu, Axes{w.attributes().axis}, true));
+        }
+
+        Tensor log_softmax_jvp_fn(const Tensor& w) {
+            Tensor tu = w.edges()[0].tangent();
+            return tu - Tensor::sum(Tensor::exp(w) * tu, Axes{w.attributes().axis}, true);
+        }
+
+        Tensor softmax_cross_entropy_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            if (!u.has_tangent()) {
+                return zero_tangent();
+            }
+            // mean over the samples of (softmax(u) - one_hot(labels)) . tu
+            int axis = w.attributes().axis;
+            Reduction r = reduction(u.shape(), 1 << axis);
+            const Indices& classes = w.data()->saved_indices;
+            Values one_hot(u.size(), 0.0f);
+            for (int i = 0; i < r.outer * r.inner; i++) {
+                int o = i / r.inner, j = i % r.inner;
+                one_hot[(o * r.reduce + classes[i]) * r.inner + j] = 1.0f;
+            }
+            Tensor error = Tensor::softmax(u, axis) - constant(u.shape(), std::move(one_hot));
+            return Tensor::sum(error * u.tangent()) / constant(float(r.outer * r.inner));
+        }
+
+        Tensor matmul_jvp_fn(const Tensor& w) {
+            const Tensor& u = w.edges()[0];
+            const Tensor& v = w.edges()[1];
+            Tensor tu = tangent_of(u), tv = tangent_of(v);
+            return add_tangents(tu.data() ? Tensor::matmul(tu, v) : tu, tv.data() ? Tensor::matmul(u, tv) : tv);
+        }
+
+        Tensor linear_jvp_fn(const Tensor& w) {
+            const Tensor& x = w.edges()[0];
+            const Tensor& weights = w.edges()[1];
+            const Tensor& bias = w.edges()[2];
+            Tensor tx = tangent_of(x), tweights = tangent_of(weights), tbias = tangent_of(bias);
+            bool batch_first = w.attributes().layout == Layout::BatchFirst;
+            int features = weights.shape()[0];
+            // tangent of the product before the activation
+            Tensor tz = zero_tangent();
+            if (batch_first) {
+                tz = add_tangents(tx.data() ? Tensor::matmul(tx, weights.transpose()) : tx, 
+                    tweights.data() ? Tensor::matmul(x, tweights.transpose()) : tweights);
+                tz = add_tangents(tz, tbias.data() ? tbias.reshape(Shape({1, features})) : tbias);
+            } else {
+                tz = add_tangents(tx.data() ? Tensor::matmul(weights, tx) : tx, 
+                    tweights.data() ? Tensor::matmul(tweights, x) : tweights);
+                tz = add_tangents(tz, tbias.data() ? tbias.reshape(Shape({features, 1})) : tbias);
+            }
+            tz = expand(tz, w.shape());
+            switch (w.attributes().activation) {
+                case Activation::None: return tz;
+                case Activation::Relu: return tz * positive(w);
+                case Activation::Sigmoid: return tz * (w * (constant(1.0f) - w));
+                case Activation::Tanh: return tz * (constant(1.0f) - w * w);
+            }
+            return tz;
+        }
+
+        Tensor view_jvp_fn(const Tensor& w) {
+            // the same view of the dense tangent of the parent, as for its gradient
+            Tensor tu = w.edges()[0].tangent().contiguous();
+            const Strides& strides = w.data()->parent_strides;
+            int offset = w.data()->parent_offset;
+            Tensor tw = view(tu, w.shape(), strides, offset, strides, offset);
+            set_op(tw, Op::View);
+            return tw;
+        }
+
+        Tensor contiguous_jvp_fn(const Tensor& w) {
+            return w.edges()[0].tangent();
+        }
     }
 
-    void Tensor::backward() {
-        grads() = std::vector<float>(grads().size(), 1.0f);
-        std::map<Tensor, std::vector<Tensor>> adj;
-        std::queue<Tensor> Q;
-        Q.push(*this);
-        std::set<Tensor> S;
-        while (!Q.empty()) {
-            Tensor u = Q.front();
-            Q.pop();
-            if (S.count(u)) {
-                continue;
+    Tensor Tensor::jvp(const Function& f, const std::vector<Tensor>& inputs, const std::vector<Tensor>& tangents) {
+        assert(inputs.size() == tangents.size());
+        std::vector<Tensor> duals;
+        for (int i = 0; i < (int)inputs.size(); i++) {
+            duals.push_back(alias(inputs[i]));
+            duals[i].requires_grad() = false;
+            duals[i].set_tangent(tangents[i]);
+        }
+        NoGradGuard no_grad;
+        ForwardModeGuard forward_mode;
+        return f(duals);
+    }
+
+    std::vector<Tensor> Tensor::hvp(const Function& f, const std::vector<Tensor>& inputs, const std::vector<Tensor>& vectors) {
+        assert(inputs.size() == vectors.size());
+        std::vector<Tensor> duals;
+        for (int i = 0; i < (int)inputs.size(); i++) {
+            duals.push_back(alias(inputs[i]));
+            // a constant copy, so that the backward pass leaves the vectors alone
+            Tensor vector(vectors[i].shape());
+            TensorUtill::contiguous_forward_fn(vector, {vectors[i]});
+            vector.requires_grad() = false;
+            duals[i].set_tangent(vector);
+        }
+        Tensor y;
+        {
+            ForwardModeGuard forward_mode;
+            y = f(duals);
+        }
+        assert(y.size() == 1);
+        if (y.has_tangent() && y.tangent().requires_grad()) {
+            y.tangent().backward();
+        }
+        std::vector<Tensor> products;
+        for (Tensor& dual : duals) {
+            products.push_back(TensorUtill::constant(dual.shape(), dual.grads()));
+        }
+        return products;
+    }
+
+    namespace {
+        // shared by all engines, so that nested passes never mark nodes with a live epoch
+        std::atomic<unsigned long long> last_epoch(0);
+
+        /*
+            Scratch buffers of the backward pass, kept across calls so that a training step 
+            does not allocate, and the order of the last graph
+        */
+        struct BackwardEngine {
+            unsigned long long epoch = 0;
+            std::vector<std::pair<Node*, int>> stack; // node and index of its next edge
+            std::vector<Node*> order; // post-order, the root last
+            std::weak_ptr<Node> root;
+            unsigned long long generation = 0;
+            std::vector<Data> held; // keeps unprocessed nodes alive while the graph is released
+            BackwardStats stats;
+            BackwardScheduler scheduler = BackwardScheduler::Auto;
+            // dependencies of the parallel scheduler, for the cached order
+            bool planned = false;
+            std::vector<int> dependency_count; // by position in order
+            std::vector<std::vector<int>> dependents;
+            long long mean_size = 0; // mean number of elements of the op outputs
+
+            /*
+                Iterative depth first search from root, marking visited nodes with the
+                current epoch instead of collecting them in a set
+            */
+            void sort(Node* root_node) {
+                epoch = ++last_epoch;
+                order.clear();
+                planned = false;
+                root_node->visit_epoch = epoch;
+                stack.push_back({root_node, 0});
+                while (!stack.empty()) {
+                    auto& [node, next] = stack.back();
+                    if (next == (int)node->edges.size()) {
+                        order.push_back(node);
+                        stack.pop_back();
+                        continue;
+                    }
+                    Node* child = node->edges[next++].data().get();
+                    if (child->visit_epoch != epoch) {
+                        child->visit_epoch = epoch;
+                        stack.push_back({child, 0});
+                    }
+                }
+            }
+
+            /*
+                Node i of the order may run once the last node before it in the serial order
+                (decreasing positions) that writes its gradient is done, i.e. all of its
+                consumers, and so is the previous writer of every gradient it writes. Writers
+                of each gradient thus run one at a time in the serial order.
+            */
+            void plan() {
+                int n = order.size();
+                std::unordered_map<Node*, int> last_writer;
+                dependency_count.assign(n, 0);
+                dependents.resize(n);
+                for (auto& d : dependents) {
+                    d.clear();
+                }
+                long long total = 0;
+                int ops = 0;
+                auto depend = [&](int i, Node* node) {
+                    auto it = last_writer.find(node);
+                    if (it != last_writer.end() && (dependents[it->second].empty() || dependents[it->second].back() != i)) {
+                        dependents[it->second].push_back(i);
+                        dependency_count[i]++;
+                    }
+                };
+                for (int i = n - 1; i >= 0; i--) {
+                    Node* node = order[i];
+                    depend(i, node);
+                    if (node->op == Op::None || !node->requires_grad) {
+                        continue;
+                    }
+                    total += ViewUtill::shape_size(node->shape), ops++;
+                    for (const Tensor& edge : node->edges) {
+                        depend(i, edge.data().get());
+                    }
+                    for (const Tensor& edge : node->edges) {
+                        last_writer[edge.data().get()] = i;
+                    }
+                }
+                mean_size = ops ? total / ops : 0;
+                planned = true;
+            }
+
+            bool use_parallel() {
+                int threads = omp_get_max_threads();
+                if (scheduler == BackwardScheduler::Serial || threads == 1 || omp_in_parallel()) {
+                    return false;
+                }
+                if (scheduler == BackwardScheduler::Parallel) {
+                    return true;
+                }
+                if ((int)order.size() < 4 * threads) {
+                    return false;
+                }
+                if (!planned) {
+                    plan();
+                }
+                return mean_size < BroadcastUtill::PARALLEL_THRESHOLD;
             }
-            S.insert(u);
-            for (Tensor v : u.edges()) {
-                adj[u].push_back(v);
-                Q.push(v);
+
+            /*
+                Drops what a processed node holds for the backward pass: its edges, which frees 
+                the inputs nothing else references, saved buffers and, for op outputs other 
+                than the root, its gradient
+            */
+            static void release(Node* node, bool is_root) {
+                if (!node->edges.empty() && !is_root) {
+                    Gradients().swap(node->grads);
+                }
+                Edges().swap(node->edges);
+                node->op = Op::None;
+                Indices().swap(node->saved_indices);
+                Values().swap(node->saved_values);
+                Values().swap(node->workspace);
+                Indices().swap(node->index_workspace);
             }
+        };
+
+        BackwardEngine& engine() {
+            static BackwardEngine engine;
+            return engine;
+        }
+
+        // set while the shared engine runs, backward functions that run a backward pass of
+        // their own, e.g. checkpoint, then get a scratch engine
+        std::atomic<bool> engine_running(false);
+
+        double seconds_since(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    void Tensor::backward(bool retain_graph) {
+        run_backward(nullptr, retain_graph);
+    }
+
+    void Tensor::backward(const Tensor& gradient, bool retain_graph) {
+        assert(gradient.shape() == shape());
+        run_backward(&gradient, retain_graph);
+    }
+
+    void Tensor::run_backward(const Tensor* gradient, bool retain_graph) {
+        auto start = std::chrono::steady_clock::now();
+        bool nested = engine_running.exchange(true);
+        std::unique_ptr<BackwardEngine> scratch;
+        if (nested) {
+            scratch = std::make_unique<BackwardEngine>();
+            scratch->scheduler = engine().scheduler;
         }
-        S.clear();
-        std::vector<Tensor> order;
-        std::function<void(Tensor)> topsort;
-        topsort = [&topsort, &adj, &S, &order] (Tensor u) -> void {
-            S.insert(u);
-            for (auto v : adj[u]) {
-                if (!S.count(v)) {
-                    topsort(v);
+        BackwardEngine& e = nested ? *scratch : engine();
+        struct Finish {
+            bool nested;
+            ~Finish() {
+                if (!nested) {
+                    engine_running = false;
                 }
             }
-            order.push_back(u);
+        } finish = {nested};
+        if (gradient) {
+            NoGradGuard guard;
+            Tensor seed = gradient->contiguous();
+            std::copy(seed.values().begin() + seed.offset(), seed.values().begin() + seed.offset() + size(), grads().begin());
+        } else {
+            std::fill(grads().begin(), grads().end(), 1.0f);
+        }
+        unsigned long long generation = graph_generation.load();
+        bool cached = e.root.lock() == _data && e.generation == generation;
+        if (!cached) {
+            e.sort(_data.get());
+            e.root = _data;
+            e.generation = generation;
+        }
+        for (Node* node : e.order) {
+            if (node->op != Op::None && node->requires_grad && node->saved_version != TensorUtill::read_version(Tensor(node->shared_from_this()))) {
+                throw std::runtime_error(
+                    std::string("backward: an input or output of ") + TensorUtill::op_info(node->op).name + 
+                    " was modified in place after it was recorded"
+                );
+            }
+        }
+        if (!retain_graph) {
+            e.held.clear();
+            for (Node* node : e.order) {
+                e.held.push_back(node->shared_from_this());
+            }
+        }
+        auto run = [&](int i, double& kernel_seconds) {
+            Node* node = e.order[i];
+            // nodes without a gradient buffer received no gradient, so they pass none on
+            BackwardFn backward_fn = TensorUtill::op_info(node->op).backward_fn;
+            if (backward_fn && node->requires_grad && !node->grads.empty()) {
+                auto kernel_start = std::chrono::steady_clock::now();
+                backward_fn(Tensor(node->shared_from_this()));
+                kernel_seconds += seconds_since(kernel_start);
+            }
+            // every consumer of the node has run, so nothing reads it any more
+            if (!retain_graph) {
+                BackwardEngine::release(node, node == _data.get());
+                e.held[i].reset();
+            }
         };
-        topsort(*this);
-        std::reverse(order.begin(), order.end());
-        for (Tensor u : order) {
-            if (u.backward_fn()) {
-                u.backward_fn()(u);
+        double kernel_seconds = 0.0;
+        bool parallel = e.use_parallel();
+        if (!parallel) {
+            for (int i = (int)e.order.size() - 1; i >= 0; i--) {
+                run(i, kernel_seconds);
+            }
+        } else {
+            if (!e.planned) {
+                e.plan();
             }
+            int n = e.order.size(), done = 0;
+            std::vector<int> remaining = e.dependency_count;
+            std::vector<int> ready;
+            for (int i = n - 1; i >= 0; i--) {
+                if (remaining[i] == 0) {
+                    ready.push_back(i);
+                }
+            }
+            std::mutex mutex;
+            std::condition_variable wake;
+            // an exception must not leave the parallel region, the first one stops the
+            // scheduling and is rethrown after the join
+            std::exception_ptr error;
+            #pragma omp parallel reduction(+:kernel_seconds)
+            {
+                while (true) {
+                    int i;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock, [&] { return !ready.empty() || done == n || error; });
+                        if (ready.empty()) {
+                            break;
+                        }
+                        i = ready.back();
+                        ready.pop_back();
+                    }
+                    std::exception_ptr failure;
+                    try {
+                        run(i, kernel_seconds);
+                    } catch (...) {
+                        failure = std::current_exception();
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        done++;
+                        if (failure && !error) {
+                            error = failure;
+                        }
+                        if (error) {
+                            ready.clear();
+                        } else {
+                            for (int j : e.dependents[i]) {
+                                if (--remaining[j] == 0) {
+                                    ready.push_back(j);
+                                }
+                            }
+                        }
+                    }
+                    wake.notify_all();
+                }
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        e.stats.nodes = e.order.size();
+        e.stats.cached_order = cached;
+        e.stats.parallel = parallel;
+        if (!retain_graph) {
+            e.order.clear();
+            e.root.reset();
         }
+        e.stats.kernel_seconds = kernel_seconds;
+        e.stats.engine_seconds = seconds_since(start) - kernel_seconds;
+    }
+
+    const BackwardStats& Tensor::backward_stats() {
+        return engine().stats;
+    }
+
+    void Tensor::set_backward_scheduler(BackwardScheduler scheduler) {
+        engine().scheduler = scheduler;
     }
 }
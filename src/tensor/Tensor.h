@@ -15,133 +15,556 @@
 #include <queue>
 #include <set>
 #include <map>
+#include <chrono>
 #include <omp.h>
 
+#include "../backend/Backend.h"
+#include "../kernel/Half.h"
+#include "../memory/Allocator.h"
+
 namespace RevGrad {
+    class Storage;
     class Node;
     class TensorData;
     class Tensor;
+    struct CheckpointBlock;
+
+    namespace FusionUtill {
+        struct Program;
+    }
 
-    typedef std::vector<float> Values;
-    typedef std::vector<float> Gradients;
+    typedef std::vector<float, PoolAllocator<float>> Values; // tensor buffers come from the allocator cache
+    typedef std::vector<float, PoolAllocator<float>> Gradients; // float whatever the type of the values
+    typedef std::vector<Half, PoolAllocator<Half>> Halves;
     typedef std::vector<int> Shape;
     typedef std::vector<int> Strides;
     typedef std::vector<int> Indices;
+    typedef std::vector<int> Axes;
     typedef std::shared_ptr<Node> Data;
-    typedef std::vector<Tensor> Edges;
-    typedef std::function<void(const Tensor&)> BackwardFn;
-    typedef std::map<std::string, int> MetaData;
+    typedef std::vector<Tensor, ObjectAllocator<Tensor>> Edges;
+    typedef void (*BackwardFn)(const Tensor& w);
+    typedef void (*ForwardFn)(const Tensor& w, const Edges& inputs); // recomputes w from its inputs
+    typedef Tensor (*JvpFn)(const Tensor& w); // tangent of w from the tangents of its inputs
+
+    /*
+        Arrangement of a batch of samples in a 2 dimensional tensor:
+        FeaturesFirst is (features, batch size), BatchFirst is (batch size, features)
+        with one sample per row, as data sets are usually stored
+    */
+    enum class Layout { FeaturesFirst, BatchFirst };
+
+    /*
+        Op that produced a node, None for leaves. Its forward and backward functions are
+        looked up in a table (TensorUtill::op_info) instead of being stored in every node.
+    */
+    enum class Op {
+        None, Addition, Subtraction, Multiplication, Division, Sum, Max, Exp, Log, Relu, Sigmoid, Tanh,
+        Softmax, LogSoftmax, SoftmaxCrossEntropy, Matmul, Linear, View, Contiguous, Checkpoint, Fused, Cast
+    };
+
+    const int ALL_INPUTS = -1; // OpInfo::saved_inputs of ops reading every input
+
+    struct OpInfo {
+        const char* name;
+        ForwardFn forward_fn; // nullptr for views, which share the storage of their input
+        BackwardFn backward_fn;
+        JvpFn jvp_fn; // nullptr for checkpoint, whose block propagates tangents itself, and fused ops
+        int saved_inputs; // mask of the inputs whose values the backward reads, bit i for input i
+        bool saved_output; // the backward reads the values of the output
+    };
+
+    /*
+        Parameters of the op that produced a node, only the ones of its op are set
+    */
+    struct OpAttributes {
+        int axes = 0; // mask of the reduced axes of sum and max
+        int axis = 0; // class axis of the softmax ops
+        Activation activation = Activation::None;
+        Layout layout = Layout::FeaturesFirst;
+        CheckpointBlock* block = nullptr; // recomputed by checkpoint, owned by the caller
+        std::shared_ptr<const FusionUtill::Program> program; // expression of a fused op over its edges
+    };
 
     namespace ViewUtill {
-        int shape_size(Shape shape);
-        Strides strides_from_shape(Shape shape);
+        int shape_size(const Shape& shape);
+        Strides strides_from_shape(const Shape& shape);
         Shape broadcast_shape(const Shape& a, const Shape& b);
         Indices unravel(int index, const Shape& shape, const Strides& strides);
         int ravel(const Indices& indices, const Strides& strides);
         Indices reshape_indices(const Indices& indices, const Shape& shape);
+        bool is_contiguous(const Shape& shape, const Strides& strides);
     }
 
-    class Node {
+    /*
+        Element buffer shared between a tensor and all views of it, values for Float32 and
+        halves for the 16 bit types
+    */
+    class Storage {
         public:
         Values values;
+        Halves halves;
+        DType dtype = DType::Float32;
+        unsigned long long version = 0; // number of in place writes
+        Storage(Values values);
+        Storage(Halves halves, DType dtype);
+    };
+
+    class Node : public std::enable_shared_from_this<Node> {
+        public:
+        std::shared_ptr<Storage> storage;
+        int offset;
         Shape shape;
         Strides strides;
-        Gradients grads;
+        Gradients grads; // empty until the gradient is first written or read
+        Data tangent; // forward mode derivative, null for zero
         Edges edges;
-        BackwardFn backward_fn;
-        MetaData meta_data;
+        Op op;
+        OpAttributes attributes;
+        Strides parent_strides; // position of a view in the gradient of its parent
+        int parent_offset;
+        Indices saved_indices; // computed by the forward for the backward, e.g. argmax
+        Values saved_values;
+        Values workspace; // scratch of the forward or backward, kept so that replays of a captured graph reuse it
+        Indices index_workspace; // the same for indices, e.g. the argmax of max
+        bool requires_grad;
+        bool pending; // output of a lazy fused op whose values are not computed yet
+        unsigned long long saved_version; // sum of the versions of the values its backward reads, when recorded
+        unsigned long long visit_epoch; // last backward pass that visited the node, 0 if none
         Node(float value = 0.0f);
         Node(Shape shape, float value = 0.0f);
         Node(Shape shape, Values values);
+        Node(Shape shape, Strides strides, std::shared_ptr<Storage> storage, int offset);
     };
 
     namespace TensorUtill {
+        const OpInfo& op_info(Op op);
         Tensor addition(const Tensor& u, const Tensor& v);
+        void addition_forward_fn(const Tensor& w, const Edges& inputs);
         void addition_backward_fn(const Tensor& w);
+        Tensor addition_jvp_fn(const Tensor& w);
         Tensor subtraction(const Tensor& u, const Tensor& v);
+        void subtraction_forward_fn(const Tensor& w, const Edges& inputs);
         void subtraction_backward_fn(const Tensor& w);
+        Tensor subtraction_jvp_fn(const Tensor& w);
         Tensor multiplication(const Tensor& u, const Tensor& v);
+        void multiplication_forward_fn(const Tensor& w, const Edges& inputs);
         void multiplication_backward_fn(const Tensor& w);
+        Tensor multiplication_jvp_fn(const Tensor& w);
         Tensor division(const Tensor& u, const Tensor& v);
+        void division_forward_fn(const Tensor& w, const Edges& inputs);
         void division_backward_fn(const Tensor& w);
-        Tensor sum(const Tensor& u, int axis);
+        Tensor division_jvp_fn(const Tensor& w);
+        Tensor sum(const Tensor& u, const Axes& axes, bool keepdim);
+        void sum_forward_fn(const Tensor& w, const Edges& inputs);
         void sum_backward_fn(const Tensor& w);
-        Tensor max(const Tensor& u, int axis);
+        Tensor sum_jvp_fn(const Tensor& w);
+        Tensor max(const Tensor& u, const Axes& axes, bool keepdim);
+        void max_forward_fn(const Tensor& w, const Edges& inputs);
         void max_backward_fn(const Tensor& w);
+        Tensor max_jvp_fn(const Tensor& w);
         Tensor exp(const Tensor& u);
+        void exp_forward_fn(const Tensor& w, const Edges& inputs);
         void exp_backward_fn(const Tensor& w);
+        Tensor exp_jvp_fn(const Tensor& w);
         Tensor log(const Tensor& u);
+        void log_forward_fn(const Tensor& w, const Edges& inputs);
         void log_backward_fn(const Tensor& w);
+        Tensor log_jvp_fn(const Tensor& w);
         Tensor relu(const Tensor& u);
+        void relu_forward_fn(const Tensor& w, const Edges& inputs);
         void relu_backward_fn(const Tensor& w);
+        Tensor relu_jvp_fn(const Tensor& w);
         Tensor sigmoid(const Tensor& u);
+        void sigmoid_forward_fn(const Tensor& w, const Edges& inputs);
         void sigmoid_backward_fn(const Tensor& w);
-        Tensor softmax(const Tensor& u);
+        Tensor sigmoid_jvp_fn(const Tensor& w);
+        Tensor tanh(const Tensor& u);
+        void tanh_forward_fn(const Tensor& w, const Edges& inputs);
+        void tanh_backward_fn(const Tensor& w);
+        Tensor tanh_jvp_fn(const Tensor& w);
+        Tensor softmax(const Tensor& u, int axis);
+        void softmax_forward_fn(const Tensor& w, const Edges& inputs);
         void softmax_backward_fn(const Tensor& w);
-        Tensor log_softmax(const Tensor& u);
+        Tensor softmax_jvp_fn(const Tensor& w);
+        Tensor log_softmax(const Tensor& u, int axis);
+        void log_softmax_forward_fn(const Tensor& w, const Edges& inputs);
         void log_softmax_backward_fn(const Tensor& w);
+        Tensor log_softmax_jvp_fn(const Tensor& w);
+        Tensor softmax_cross_entropy(const Tensor& u, const Tensor& labels, int axis);
+        void softmax_cross_entropy_forward_fn(const Tensor& w, const Edges& inputs);
+        void softmax_cross_entropy_backward_fn(const Tensor& w);
+        Tensor softmax_cross_entropy_jvp_fn(const Tensor& w);
         Tensor matmul(const Tensor& u, const Tensor& v);
+        void matmul_forward_fn(const Tensor& w, const Edges& inputs);
         void matmul_backward_fn(const Tensor& w);
+        Tensor matmul_jvp_fn(const Tensor& w);
+        Tensor linear(const Tensor& x, const Tensor& weights, const Tensor& bias, Activation activation, Layout layout);
+        void linear_forward_fn(const Tensor& w, const Edges& inputs);
+        void linear_backward_fn(const Tensor& w);
+        Tensor linear_jvp_fn(const Tensor& w);
+        Tensor view(const Tensor& u, Shape shape, Strides strides, int offset, Strides parent_strides, int parent_offset);
+        void view_backward_fn(const Tensor& w);
+        Tensor view_jvp_fn(const Tensor& w);
+        Tensor contiguous(const Tensor& u);
+        /*
+            Dense copy of u with elements of type dtype, shares the forward, backward and
+            jvp functions of contiguous
+        */
+        Tensor cast(const Tensor& u, DType dtype);
+        void contiguous_forward_fn(const Tensor& w, const Edges& inputs);
+        void contiguous_backward_fn(const Tensor& w);
+        Tensor contiguous_jvp_fn(const Tensor& w);
+        Tensor checkpoint(const Tensor& x, CheckpointBlock& block);
+        void checkpoint_forward_fn(const Tensor& w, const Edges& inputs);
+        void checkpoint_backward_fn(const Tensor& w);
+        /*
+            Lazy op outputs, see LazyGuard: op applied to u (and v) is appended to the
+            expression of every pending operand, the values are left uncomputed
+        */
+        Tensor fuse(const Tensor& u, const Tensor& v, BinaryOp op);
+        Tensor fuse(const Tensor& u, UnaryOp op);
+        /*
+            Sum over every element of the pending tensor u, computed in the same pass as u
+        */
+        Tensor fuse_sum(const Tensor& u, bool keepdim);
+        void fused_forward_fn(const Tensor& w, const Edges& inputs);
+        void fused_backward_fn(const Tensor& w);
+        /*
+            Computes the values of u if it is pending, every access to them goes through it
+        */
+        void materialize(const Tensor& u);
+        /*
+            Updates the storage of u in place, v is broadcast to the shape of u
+        */
+        void binary_in_place(const Tensor& u, const Tensor& v, BinaryOp op);
+        void add_in_place(const Tensor& u, float value);
+        void mul_in_place(const Tensor& u, float value);
+        void clamp_in_place(const Tensor& u, float min, float max);
+        /*
+            @return sum of the versions of the storages the backward of w reads
+        */
+        unsigned long long read_version(const Tensor& w);
+        /*
+            Records the versions the backward of w will check, when its op is recorded or
+            its values are recomputed
+        */
+        void save_version(const Tensor& w);
     }
 
+    /*
+        While a guard is alive, ops on its thread record no graph: outputs get no edges, no
+        backward function and do not require gradients, so intermediates are freed as soon
+        as they go out of scope. Used for inference, guards nest.
+    */
+    class NoGradGuard {
+        bool previous;
+    public:
+        NoGradGuard();
+        ~NoGradGuard();
+        NoGradGuard(const NoGradGuard&) = delete;
+        NoGradGuard& operator=(const NoGradGuard&) = delete;
+        static bool active();
+    };
+
+    /*
+        While a guard is alive, ops on its thread run in forward mode as well: every output
+        whose inputs have tangents gets the derivative of its values along them as its own
+        tangent, a Jacobian-vector product, computed from the values of the op alone. Inputs
+        without a tangent are constants. Under a NoGradGuard no graph is kept at all, 
+        otherwise tangents are recorded like any op output and can be differentiated in 
+        reverse mode, see Tensor::hvp. Guards nest.
+    */
+    class ForwardModeGuard {
+        bool previous;
+    public:
+        ForwardModeGuard();
+        ~ForwardModeGuard();
+        ForwardModeGuard(const ForwardModeGuard&) = delete;
+        ForwardModeGuard& operator=(const ForwardModeGuard&) = delete;
+        static bool active();
+    };
+
+    /*
+        Work done by fused kernels since the start or the last LazyGuard::reset_stats, 
+        forward and backward. Every op in a fused kernel beyond the first would have been a
+        pass over memory of its own.
+    */
+    struct FusionStats {
+        long long kernels = 0;
+        long long ops = 0;
+        long long passes_saved = 0;
+    };
+
+    /*
+        While a guard is alive, elementwise ops on its thread (+ - * /, exp, log, relu, 
+        sigmoid, tanh, with broadcasting) are not run but recorded in their output, which 
+        stays pending: an op on pending operands extends their expression instead of reading
+        their values, and a sum over every element of a pending tensor becomes part of it
+        too. Values are computed in one pass over the inputs once they are first read, 
+        possibly after the guard is gone, and the backward of the fused node recomputes the 
+        expression on the fly instead of keeping any intermediate. Expressions grow up to 
+        FusionUtill::MAX_INSTRUCTIONS and MAX_INPUTS, longer chains start a new one. Off 
+        in forward mode. Guards nest.
+    */
+    class LazyGuard {
+        bool previous;
+    public:
+        LazyGuard();
+        ~LazyGuard();
+        LazyGuard(const LazyGuard&) = delete;
+        LazyGuard& operator=(const LazyGuard&) = delete;
+        static bool active();
+        static FusionStats stats();
+        static void reset_stats();
+    };
+
+    /*
+        Timing of the last Tensor::backward call. Engine time covers seeding the gradient,
+        ordering the graph and dispatching, kernel time the backward functions themselves.
+    */
+    struct BackwardStats {
+        int nodes = 0;
+        bool cached_order = false; // the topological order of the previous call was reused
+        bool parallel = false; // nodes ran concurrently, kernel time is then summed over threads
+        double engine_seconds = 0.0;
+        double kernel_seconds = 0.0;
+    };
+
+    /*
+        Serial runs the backward functions one after another. Parallel runs every node whose
+        gradient is complete on the OpenMP threads, as long as no unfinished node that comes
+        before it in the serial order writes a gradient it writes too, so every gradient sums
+        its contributions in the serial order and results match the serial pass bit for bit.
+        Auto picks parallel for graphs of many nodes too small to use threads inside their
+        kernels.
+    */
+    enum class BackwardScheduler { Auto, Serial, Parallel };
+
     class Tensor {
         Data _data;
         static std::random_device rd;
         static std::mt19937 rng;
-        static std::vector<float> random_vector(int n, int in_degree);
+        static Values random_vector(int n, int in_degree);
+        void run_backward(const Tensor* gradient, bool retain_graph);
     public:
         Tensor(float value = 0.0f);
         Tensor(Shape shape, float value = 0.0f);
         Tensor(Shape shape, Values values);
+        Tensor(const Data& data);
         static Tensor from_csv(const std::string& filename);
         static Tensor random(Shape shape, int in_degree);
         Tensor clone();
         const Data& data() const;
+        /*
+            @return underlying storage, shared with views; use offset() and strides() 
+            to address it or contiguous() to get a dense tensor. Float32 tensors only.
+        */
         Values& values();
         const Values& values() const;
+        /*
+            @return underlying storage of a BFloat16 or Float16 tensor, addressed like values()
+        */
+        Halves& halves();
+        const Halves& halves() const;
+        /*
+            Half precision is a storage format for leaves, e.g. parameters, which halves
+            their memory and bandwidth. Ops compute in float and their outputs and gradients
+            are Float32, so activations keep the float cost. Matrix products and elementwise
+            ops convert half inputs as they load them, reductions and softmax convert into
+            a float buffer first.
+        */
+        DType dtype() const;
+        /*
+            @return dense copy with elements of type dtype, rounded to nearest even, through
+            which gradients flow back unchanged; contiguous() if already of that type
+        */
+        Tensor to(DType dtype) const;
+        int offset() const;
         Shape& shape();
         const Shape& shape() const;
         Strides& strides();
         const Strides& strides() const;
+        /*
+            @return gradient, allocated as zeros on first use
+        */
         Gradients& grads();
         const Gradients& grads() const;
         Edges& edges();
         const Edges& edges() const;
-        BackwardFn& backward_fn();
-        const BackwardFn& backward_fn() const;
-        MetaData& meta_data();
-        const MetaData& meta_data() const;
+        Op& op();
+        Op op() const;
+        /*
+            @return function recomputing the values of this op output, nullptr for leaves and views
+        */
+        ForwardFn forward_fn() const;
+        /*
+            @return backward function of the op, nullptr for leaves and tensors that need no gradient
+        */
+        BackwardFn backward_fn() const;
+        OpAttributes& attributes();
+        const OpAttributes& attributes() const;
+        /*
+            Backward passes skip gradients of tensors that do not require them, e.g. data batches.
+            Op outputs require gradients when any of their inputs does.
+        */
+        bool& requires_grad();
+        bool requires_grad() const;
+        /*
+            Tangent of this tensor in forward mode, of the same shape, see ForwardModeGuard
+        */
+        bool has_tangent() const;
+        Tensor tangent() const;
+        void set_tangent(const Tensor& tangent);
+        void clear_tangent();
         float& value(const Indices& indices);
         const float& value(const std::vector<int>& indices) const;
         float& grad(const Indices& indices);
         const float& grad(const std::vector<int>& indices) const;
+        /*
+            Records tensor as an input of this op output, a no-op under a NoGradGuard
+        */
         void add_edge(const Tensor& tensor);
         bool operator<(const Tensor& other) const;
         friend Tensor operator+(const Tensor& u, const Tensor& v);
         friend Tensor operator-(const Tensor& u, const Tensor& v);
         friend Tensor operator*(const Tensor& u, const Tensor& v);
         friend Tensor operator/(const Tensor& u, const Tensor& v);
+        /*
+            In place ops write into the storage of this tensor, shared with its views, without
+            allocating and without recording a graph. They are meant for data and, under a
+            NoGradGuard, for parameter updates: tensors that require gradients cannot be
+            written in place while the graph is recorded. Every write bumps the version of
+            the storage, see backward.
+            @param other read as a constant and broadcast to the shape of this tensor
+            @throws std::runtime_error if this tensor requires gradients outside a NoGradGuard
+        */
         Tensor& operator+=(const Tensor& other);
         Tensor& operator-=(const Tensor& other);
         Tensor& operator*=(const Tensor& other);
         Tensor& operator/=(const Tensor& other);
+        Tensor& add_(float value);
+        Tensor& mul_(float value);
+        Tensor& clamp_(float min, float max);
+        /*
+            @return number of in place writes to the storage. Code writing values() directly 
+            calls bump_version, so that graphs which read the old values are rejected.
+        */
+        unsigned long long version() const;
+        void bump_version();
         Tensor operator-() const;
+        /*
+            @param axis axis to reduce, -1 reduces every element
+        */
         static Tensor sum(const Tensor& u, int axis = -1);
+        /*
+            @param axes axes to reduce, all of them when empty
+            @param keepdim keep reduced axes with size 1 instead of removing them
+        */
+        static Tensor sum(const Tensor& u, const Axes& axes, bool keepdim = false);
         static Tensor mean(const Tensor& u);
         static Tensor max(const Tensor& u, int axis = 0);
+        static Tensor max(const Tensor& u, const Axes& axes, bool keepdim = false);
         static Tensor exp(const Tensor& u);
         static Tensor log(const Tensor& u);
         static Tensor relu(const Tensor& u);
         static Tensor sigmoid(const Tensor& u);
-        static Tensor softmax(const Tensor& u);
-        static Tensor log_softmax(const Tensor& u);
+        static Tensor tanh(const Tensor& u);
+        /*
+            @param axis class axis, 0 for (classes, batch size) and 1 for (batch size, classes)
+        */
+        static Tensor softmax(const Tensor& u, int axis = 0);
+        static Tensor log_softmax(const Tensor& u, int axis = 0);
+        /*
+            Mean cross entropy of softmax(u) against class labels, without materializing 
+            the probabilities or one-hot targets
+            @param u logits, classes along axis
+            @param labels class index of every sample, batch size elements
+            @throws std::out_of_range if a label is not a class index
+        */
+        static Tensor softmax_cross_entropy(const Tensor& u, const Tensor& labels, int axis = 0);
         static Tensor matmul(const Tensor& u, const Tensor& v);
+        /*
+            activation(weights * x + bias) as a single node, the bias and activation are 
+            applied to blocks of the product while they are still in cache
+            @param x input of shape (in features, batch size), or (batch size, in features)
+            for BatchFirst which computes x * weights^T + bias without transposing anything
+            @param weights shape (out features, in features)
+            @param bias one value per out feature
+        */
+        static Tensor linear(
+            const Tensor& x, const Tensor& weights, const Tensor& bias, 
+            Activation activation = Activation::None, Layout layout = Layout::FeaturesFirst
+        );
+        /*
+            block.forward(x) as a single node that keeps none of the intermediates of the
+            block: the forward runs without recording a graph and the backward runs it again
+            with one, then propagates the gradient of the output through it. Trades a second
+            forward of the block for its activation memory, see CheckpointStats.
+            @param block must outlive the backward pass
+        */
+        static Tensor checkpoint(const Tensor& x, CheckpointBlock& block);
+        typedef std::function<Tensor(const std::vector<Tensor>& inputs)> Function;
+        /*
+            Jacobian-vector product of f in a single forward mode pass that records no graph
+            @param tangents direction, one tensor of the shape of each input
+            @return f(inputs), with the derivative of f along tangents as its tangent
+        */
+        static Tensor jvp(const Function& f, const std::vector<Tensor>& inputs, const std::vector<Tensor>& tangents);
+        /*
+            Hessian-vector product of a function with a single output: the forward mode 
+            derivative of f along vectors is recorded as a graph, one backward pass from it 
+            gives its gradient H * vectors
+            @return one product per input, with the shape of the input
+        */
+        static std::vector<Tensor> hvp(const Function& f, const std::vector<Tensor>& inputs, const std::vector<Tensor>& vectors);
         int size() const;
-        void reshape(const Shape& shape);
-        void flatten();
-        void transpose();
+        bool is_contiguous() const;
+        /*
+            @return this tensor if it is dense in its storage, otherwise a dense copy
+        */
+        Tensor contiguous() const;
+        /*
+            The views below share storage with this tensor and propagate gradients to it
+        */
+        Tensor reshape(const Shape& shape) const;
+        Tensor flatten() const;
+        Tensor transpose() const;
         Tensor slice(const std::vector<std::pair<int, int>>& ranges) const;
-        void backward();
+        /*
+            Runs the backward functions of every node reachable from this tensor in reverse 
+            topological order. Each node releases its edges, saved buffers and, unless it is 
+            a leaf or this tensor, its gradient as soon as its backward function has run, so 
+            intermediates are freed during the pass and a second call does nothing.
+            @param retain_graph keep the graph for another backward call, the order is then
+            cached and reused while this tensor is alive and no edges are added to the graph
+            @throws std::runtime_error, before running any backward function, if values 
+            read by a backward function were written in place after its op was recorded
+        */
+        void backward(bool retain_graph = false);
+        /*
+            Backward pass seeded with gradient instead of ones, e.g. the gradient of a loss
+            with respect to this tensor
+        */
+        void backward(const Tensor& gradient, bool retain_graph = false);
+        static const BackwardStats& backward_stats();
+        static void set_backward_scheduler(BackwardScheduler scheduler);
+    };
+
+    /*
+        Costs of the last use of a checkpointed block. Saved bytes are the intermediate 
+        buffers the block did not keep from its forward to its backward, the recompute time 
+        is the price paid for them in the backward.
+    */
+    struct CheckpointStats {
+        long long saved_bytes = 0;
+        double forward_seconds = 0.0;
+        double recompute_seconds = 0.0;
+    };
+
+    struct CheckpointBlock {
+        std::function<Tensor(const Tensor& x)> forward;
+        std::vector<Tensor> parameters; // every tensor other than x whose gradient the block computes
+        CheckpointStats stats;
     };
 }
 
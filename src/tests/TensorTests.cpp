@@ -1,7 +1,14 @@
 #include <iostream>
+#include <random>
+#include <thread>
 
 #include "../utill/Print.h"
 #include "../tensor/Tensor.h"
+#include "../backend/Backend.h"
+#include "../kernel/Math.h"
+#include "../graph/StaticGraph.h"
+#include "../model/Model.h"
+#include "../strategy/Strategy.h"
 
 using namespace RevGrad;
 
@@ -26,7 +33,7 @@ void set() {
 
 void flatten() {
     Tensor a(Shape({2, 3}), 5);
-    a.flatten();
+    a = a.flatten();
     if (a.value({0}) != 5 || a.shape() != Shape({6})) {
         throw std::logic_error("flatten FAILED!");
     }
@@ -35,7 +42,7 @@ void flatten() {
 
 void reshape() {
     Tensor a(Shape({2, 3}), 5);
-    a.reshape(Shape({3, 2}));
+    a = a.reshape(Shape({3, 2}));
     if (a.value({0, 0}) != 5 || a.shape() != Shape({3, 2})) {
         throw std::logic_error("reshape FAILED!");
     }
@@ -44,7 +51,7 @@ void reshape() {
 
 void transpose() {
     Tensor a(Shape({2, 3}), {1, 2, 3, 4, 5, 6});
-    a.transpose();
+    a = a.transpose();
     if (
         a.value({0, 1}) != 4 || 
         a.shape() != Shape({3, 2})
@@ -62,7 +69,7 @@ void slice() {
         16, 17, 18, 19, 20,
         21, 22, 23, 24, 25
     });
-    a.transpose();
+    a = a.transpose();
     Tensor b = a.slice({{2, 4}, {1, 3}});
     if (
         b.size() != 4 ||
@@ -77,6 +84,44 @@ void slice() {
     std::cout << "slice PASSED!" << std::endl;
 }
 
+void view() {
+    Tensor a(Shape({3, 4}), {
+        1, 2,  3,  4,
+        5, 6,  7,  8,
+        9, 10, 11, 12
+    });
+    Tensor b = a.slice({{1, 3}, {1, 3}}).transpose();
+    a.value({2, 1}) = 20;
+    Tensor c = b.contiguous();
+    if (
+        b.values().data() != a.values().data() ||
+        b.is_contiguous() ||
+        b.value({0, 1}) != 20 ||
+        !c.is_contiguous() ||
+        c.values() != Values{6, 20, 7, 11}
+    ) {
+        throw std::logic_error("view FAILED!");
+    }
+    std::cout << "view PASSED!" << std::endl;
+}
+
+void view_gradient() {
+    Tensor a(Shape({2, 3}), {1, 2, 3, 4, 5, 6});
+    Tensor s = a.transpose().slice({{1, 3}, {0, 2}});
+    Tensor b = s.reshape(Shape({4}));
+    Tensor c(Shape({4}), {1, 2, 3, 4});
+    Tensor d = Tensor::sum(b * c);
+    d.backward();
+    if (
+        s.values().data() != a.values().data() ||
+        d.value({0}) != 2 * 1 + 5 * 2 + 3 * 3 + 6 * 4 ||
+        a.grads() != Gradients{0, 1, 3, 0, 2, 4}
+    ) {
+        throw std::logic_error("view_gradient FAILED!");
+    }
+    std::cout << "view_gradient PASSED!" << std::endl;
+}
+
 void edges() {
     Tensor a(Shape({2}), 2);
     Tensor b(Shape({2}), 4);
@@ -91,6 +136,628 @@ void edges() {
     std::cout << "edges PASSED!" << std::endl;
 }
 
+void backward_order() {
+    // diamond: d depends on a through both b and c
+    Tensor a(Shape({2}), 3);
+    Tensor b = a * a;
+    Tensor c = a + b;
+    Tensor d = Tensor::sum(b * c);
+    d.backward(true);
+    // d = a^3 + a^4, so d' = 3a^2 + 4a^3
+    Gradients grads = a.grads();
+    bool first = Tensor::backward_stats().cached_order;
+    int nodes = Tensor::backward_stats().nodes;
+    d.backward(true);
+    if (
+        first || !Tensor::backward_stats().cached_order || nodes != 5 ||
+        grads != Gradients{135, 135}
+    ) {
+        throw std::logic_error("backward_order FAILED!");
+    }
+    // deep chains are walked without recursion
+    Tensor x(Shape({1}), 1);
+    Tensor y = x;
+    for (int i = 0; i < 20000; i++) {
+        y = y + x;
+    }
+    y.backward();
+    if (x.grads() != Gradients{20001} || Tensor::backward_stats().nodes != 20001) {
+        throw std::logic_error("backward_order FAILED!");
+    }
+    std::cout << "backward_order PASSED!" << std::endl;
+}
+
+void op_table() {
+    Tensor x(Shape({4, 3}), 1.0f);
+    Tensor weights(Shape({2, 3}), 0.5f);
+    Tensor bias(Shape({2, 1}), 0.0f);
+    Tensor y = Tensor::linear(x, weights, bias, Activation::Sigmoid, Layout::BatchFirst);
+    Tensor z = Tensor::sum(y.transpose(), {1});
+    bool typed = 
+        y.op() == Op::Linear && y.attributes().activation == Activation::Sigmoid && 
+        y.attributes().layout == Layout::BatchFirst &&
+        z.op() == Op::Sum && z.attributes().axes == 2 && z.edges()[0].op() == Op::View;
+    bool table = 
+        std::string(TensorUtill::op_info(Op::SoftmaxCrossEntropy).name) == "softmax_cross_entropy" &&
+        y.forward_fn() == TensorUtill::linear_forward_fn && y.backward_fn() == TensorUtill::linear_backward_fn &&
+        !z.edges()[0].forward_fn() && z.edges()[0].backward_fn() &&
+        x.op() == Op::None && !x.forward_fn() && !x.backward_fn();
+    // the nodes of a released graph are reused by the next one
+    std::set<Node*> nodes = {y.data().get(), z.data().get(), z.edges()[0].data().get()};
+    y = x, z = x;
+    Tensor w = Tensor::linear(x, weights, bias, Activation::Sigmoid, Layout::BatchFirst);
+    bool pooled = AllocatorUtill::mode() == AllocatorUtill::Mode::System || nodes.count(w.data().get());
+    if (!typed || !table || !pooled) {
+        throw std::logic_error("op_table FAILED!");
+    }
+    std::cout << "op_table PASSED!" << std::endl;
+}
+
+void release_graph() {
+    Tensor a(Shape({2}), {1.0, 2.0});
+    Tensor y;
+    std::weak_ptr<Node> b_node, c_node;
+    {
+        Tensor b = Tensor::exp(a);
+        Tensor c = b * a;
+        b_node = b.data(), c_node = c.data();
+        y = Tensor::sum(c);
+    }
+    y.backward(true);
+    bool retained = !b_node.expired() && !c_node.expired() && y.edges().size() == 1;
+    // y = sum(a e^a), y' = (a + 1) e^a
+    Gradients grads = a.grads();
+    y.backward();
+    if (
+        !retained || !b_node.expired() || !c_node.expired() || !y.edges().empty() || y.backward_fn() ||
+        std::abs(grads[0] - 2.0f * std::exp(1.0f)) > 1e-4 ||
+        std::abs(grads[1] - 3.0f * std::exp(2.0f)) > 1e-3 ||
+        std::abs(y.values()[0] - (std::exp(1.0f) + 2.0f * std::exp(2.0f))) > 1e-3
+    ) {
+        throw std::logic_error("release_graph FAILED!");
+    }
+    std::cout << "release_graph PASSED!" << std::endl;
+}
+
+/*
+    @return gradients of x, weights and bias of an ensemble of branches sharing their parameters 
+    and input, under scheduler
+*/
+std::vector<Gradients> ensemble_grads(int in, int out, int batch, int branches, BackwardScheduler scheduler, bool& parallel) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Values x_values(in * batch), weights_values(out * in);
+    for (auto& x : x_values) x = dist(rng);
+    for (auto& x : weights_values) x = dist(rng);
+    Tensor x(Shape({in, batch}), x_values), weights(Shape({out, in}), weights_values), bias(Shape({out, 1}), 0.1f);
+    Tensor total(0.0f);
+    for (int i = 0; i < branches; i++) {
+        Tensor y = Tensor::linear(x * Tensor(0.1f * i), weights, bias, Activation::Tanh);
+        total = total + Tensor::sum(Tensor::softmax(y, 0) * y);
+    }
+    Tensor::set_backward_scheduler(scheduler);
+    total.backward();
+    parallel = Tensor::backward_stats().parallel;
+    Tensor::set_backward_scheduler(BackwardScheduler::Auto);
+    return {x.grads(), weights.grads(), bias.grads()};
+}
+
+void parallel_backward() {
+    bool serial_parallel, parallel;
+    bool small = ensemble_grads(6, 4, 5, 24, BackwardScheduler::Serial, serial_parallel) ==
+        ensemble_grads(6, 4, 5, 24, BackwardScheduler::Parallel, parallel);
+    bool small_parallel = parallel == (omp_get_max_threads() > 1);
+    // products large enough for the blocked, threaded GEMM, which runs nested in the team
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(std::max(threads, 4));
+    bool gemm = ensemble_grads(64, 64, 96, 8, BackwardScheduler::Serial, serial_parallel) ==
+        ensemble_grads(64, 64, 96, 8, BackwardScheduler::Parallel, parallel);
+    omp_set_num_threads(threads);
+    if (!small || !small_parallel || !gemm || !parallel || serial_parallel) {
+        throw std::logic_error("parallel_backward FAILED!");
+    }
+    std::cout << "parallel_backward PASSED!" << std::endl;
+}
+
+void no_grad() {
+    Tensor a(Shape({2, 3}), 2.0);
+    Tensor b(Shape({3}), 4.0);
+    Tensor c;
+    bool other_thread = true;
+    {
+        NoGradGuard guard;
+        c = Tensor::relu(a * b).transpose();
+        std::thread([&]() { other_thread = NoGradGuard::active(); }).join();
+    }
+    Tensor d = a * b;
+    if (
+        other_thread || NoGradGuard::active() ||
+        !c.edges().empty() || c.backward_fn() || c.requires_grad() || c.values()[0] != 8 ||
+        d.edges().size() != 2 || !d.backward_fn() || !d.requires_grad()
+    ) {
+        throw std::logic_error("no_grad FAILED!");
+    }
+    std::cout << "no_grad PASSED!" << std::endl;
+}
+
+void in_place() {
+    Tensor a(Shape({2, 3}), Values({1, 2, 3, 4, 5, 6}));
+    a.requires_grad() = false;
+    const float* buffer = a.values().data();
+    Data node = a.data();
+    a += Tensor(Shape({3}), Values({1, 1, 1}));
+    a.mul_(2.0f).add_(-4.0f).clamp_(0.0f, 6.0f);
+    a /= Tensor(Shape({2, 1}), Values({1, 2}));
+    bool dense = a.values() == Values({0, 2, 4, 3, 3, 3}) && a.values().data() == buffer && a.data() == node && a.version() == 5;
+    // strided views and operands overlapping the output
+    Tensor b(Shape({3, 3}), Values({1, 2, 3, 4, 5, 6, 7, 8, 9}));
+    b.requires_grad() = false;
+    b.slice({{0, 3}, {1, 2}}).mul_(10.0f);
+    b += b.transpose();
+    bool views = b.values() == Values({2, 24, 10, 24, 100, 86, 10, 86, 18}) && b.version() == 2;
+    // backward rejects graphs whose saved values were overwritten
+    Tensor x(Shape({3}), 1.0f), y(Shape({3}), 2.0f);
+    Tensor product = Tensor::sum(x * y), total = Tensor::sum(x + y);
+    {
+        NoGradGuard guard;
+        x.mul_(3.0f);
+    }
+    bool rejected = false;
+    try {
+        product.backward();
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    total.backward();
+    // tensors in the graph cannot be written in place while it is recorded
+    bool guarded = false;
+    try {
+        x.mul_(2.0f);
+    } catch (const std::runtime_error&) {
+        guarded = x.version() == 1;
+    }
+    if (!dense || !views || !rejected || !guarded || x.grads() != Gradients({1, 1, 1})) {
+        throw std::logic_error("in_place FAILED!");
+    }
+    std::cout << "in_place PASSED!" << std::endl;
+}
+
+void static_graph() {
+    int rows = 29, in = 6, out = 5, batch = 8;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Values x_values(rows * in), weights_values(out * in), bias_values(out), label_values(rows);
+    for (auto& x : x_values) x = dist(rng);
+    for (auto& x : weights_values) x = dist(rng);
+    for (auto& x : bias_values) x = dist(rng);
+    for (int i = 0; i < rows; i++) label_values[i] = i % out;
+    Tensor data(Shape({rows, in}), x_values), labels(Shape({rows}), label_values);
+    Tensor weights[2], bias[2];
+    for (int k = 0; k < 2; k++) {
+        weights[k] = Tensor(Shape({out, in}), weights_values);
+        bias[k] = Tensor(Shape({out, 1}), bias_values);
+    }
+    // covers fused, elementwise, reduction, softmax and view ops
+    auto step = [&](int k, const std::vector<Tensor>& inputs) {
+        Tensor y = Tensor::linear(inputs[0], weights[k], bias[k], Activation::Tanh, Layout::BatchFirst);
+        Tensor z = Tensor::exp(Tensor::log_softmax(y, 1)) * y - Tensor::max(y, Axes{1}, true);
+        Tensor penalty = Tensor::sum(Tensor::relu(z.transpose())) / Tensor(float(inputs[0].shape()[0]));
+        return Tensor::softmax_cross_entropy(z, inputs[1], 1) + penalty;
+    };
+    StaticGraph graph([&](const std::vector<Tensor>& inputs) { return step(0, inputs); });
+    bool same = true, allocation_free = true;
+    for (int epoch = 0; epoch < 2; epoch++) {
+        for (int i = 0; i < rows; i += batch) {
+            int end = std::min(rows, i + batch);
+            std::vector<Tensor> inputs = {data.slice({{i, end}, {0, in}}), labels.slice({{i, end}})};
+            for (int k = 0; k < 2; k++) {
+                std::fill(weights[k].grads().begin(), weights[k].grads().end(), 0.0f);
+                std::fill(bias[k].grads().begin(), bias[k].grads().end(), 0.0f);
+            }
+            long long allocations = AllocatorUtill::stats().allocations;
+            int replays = graph.replays();
+            Tensor replayed = graph(inputs);
+            // replays write into the buffers bound when the plan was captured
+            if (graph.replays() > replays) {
+                allocation_free &= AllocatorUtill::stats().allocations == allocations;
+            }
+            Tensor eager = step(1, inputs);
+            eager.backward();
+            same &= std::abs(replayed.values()[0] - eager.values()[0]) < 1e-5;
+            for (int j = 0; j < out * in; j++) {
+                same &= std::abs(weights[0].grads()[j] - weights[1].grads()[j]) < 1e-5;
+            }
+            for (int j = 0; j < out; j++) {
+                same &= std::abs(bias[0].grads()[j] - bias[1].grads()[j]) < 1e-5;
+            }
+            // replays read the parameters updated in place
+            for (int k = 0; k < 2; k++) {
+                for (int j = 0; j < out * in; j++) {
+                    weights[k].values()[j] -= 0.1f * weights[k].grads()[j];
+                }
+            }
+        }
+    }
+    // one plan for the full batches and one for the last batch of 5
+    if (!same || !allocation_free || graph.captures() != 2 || graph.replays() != 6) {
+        throw std::logic_error("static_graph FAILED!");
+    }
+    std::cout << "static_graph PASSED!" << std::endl;
+}
+
+class Block : public Model {
+public:
+    Linear l1, l2, l3;
+    Block() {}
+    Block(int width) {
+        l1 = Linear(this, width, width, Activation::Tanh, Layout::BatchFirst);
+        l2 = Linear(this, width, width, Activation::Relu, Layout::BatchFirst);
+        l3 = Linear(this, width, width, Activation::None, Layout::BatchFirst);
+    }
+    Tensor forward(Tensor x) override {
+        return l3(l2(l1(x)));
+    }
+};
+
+class Deep : public Model {
+public:
+    Block blocks[2];
+    Checkpoint checkpoints[2];
+    bool checkpointed;
+    Deep(int width, bool checkpointed) : checkpointed(checkpointed) {
+        for (int k = 0; k < 2; k++) {
+            blocks[k] = Block(width);
+            if (checkpointed) {
+                checkpoints[k] = Checkpoint(this, &blocks[k]);
+            } else {
+                parameters.insert(parameters.end(), blocks[k].parameters.begin(), blocks[k].parameters.end());
+            }
+        }
+    }
+    Tensor forward(Tensor x) override {
+        for (int k = 0; k < 2; k++) {
+            x = checkpointed ? checkpoints[k](x) : blocks[k](x);
+        }
+        return x;
+    }
+};
+
+void checkpoint() {
+    int batch = 8, width = 16;
+    Deep eager(width, false), checkpointed(width, true);
+    for (int i = 0; i < (int)eager.parameters.size(); i++) {
+        checkpointed.parameters[i].values() = eager.parameters[i].values();
+    }
+    Values x_values(batch * width), label_values(batch);
+    for (int i = 0; i < batch * width; i++) x_values[i] = std::sin(i * 0.37f);
+    for (int i = 0; i < batch; i++) label_values[i] = i % width;
+    Tensor labels(Shape({batch}), label_values);
+    Tensor x[2] = {Tensor(Shape({batch, width}), x_values), Tensor(Shape({batch, width}), x_values)};
+    Tensor losses[2];
+    Deep* models[2] = {&eager, &checkpointed};
+    for (int k = 0; k < 2; k++) {
+        losses[k] = Tensor::softmax_cross_entropy((*models[k])(x[k]), labels, 1);
+        losses[k].backward();
+    }
+    bool same = losses[0].values() == losses[1].values() && x[0].grads() == x[1].grads();
+    for (int i = 0; i < (int)eager.parameters.size(); i++) {
+        same &= eager.parameters[i].grads() == checkpointed.parameters[i].grads();
+    }
+    // the outputs of l1 and l2 are not kept between the passes
+    const CheckpointStats& stats = checkpointed.checkpoints[1].stats();
+    if (!same || stats.saved_bytes != 2 * batch * width * (long long)sizeof(float) || stats.recompute_seconds <= 0.0) {
+        throw std::logic_error("checkpoint FAILED!");
+    }
+    std::cout << "checkpoint PASSED!" << std::endl;
+}
+
+void forward_mode() {
+    int batch = 4, in = 5, out = 3;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto random = [&](Shape shape) {
+        Values values(ViewUtill::shape_size(shape));
+        for (auto& x : values) x = dist(rng);
+        return Tensor(shape, values);
+    };
+    Tensor labels(Shape({2}), Values({0, 2}));
+    // covers every op with a forward mode rule
+    Tensor::Function f = [&](const std::vector<Tensor>& inputs) {
+        const Tensor& x = inputs[0];
+        const Tensor& weights = inputs[1];
+        const Tensor& bias = inputs[2];
+        Tensor y = Tensor::linear(x, weights, bias, Activation::Sigmoid, Layout::BatchFirst);
+        Tensor z = Tensor::softmax(y, 1) * Tensor::exp(y) / (Tensor::relu(y.transpose()).transpose() + Tensor(1.0f));
+        Tensor a = Tensor::log_softmax(z, 1) - Tensor::max(z, Axes{1}, true);
+        Tensor m = Tensor::matmul(a, Tensor::tanh(weights)).slice({{1, 3}, {0, in}});
+        Tensor logits = Tensor::linear(m, weights, bias, Activation::Relu, Layout::BatchFirst);
+        return Tensor::softmax_cross_entropy(logits, labels, 1) + Tensor::sum(m) / Tensor(7.0f) + 
+            Tensor::mean(Tensor::log(x * x + Tensor(1.0f))) - Tensor::sum(Tensor::sum(y, Axes{0}, true)) +
+            Tensor::sum(bias + Tensor(Shape({out, 2}), 0.0f));
+    };
+    std::vector<Tensor> inputs = {random(Shape({batch, in})), random(Shape({out, in})), random(Shape({out, 1}))};
+    std::vector<Tensor> tangents = {random(Shape({batch, in})), random(Shape({out, in})), random(Shape({out, 1}))};
+    Tensor dual = Tensor::jvp(f, inputs, tangents);
+    // the directional derivative equals the gradient times the direction
+    Tensor loss = f(inputs);
+    loss.backward();
+    double expected = 0.0;
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < inputs[k].size(); i++) {
+            expected += inputs[k].grads()[i] * tangents[k].values()[i];
+        }
+    }
+    bool jvp = dual.has_tangent() && dual.edges().empty() && !dual.requires_grad() && dual.tangent().edges().empty() &&
+        std::abs(dual.values()[0] - loss.values()[0]) < 1e-6 && std::abs(dual.tangent().values()[0] - expected) < 1e-4;
+    // f(x) = sum(x^3) + |a x|^2 / 2 has the Hessian diag(6 x) + a^T a
+    Tensor a = random(Shape({3, batch})), x = random(Shape({batch, 1})), v = random(Shape({batch, 1}));
+    Tensor hv = Tensor::hvp([&](const std::vector<Tensor>& inputs) {
+        Tensor ax = Tensor::matmul(a, inputs[0]);
+        return Tensor::sum(inputs[0] * inputs[0] * inputs[0]) + Tensor::sum(ax * ax) / Tensor(2.0f);
+    }, {x}, {v})[0];
+    bool hvp = hv.shape() == x.shape() && x.grads() == Gradients(batch, 0.0f);
+    for (int i = 0; i < batch; i++) {
+        float expected = 6.0f * x.values()[i] * v.values()[i];
+        for (int j = 0; j < batch; j++) {
+            for (int k = 0; k < 3; k++) {
+                expected += a.value({k, i}) * a.value({k, j}) * v.values()[j];
+            }
+        }
+        hvp &= std::abs(hv.values()[i] - expected) < 1e-4;
+    }
+    if (!jvp || !hvp) {
+        throw std::logic_error("forward_mode FAILED!");
+    }
+    std::cout << "forward_mode PASSED!" << std::endl;
+}
+
+void lazy_fusion() {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto random = [&](Shape shape) {
+        Values values(ViewUtill::shape_size(shape));
+        for (auto& x : values) x = dist(rng);
+        return Tensor(shape, values);
+    };
+    // large enough for threads, too long for one fused kernel
+    Tensor x = random(Shape({128, 300})), b = random(Shape({1, 300})), c = random(Shape({1}));
+    Tensor d;
+    auto f = [&]() {
+        d = x - b;
+        Tensor e = Tensor::sigmoid(d) * Tensor::tanh(d) / (Tensor::exp(d * c) + Tensor::relu(d));
+        return Tensor::sum(e + Tensor::log(d * d + Tensor(1.0f))) / Tensor(2.0f);
+    };
+    Tensor eager = f();
+    eager.backward();
+    Gradients x_grad = x.grads(), b_grad = b.grads(), c_grad = c.grads();
+    x.grads().assign(x.size(), 0.0f), b.grads().assign(b.size(), 0.0f), c.grads().assign(1, 0.0f);
+    Tensor lazy;
+    {
+        LazyGuard guard;
+        lazy = f();
+    }
+    bool pending = lazy.data()->pending && d.data()->pending && lazy.op() == Op::Fused;
+    lazy.backward();
+    auto close = [](const Gradients& a, const Gradients& b) {
+        bool close = a.size() == b.size();
+        for (int i = 0; close && i < (int)a.size(); i++) {
+            close &= std::abs(a[i] - b[i]) <= 1e-4f * (1.0f + std::abs(b[i]));
+        }
+        return close;
+    };
+    bool values = std::abs(lazy.values()[0] - eager.values()[0]) <= 1e-4f * std::abs(eager.values()[0]);
+    bool grads = close(x.grads(), x_grad) && close(b.grads(), b_grad) && close(c.grads(), c_grad);
+    // the squared error is one pass forward and one backward instead of four and four
+    Tensor p = random(Shape({50})), q = random(Shape({50}));
+    LazyGuard::reset_stats();
+    Tensor error;
+    {
+        LazyGuard guard;
+        error = Tensor::sum((p - q) * (p - q));
+    }
+    float expected = 0.0f;
+    for (int i = 0; i < 50; i++) {
+        expected += (p.values()[i] - q.values()[i]) * (p.values()[i] - q.values()[i]);
+    }
+    bool forward = std::abs(error.values()[0] - expected) < 1e-4 && LazyGuard::stats().kernels == 1 && 
+        LazyGuard::stats().passes_saved == 3;
+    error.backward();
+    bool backward = LazyGuard::stats().kernels == 2 && LazyGuard::stats().passes_saved == 6 && 
+        std::abs(p.grads()[7] - 2.0f * (p.values()[7] - q.values()[7])) < 1e-5;
+    // without a graph the inputs are held only until the values are computed
+    NoGradGuard no_grad;
+    LazyGuard guard;
+    Tensor r = Tensor::exp(p) * Tensor(2.0f);
+    bool inference = r.data()->pending && !r.requires_grad() && r.edges().size() == 2 &&
+        std::abs(r.values()[3] - 2.0f * std::exp(p.values()[3])) < 1e-5 && r.edges().empty();
+    if (!pending || !values || !grads || !forward || !backward || !inference) {
+        throw std::logic_error("lazy_fusion FAILED!");
+    }
+    std::cout << "lazy_fusion PASSED!" << std::endl;
+}
+
+void half_precision() {
+    using namespace HalfUtill;
+    bool scalar = float_to_bf16(1.0f) == 0x3f80 && float_to_fp16(1.0f) == 0x3c00 &&
+        float_to_fp16(65504.0f) == 0x7bff && float_to_fp16(1e5f) == 0x7c00 && float_to_fp16(-0.0f) == 0x8000 &&
+        float_to_fp16(std::ldexp(1.0f, -24)) == 0x0001 && fp16_to_float(0x0001) == std::ldexp(1.0f, -24) &&
+        // ties round to even
+        float_to_bf16(1.0f + std::ldexp(1.0f, -8)) == 0x3f80 && float_to_fp16(1.0f + std::ldexp(1.0f, -11)) == 0x3c00 &&
+        float_to_bf16(-3.0f) == 0xc040 && bf16_to_float(0xc040) == -3.0f &&
+        // bf16 flushes subnormals
+        float_to_bf16(std::ldexp(1.0f, -130)) == 0x0000 && float_to_bf16(-std::ldexp(1.0f, -127)) == 0x8000;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> dist(-4.0f, 4.0f);
+    std::vector<float> f(1003);
+    for (auto& x : f) x = dist(rng) * std::exp(dist(rng));
+    for (int i = 0; i < 64; i += 2) {
+        f[i] = std::ldexp(dist(rng), -128 - i / 4);
+    }
+    // the vector conversions agree with the scalar ones
+    bool vector = true;
+    for (DType type : {DType::BFloat16, DType::Float16}) {
+        std::vector<Half> h(f.size());
+        std::vector<float> back(f.size());
+        HalfUtill::from_float(type, f.data(), h.data(), f.size());
+        HalfUtill::to_float(type, h.data(), back.data(), f.size());
+        for (int i = 0; i < (int)f.size(); i++) {
+            vector &= h[i] == HalfUtill::from_float(type, f[i]) && back[i] == HalfUtill::to_float(type, h[i]);
+            // the subnormals at the front underflow
+            vector &= i < 64 || std::abs(back[i] - f[i]) <= std::abs(f[i]) * (type == DType::BFloat16 ? 1.0f / 256 : 1.0f / 2048);
+        }
+    }
+    auto random = [&](Shape shape) {
+        Values values(ViewUtill::shape_size(shape));
+        for (auto& x : values) x = dist(rng) / 4.0f;
+        return Tensor(shape, values);
+    };
+    // ops on half tensors match the same ops on their rounded float values
+    Tensor x = random(Shape({64, 40})), weights = random(Shape({40, 8})), b = random(Shape({1, 40}));
+    Tensor x16 = x.to(DType::Float16), weights16 = weights.to(DType::BFloat16);
+    Tensor xr, weightsr;
+    {
+        NoGradGuard no_grad;
+        xr = x16.to(DType::Float32), weightsr = weights16.to(DType::Float32);
+    }
+    xr.requires_grad() = weightsr.requires_grad() = true;
+    bool storage = x16.dtype() == DType::Float16 && x16.halves().size() == 64 * 40 && x16.data()->storage->values.empty() &&
+        xr.dtype() == DType::Float32 && x16.transpose().contiguous().dtype() == DType::Float16;
+    auto f_of = [&](const Tensor& x, const Tensor& weights) {
+        Tensor z = Tensor::exp(x) * b - Tensor::sigmoid(x.transpose()).transpose();
+        return Tensor::sum(Tensor::matmul(z, weights)) + Tensor::sum(Tensor::softmax(x, 1) * Tensor::max(x, 0));
+    };
+    Tensor half = f_of(x16, weights16);
+    half.backward();
+    Tensor single = f_of(xr, weightsr);
+    single.backward();
+    auto close = [](float a, float b) { return std::abs(a - b) <= 1e-4f * (1.0f + std::abs(b)); };
+    bool ops = close(half.values()[0], single.values()[0]);
+    for (int i = 0; i < x.size(); i++) {
+        ops &= close(x.grads()[i], xr.grads()[i]);
+    }
+    for (int i = 0; i < weights.size(); i++) {
+        ops &= close(weights.grads()[i], weightsr.grads()[i]);
+    }
+    // in place updates round back to the type of the tensor
+    NoGradGuard no_grad;
+    Tensor t = Tensor(Shape({3, 1}), Values({1.0f, 2.5f, -3.0f})).to(DType::BFloat16);
+    t.transpose().mul_(3.0f);
+    t += Tensor(0.5f);
+    Tensor values = t.to(DType::Float32);
+    bool in_place = values.values() == Values({3.5f, 8.0f, -8.5f}) && t.version() == 2;
+    if (!scalar || !vector || !storage || !ops || !in_place) {
+        throw std::logic_error("half_precision FAILED!");
+    }
+    std::cout << "half_precision PASSED!" << std::endl;
+}
+
+void mixed_precision() {
+    Tensor x(Shape({4, 3}), Values({0.5f, -1.0f, 2.0f, 0.25f, 3.0f, -0.75f, 1.5f, -2.0f, 0.125f, 1.0f, -0.5f, 4.0f}));
+    Values initial = {0.1f, -0.2f, 0.3f, 0.7f, -0.9f, 1.1f, 0.01f, 0.5f, -0.33f, 2.0f, -1.5f, 0.05f};
+    Tensor weights(Shape({4, 3}), initial), bias(Shape({1, 3}), 0.2f);
+    Tensor weightsr(Shape({4, 3}), initial), biasr(Shape({1, 3}), 0.2f);
+    SGD sgd({weights, bias}, 0.1f, 0.9f), reference({weightsr, biasr}, 0.1f, 0.9f);
+    sgd.set_precision(DType::BFloat16, 1024.0f, 2);
+    auto f_of = [&](const Tensor& weights, const Tensor& bias) {
+        return Tensor::sum(x * weights + bias);
+    };
+    // the parameters hold the master copies rounded to the half type
+    auto rounded = [&]() {
+        NoGradGuard no_grad;
+        Values w = weights.to(DType::Float32).values(), b = bias.to(DType::Float32).values();
+        bool equal = weights.dtype() == DType::BFloat16 && bias.dtype() == DType::BFloat16;
+        for (int i = 0; i < weights.size(); i++) {
+            equal &= w[i] == HalfUtill::bf16_to_float(HalfUtill::float_to_bf16(weightsr.values()[i]));
+        }
+        for (int i = 0; i < bias.size(); i++) {
+            equal &= b[i] == HalfUtill::bf16_to_float(HalfUtill::float_to_bf16(biasr.values()[i]));
+        }
+        return equal;
+    };
+    bool storage = rounded();
+    // gradients do not depend on the parameters, so updates from the unscaled gradients
+    // of the master copies match float updates exactly
+    bool updates = true, scaled = true;
+    for (int step = 0; step < 3; step++) {
+        sgd.zero();
+        reference.zero();
+        float scale = sgd.loss_scale();
+        Tensor loss = sgd.scale_loss(f_of(weights, bias));
+        loss.backward();
+        f_of(weightsr, biasr).backward();
+        scaled &= bias.grads()[0] == 4.0f * scale;
+        sgd.update();
+        reference.update();
+        updates &= rounded();
+    }
+    // two good steps in a row double the scale
+    bool growth = sgd.loss_scale() == 2048.0f && sgd.loss_scaling().good_steps == 1;
+    // a step with an overflowed gradient is skipped and halves the scale
+    sgd.zero();
+    sgd.scale_loss(f_of(weights, bias)).backward();
+    weights.grads()[5] = std::numeric_limits<float>::infinity();
+    unsigned long long version = weights.version();
+    sgd.update();
+    bool skipped = sgd.loss_scale() == 1024.0f && sgd.loss_scaling().skipped_steps == 1 &&
+        sgd.loss_scaling().good_steps == 0 && weights.version() == version && rounded();
+    if (!storage || !updates || !scaled || !growth || !skipped) {
+        throw std::logic_error("mixed_precision FAILED!");
+    }
+    std::cout << "mixed_precision PASSED!" << std::endl;
+}
+
+void allocator() {
+    AllocatorUtill::Mode mode = AllocatorUtill::mode();
+    AllocatorUtill::set_mode(AllocatorUtill::Mode::Caching);
+    bool classes = 
+        AllocatorUtill::size_class(1) == 64 && AllocatorUtill::size_class(64) == 64 &&
+        AllocatorUtill::size_class(65) == 128 && AllocatorUtill::size_class(1000) == 1024 &&
+        AllocatorUtill::size_class(1025) == 1280 && AllocatorUtill::size_class(5000) == 5120;
+    bool aligned = true, reused = true;
+    for (int i = 0; i < 4; i++) {
+        Tensor a(Shape({37, 3}), 1.0f);
+        aligned &= (size_t)a.values().data() % AllocatorUtill::ALIGNMENT == 0;
+        AllocatorStats before = AllocatorUtill::stats();
+        {
+            // same size class as a
+            Tensor b(Shape({111}), 2.0f);
+            b.grads();
+        }
+        Tensor c(Shape({3, 37}));
+        AllocatorStats after = AllocatorUtill::stats();
+        reused &= after.reserved == before.reserved || i == 0;
+        reused &= after.reuse_hits > before.reuse_hits;
+        reused &= after.in_use == before.in_use + (long long)AllocatorUtill::size_class(111 * sizeof(float));
+    }
+    // gradients of released intermediates are reused by the ones computed after them
+    Tensor x(Shape({256}), 0.5f);
+    Tensor y = x;
+    for (int i = 0; i < 8; i++) {
+        y = Tensor::tanh(y);
+    }
+    Tensor z = Tensor::sum(y);
+    AllocatorUtill::reset_peak();
+    AllocatorStats before = AllocatorUtill::stats();
+    z.backward();
+    AllocatorStats after = AllocatorUtill::stats();
+    bool planned = after.peak - before.in_use <= 3 * 1024;
+    // buffers freed on other threads stay in their caches until empty_cache
+    long long in_use = AllocatorUtill::stats().in_use;
+    #pragma omp parallel for
+    for (int i = 0; i < 64; i++) {
+        Tensor t(Shape({i + 1, 100}), 1.0f);
+        Tensor u = Tensor::exp(t);
+    }
+    bool threads = AllocatorUtill::stats().in_use == in_use;
+    AllocatorUtill::empty_cache();
+    threads &= AllocatorUtill::stats().reserved == AllocatorUtill::stats().in_use;
+    AllocatorUtill::set_mode(mode);
+    if (!classes || !aligned || !reused || !planned || !threads) {
+        throw std::logic_error("allocator FAILED!");
+    }
+    std::cout << "allocator PASSED!" << std::endl;
+}
+
 void addition() {
     Tensor a(Shape({2}), 2);
     Tensor b(Shape({2}), 4);
@@ -208,6 +875,63 @@ void large_addition() {
     std::cout << "large_addition PASSED!" << std::endl;
 }
 
+void broadcast() {
+    Tensor a(Shape({2, 3}), {1, 2, 3, 4, 5, 6});
+    Tensor b(Shape({2, 1}), {10, 20});
+    Tensor c(Shape({3}), {1, 2, 3});
+    Tensor d = a + b;
+    Tensor e = a * c;
+    Tensor f = Tensor(2.0f) - a;
+    if (
+        d.values() != Values{11, 12, 13, 24, 25, 26} ||
+        e.values() != Values{1, 4, 9, 4, 10, 18} ||
+        f.values() != Values{1, 0, -1, -2, -3, -4} ||
+        d.shape() != Shape({2, 3})
+    ) {
+        throw std::logic_error("broadcast FAILED!");
+    }
+    std::cout << "broadcast PASSED!" << std::endl;
+}
+
+void broadcast_gradient() {
+    Tensor a(Shape({2, 3}), {1, 2, 3, 4, 5, 6});
+    Tensor b(Shape({2, 1}), {2, 4});
+    Tensor c(Shape({3}), {1, 2, 3});
+    Tensor d = Tensor::sum((a / b) * c);
+    d.backward();
+    if (
+        a.grads() != Gradients{0.5, 1, 1.5, 0.25, 0.5, 0.75} ||
+        b.grads() != Gradients{-3.5, -2} ||
+        c.grads() != Gradients{1.5, 2.25, 3}
+    ) {
+        throw std::logic_error("broadcast_gradient FAILED!");
+    }
+    std::cout << "broadcast_gradient PASSED!" << std::endl;
+}
+
+void large_broadcast() {
+    int n = 300, m = 500;
+    Tensor a(Shape({n, m}), 1.0f);
+    Tensor b(Shape({n, 1}), 2.0f);
+    Tensor c(Shape({1, m}), 3.0f);
+    Tensor d = Tensor::sum((a + b) * c);
+    d.backward();
+    for (int i = 0; i < n; i++) {
+        if (b.grad({i, 0}) != 3.0f * m) {
+            throw std::logic_error("large_broadcast FAILED!");
+        }
+    }
+    for (int j = 0; j < m; j++) {
+        if (c.grad({0, j}) != 3.0f * n) {
+            throw std::logic_error("large_broadcast FAILED!");
+        }
+    }
+    if (d.value({0}) != 9.0f * n * m || a.grad({n - 1, m - 1}) != 3.0f) {
+        throw std::logic_error("large_broadcast FAILED!");
+    }
+    std::cout << "large_broadcast PASSED!" << std::endl;
+}
+
 void sum() {
     Tensor a(Shape({50}), 1);
     Tensor b = Tensor::sum(a);
@@ -235,12 +959,58 @@ void max() {
     Tensor x(Shape({2, 3}), {0, 1, 4, 0, 7, 1});
     Tensor y = Tensor::max(x);
     y.backward();
-    if (x.grads() != std::vector<float>{0.5, 0, 1, 0.5, 1, 0}) {
+    if (x.grads() != Gradients{0.5, 0, 1, 0.5, 1, 0}) {
         throw std::logic_error("max FAILED!");
     }
     std::cout << "max PASSED!" << std::endl;
 }
 
+void multi_axis_reduction() {
+    Tensor a(Shape({2, 3, 4}), {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+        12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23
+    });
+    Tensor b = Tensor::sum(a, Axes({0, 2}), true);
+    Tensor c = Tensor::max(a, Axes({0, 2}));
+    Tensor d = Tensor::sum(b * Tensor(Shape({1, 3, 1}), {1, 2, 3})) + Tensor::sum(c);
+    d.backward();
+    if (
+        b.shape() != Shape({1, 3, 1}) || b.values() != Values{60, 92, 124} ||
+        c.shape() != Shape({3}) || c.values() != Values{15, 19, 23} ||
+        a.grad({0, 1, 2}) != 2 || a.grad({1, 2, 3}) != 4 || a.grad({1, 0, 3}) != 2
+    ) {
+        throw std::logic_error("multi_axis_reduction FAILED!");
+    }
+    std::cout << "multi_axis_reduction PASSED!" << std::endl;
+}
+
+void large_reduction() {
+    int m = 3, n = 100000;
+    Values values(m * n);
+    for (int i = 0; i < m * n; i++) {
+        values[i] = (i * 7919LL) % 1000 / 1000.0f;
+    }
+    values[1 * n + 54321] = 2.0f;
+    Tensor a(Shape({m, n}), values);
+    Tensor b = Tensor::sum(a, 1);
+    Tensor c = Tensor::max(a, 1);
+    Tensor d = Tensor::max(a.transpose(), 0);
+    Tensor::sum(c).backward();
+    for (int i = 0; i < m; i++) {
+        double expected = 0.0;
+        for (int j = 0; j < n; j++) {
+            expected += values[i * n + j];
+        }
+        if (std::abs(b.value({i}) - expected) > 1e-5 * expected || c.value({i}) != d.value({i})) {
+            throw std::logic_error("large_reduction FAILED!");
+        }
+    }
+    if (c.value({1}) != 2.0f || a.grad({1, 54321}) != 1.0f || a.grad({1, 0}) != 0.0f) {
+        throw std::logic_error("large_reduction FAILED!");
+    }
+    std::cout << "large_reduction PASSED!" << std::endl;
+}
+
 void exp() {
     Tensor a(Shape({2, 3}), 2);
     Tensor b = Tensor::exp(a);
@@ -300,6 +1070,91 @@ void log_softmax() {
     std::cout << "log_softmax PASSED!" << std::endl;
 }
 
+void wide_softmax() {
+    int features = 1000, batch = 37;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-5.0f, 5.0f);
+    Values u_values(features * batch), c_values(features * batch);
+    for (auto& x : u_values) x = dist(rng);
+    for (auto& x : c_values) x = dist(rng);
+    Tensor c(Shape({features, batch}), c_values);
+    for (bool log : {false, true}) {
+        Tensor u(Shape({features, batch}), u_values);
+        Tensor w = log ? Tensor::log_softmax(u) : Tensor::softmax(u);
+        Tensor::sum(w * c).backward();
+        for (int k = 0; k < batch; k++) {
+            double max_value = -1e30, sum = 0.0, dot = 0.0, c_sum = 0.0;
+            for (int i = 0; i < features; i++) {
+                max_value = std::max(max_value, (double)u.value({i, k}));
+            }
+            for (int i = 0; i < features; i++) {
+                sum += std::exp(u.value({i, k}) - max_value);
+            }
+            for (int i = 0; i < features; i++) {
+                double y = std::exp(u.value({i, k}) - max_value) / sum;
+                dot += c.value({i, k}) * y;
+                c_sum += c.value({i, k});
+            }
+            for (int i = 0; i < features; i++) {
+                double y = std::exp(u.value({i, k}) - max_value) / sum;
+                double value = log ? std::log(y) : y;
+                double grad = log ? c.value({i, k}) - y * c_sum : y * (c.value({i, k}) - dot);
+                if (
+                    std::abs(w.value({i, k}) - value) > 1e-5 * std::max(1.0, std::abs(value)) ||
+                    std::abs(u.grad({i, k}) - grad) > 1e-4 * std::max(1.0, std::abs(grad))
+                ) {
+                    throw std::logic_error("wide_softmax FAILED!");
+                }
+            }
+        }
+    }
+    std::cout << "wide_softmax PASSED!" << std::endl;
+}
+
+void softmax_cross_entropy() {
+    // long lines, and more samples than a chunk of columns
+    for (auto [classes, batch] : std::vector<std::pair<int, int>>{{5, 3}, {100000, 3}, {40, 600}}) {
+        std::mt19937 rng(classes);
+        std::uniform_real_distribution<float> dist(-3.0f, 3.0f);
+        Values u_values(classes * batch), one_hot(classes * batch, 0.0f);
+        for (auto& x : u_values) x = dist(rng);
+        Values labels(batch);
+        for (int k = 0; k < batch; k++) {
+            labels[k] = (1 + 3 * k) % 5;
+        }
+        for (int k = 0; k < batch; k++) {
+            one_hot[labels[k] * batch + k] = 1.0f;
+        }
+        Tensor u(Shape({classes, batch}), u_values);
+        Tensor loss = Tensor::softmax_cross_entropy(u, Tensor(Shape({batch}), labels));
+        loss.backward();
+        Tensor v(Shape({classes, batch}), u_values);
+        Tensor expected = -Tensor::mean(Tensor::sum(Tensor(Shape({classes, batch}), one_hot) * Tensor::log_softmax(v), 0));
+        expected.backward();
+        if (loss.size() != 1 || std::abs(loss.value({0}) - expected.value({0})) > 1e-5 * expected.value({0})) {
+            throw std::logic_error("softmax_cross_entropy FAILED!");
+        }
+        for (int i = 0; i < classes * batch; i++) {
+            if (std::abs(u.grads()[i] - v.grads()[i]) > 1e-6) {
+                throw std::logic_error("softmax_cross_entropy FAILED!");
+            }
+        }
+    }
+    // labels are checked in release builds as well
+    for (float label : {5.0f, -1.0f, 1.5f}) {
+        bool rejected = false;
+        try {
+            Tensor::softmax_cross_entropy(Tensor(Shape({5, 2}), 0.0f), Tensor(Shape({2}), Values({0.0f, label})));
+        } catch (const std::out_of_range&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            throw std::logic_error("softmax_cross_entropy FAILED!");
+        }
+    }
+    std::cout << "softmax_cross_entropy PASSED!" << std::endl;
+}
+
 void sigmoid() {
     Tensor a(Shape({2}), 0.4);
     Tensor b = Tensor::sigmoid(a);
@@ -313,6 +1168,62 @@ void sigmoid() {
     std::cout << "sigmoid PASSED!" << std::endl;
 }
 
+void tanh() {
+    Tensor a(Shape({2}), 0.4);
+    Tensor b = Tensor::tanh(a);
+    b.backward();
+    if (
+        abs(b.value({0}) - 0.379949) > 0.001 ||
+        abs(a.grad({0}) - 0.855639) > 0.001
+    ) {
+        throw std::logic_error("tanh FAILED!");
+    }
+    std::cout << "tanh PASSED!" << std::endl;
+}
+
+template <MathUtill::Mode M>
+bool transcendental_within(float max_relative_error) {
+    auto close = [&](float got, double expected) {
+        return std::abs(got - expected) <= max_relative_error * std::abs(expected) + 1e-38;
+    };
+    for (float x = -80.0f; x <= 80.0f; x += 0.0137f) {
+        if (
+            !close(MathUtill::exp<M>(x), std::exp((double)x)) ||
+            !close(MathUtill::sigmoid<M>(x), 1.0 / (1.0 + std::exp(-(double)x))) ||
+            !close(MathUtill::tanh<M>(x), std::tanh((double)x))
+        ) {
+            return false;
+        }
+    }
+    for (float x = 1e-30f; x < 1e30f; x *= 1.37f) {
+        if (!close(MathUtill::log<M>(x), std::log((double)x))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void transcendental() {
+    const float inf = std::numeric_limits<float>::infinity();
+    using MathUtill::Mode;
+    if (
+        !transcendental_within<Mode::Precise>(3e-7f) ||
+        !transcendental_within<Mode::Fast>(1e-5f) ||
+        MathUtill::exp<Mode::Precise>(-200.0f) != 0.0f ||
+        MathUtill::exp<Mode::Precise>(200.0f) != inf ||
+        MathUtill::exp<Mode::Precise>(-100.0f) == 0.0f || // subnormal
+        MathUtill::log<Mode::Precise>(0.0f) != -inf ||
+        MathUtill::log<Mode::Precise>(inf) != inf ||
+        !std::isnan(MathUtill::log<Mode::Precise>(-1.0f)) ||
+        MathUtill::sigmoid<Mode::Precise>(-200.0f) != 0.0f ||
+        MathUtill::sigmoid<Mode::Precise>(200.0f) != 1.0f ||
+        MathUtill::tanh<Mode::Precise>(-200.0f) != -1.0f
+    ) {
+        throw std::logic_error("transcendental FAILED!");
+    }
+    std::cout << "transcendental PASSED!" << std::endl;
+}
+
 void matmul() {
     Tensor a(Shape({2, 3}), 2.0);
     Tensor b(Shape({3, 2}), 4.0);
@@ -343,6 +1254,214 @@ void matmul_gradient() {
     std::cout << "matmul_gradient PASSED!" << std::endl;
 }
 
+void matmul_requires_grad() {
+    Tensor a = Tensor(Shape({2, 3}), {1.0, 3.0, 5.0, 2.0, 4.0, 6.0}).transpose();
+    Tensor b(Shape({2, 3}), {7.0, 8.0, 9.0, 10.0, 11.0, 12.0});
+    a.requires_grad() = false;
+    Tensor c = Tensor::matmul(a, b);
+    c.backward();
+    if (
+        c.values() != Values{27,  30,  33, 61, 68, 75, 95, 106, 117} ||
+        a.grads() != Gradients{0, 0, 0, 0, 0, 0} ||
+        b.grads() != Gradients{9, 9, 9, 12, 12, 12}
+    ) {
+        throw std::logic_error("matmul_requires_grad FAILED!");
+    }
+    std::cout << "matmul_requires_grad PASSED!" << std::endl;
+}
+
+void lazy_gradients() {
+    Tensor x(Shape({3}), {1.0, 2.0, 3.0});
+    Tensor w(Shape({3}), 2.0);
+    x.requires_grad() = false;
+    Tensor c = Tensor::exp(x) * x;
+    Tensor y = Tensor::sum(c * w + c);
+    if (
+        c.requires_grad() || !y.requires_grad() ||
+        !x.data()->grads.empty() || !w.data()->grads.empty() || !y.data()->grads.empty()
+    ) {
+        throw std::logic_error("lazy_gradients FAILED!");
+    }
+    y.backward();
+    if (
+        !x.data()->grads.empty() || !c.data()->grads.empty() ||
+        w.data()->grads != Gradients{c.values()[0], c.values()[1], c.values()[2]}
+    ) {
+        throw std::logic_error("lazy_gradients FAILED!");
+    }
+    std::cout << "lazy_gradients PASSED!" << std::endl;
+}
+
+void large_matmul() {
+    int m = 37, n = 53, k = 300;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Values a_values(k * m), b_values(k * n);
+    for (auto& x : a_values) x = dist(rng);
+    for (auto& x : b_values) x = dist(rng);
+    Tensor a = Tensor(Shape({k, m}), a_values).transpose();
+    Tensor b(Shape({k, n}), b_values);
+    Tensor c = Tensor::matmul(a, b);
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            float expected = 0.0f;
+            for (int p = 0; p < k; p++) {
+                expected += a.value({i, p}) * b.value({p, j});
+            }
+            if (std::abs(c.value({i, j}) - expected) > 1e-3) {
+                throw std::logic_error("large_matmul FAILED!");
+            }
+        }
+    }
+    std::cout << "large_matmul PASSED!" << std::endl;
+}
+
+void linear() {
+    // spans several packed blocks of the GEMM so the epilogue runs on partial blocks
+    int m = 130, n = 70, k = 300;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Values x_values(n * k), weights_values(m * k), bias_values(m);
+    for (auto& x : x_values) x = dist(rng);
+    for (auto& x : weights_values) x = dist(rng) * 0.1f;
+    for (auto& x : bias_values) x = dist(rng);
+    std::vector<Activation> activations = {Activation::None, Activation::Relu, Activation::Sigmoid, Activation::Tanh};
+    for (Activation activation : activations) {
+        Tensor x[2], weights[2], bias[2], y[2];
+        int edges = 0;
+        for (int fused = 0; fused < 2; fused++) {
+            x[fused] = Tensor(Shape({n, k}), x_values).transpose();
+            weights[fused] = Tensor(Shape({m, k}), weights_values);
+            bias[fused] = Tensor(Shape({m, 1}), bias_values);
+            if (fused) {
+                y[fused] = Tensor::linear(x[fused], weights[fused], bias[fused], activation);
+                edges = y[fused].edges().size();
+            } else {
+                y[fused] = Tensor::matmul(weights[fused], x[fused]) + bias[fused];
+                if (activation == Activation::Relu) y[fused] = Tensor::relu(y[fused]);
+                if (activation == Activation::Sigmoid) y[fused] = Tensor::sigmoid(y[fused]);
+                if (activation == Activation::Tanh) y[fused] = Tensor::tanh(y[fused]);
+            }
+            Tensor::sum(y[fused] * y[fused]).backward();
+        }
+        auto close = [](const Values& a, const Values& b) {
+            for (int i = 0; i < (int)a.size(); i++) {
+                if (std::abs(a[i] - b[i]) > 1e-3 * std::max(1.0f, std::abs(b[i]))) {
+                    return false;
+                }
+            }
+            return a.size() == b.size();
+        };
+        if (
+            edges != 3 ||
+            !close(y[1].values(), y[0].values()) ||
+            !close(x[1].grads(), x[0].grads()) ||
+            !close(weights[1].grads(), weights[0].grads()) ||
+            !close(bias[1].grads(), bias[0].grads())
+        ) {
+            throw std::logic_error("linear FAILED!");
+        }
+    }
+    std::cout << "linear PASSED!" << std::endl;
+}
+
+void batch_first() {
+    int batch = 50, in = 40, out = 30;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Values x_values(batch * in), weights_values(out * in), bias_values(out), label_values(batch);
+    for (auto& x : x_values) x = dist(rng);
+    for (auto& x : weights_values) x = dist(rng);
+    for (auto& x : bias_values) x = dist(rng);
+    for (int i = 0; i < batch; i++) label_values[i] = (i * 7) % out;
+    Tensor x[2], weights[2], bias[2], y[2], loss[2];
+    for (int layout = 0; layout < 2; layout++) {
+        bool rows = layout == 1;
+        x[layout] = Tensor(Shape({batch, in}), x_values);
+        weights[layout] = Tensor(Shape({out, in}), weights_values);
+        bias[layout] = Tensor(Shape({out, 1}), bias_values);
+        y[layout] = Tensor::linear(
+            rows ? x[layout] : x[layout].transpose(), weights[layout], bias[layout], 
+            Activation::Tanh, rows ? Layout::BatchFirst : Layout::FeaturesFirst
+        );
+        loss[layout] = Tensor::softmax_cross_entropy(y[layout], Tensor(Shape({batch}), label_values), rows ? 1 : 0);
+        loss[layout].backward();
+    }
+    auto close = [](const Values& a, const Values& b) {
+        for (int i = 0; i < (int)a.size(); i++) {
+            if (std::abs(a[i] - b[i]) > 1e-5 * std::max(1.0f, std::abs(b[i]))) {
+                return false;
+            }
+        }
+        return a.size() == b.size();
+    };
+    Values transposed = y[0].transpose().contiguous().values();
+    if (
+        y[1].shape() != Shape({batch, out}) ||
+        !close(y[1].values(), transposed) ||
+        !close(loss[1].values(), loss[0].values()) ||
+        !close(x[1].grads(), x[0].grads()) ||
+        !close(weights[1].grads(), weights[0].grads()) ||
+        !close(bias[1].grads(), bias[0].grads())
+    ) {
+        throw std::logic_error("batch_first FAILED!");
+    }
+    std::cout << "batch_first PASSED!" << std::endl;
+}
+
+void backends() {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(0.5f, 1.5f);
+    Values a_values(24 * 40), b_values(40), c_values(40 * 17);
+    for (auto& x : a_values) x = dist(rng);
+    for (auto& x : b_values) x = dist(rng);
+    for (auto& x : c_values) x = dist(rng) - 1.0f;
+    auto run = [&](Values& values, Gradients& grads) {
+        Tensor a(Shape({24, 40}), a_values);
+        Tensor b(Shape({40}), b_values);
+        Tensor c(Shape({40, 17}), c_values);
+        Tensor d = Tensor::log(a * b + Tensor::exp(a - b)) / b;
+        Tensor e = Tensor::sigmoid(Tensor::matmul(d, c)) * Tensor::tanh(Tensor::matmul(d, c)) + Tensor::relu(Tensor::matmul(a, c));
+        Tensor f = Tensor::sum(Tensor::sum(e, 1) + Tensor::max(e.transpose(), 0) + Tensor::log_softmax(e).slice({{0, 24}, {0, 1}}).flatten());
+        f.backward();
+        values = e.values();
+        grads = a.grads();
+        grads.insert(grads.end(), b.grads().begin(), b.grads().end());
+        grads.insert(grads.end(), c.grads().begin(), c.grads().end());
+    };
+    std::string previous = BackendUtill::backend().name();
+    Values expected_values, values;
+    Gradients expected_grads, grads;
+    BackendUtill::set_backend("reference");
+    run(expected_values, expected_grads);
+    for (const std::string& name : BackendUtill::available_backends()) {
+        BackendUtill::set_backend(name);
+        run(values, grads);
+        for (int i = 0; i < (int)values.size(); i++) {
+            if (std::abs(values[i] - expected_values[i]) > 1e-3) {
+                throw std::logic_error("backends FAILED!");
+            }
+        }
+        for (int i = 0; i < (int)grads.size(); i++) {
+            if (std::abs(grads[i] - expected_grads[i]) > 1e-2 * std::max(1.0f, std::abs(expected_grads[i]))) {
+                throw std::logic_error("backends FAILED!");
+            }
+        }
+    }
+    BackendUtill::set_backend(previous);
+    // an unknown name is rejected and leaves the active backend in place
+    bool rejected = false;
+    try {
+        BackendUtill::set_backend("unknown");
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    if (!rejected || BackendUtill::backend().name() != previous) {
+        throw std::logic_error("backends FAILED!");
+    }
+    std::cout << "backends PASSED!" << std::endl;
+}
+
 int main() {
 
     std::vector<void(*)()> tests = {
@@ -352,7 +1471,22 @@ int main() {
         &reshape,
         &transpose,
         &slice,
+        &view,
+        &view_gradient,
         &edges,
+        &backward_order,
+        &op_table,
+        &release_graph,
+        &parallel_backward,
+        &no_grad,
+        &in_place,
+        &static_graph,
+        &checkpoint,
+        &forward_mode,
+        &lazy_fusion,
+        &half_precision,
+        &mixed_precision,
+        &allocator,
         &addition,
         &addition_gradient,
         &multiplication,
@@ -361,15 +1495,30 @@ int main() {
         &division_gradient,
         &mixed_gradient,
         &large_addition,
+        &broadcast,
+        &broadcast_gradient,
+        &large_broadcast,
         &sum,
         &max,
+        &multi_axis_reduction,
+        &large_reduction,
         &exp,
         &relu,
         &softmax,
         &log_softmax,
+        &wide_softmax,
+        &softmax_cross_entropy,
         &sigmoid,
+        &tanh,
+        &transcendental,
         &matmul,
-        &matmul_gradient
+        &matmul_gradient,
+        &matmul_requires_grad,
+        &lazy_gradients,
+        &large_matmul,
+        &linear,
+        &batch_first,
+        &backends
     };
     for (auto test : tests) {
         test();
@@ -14,8 +14,11 @@ namespace RevGrad {
     }
 
     std::ostream& operator<<(std::ostream& os, const Tensor& tensor) {
+        if (tensor.dtype() != DType::Float32) {
+            NoGradGuard no_grad;
+            return os << tensor.to(DType::Float32);
+        }
         os << "Tensor(shape=" << tensor.shape() << ", data=";
-        const Values& values = tensor.values();
         Indices indices(tensor.shape().size());
         std::function<void(int)> print_tensor = [&] (int level) {
             if (level == (int)tensor.shape().size()) {